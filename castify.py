@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 # pip3 install pycryptodome
 
-import sys, os, struct
+import sys, os, struct, zlib
 import __future__
 
 from base64 import b16decode
@@ -17,6 +17,39 @@ loaderfile = sys.argv[1]
 elffile = sys.argv[2]
 outfile = sys.argv[3]
 hybrid_mbr_ancast = sys.argv[4].lower() == "true"
+compress_elf = len(sys.argv) > 5 and sys.argv[5].lower() == "true"
+
+# ioshdr.argument flags, see elfloader/stub.c
+IOSHDR_FLAG_DEFLATE = 0x1
+
+PT_LOAD = 1
+
+def deflate_elf(elf):
+    # keep the ELF and program headers, replace every PT_LOAD segment with a
+    # zlib stream. p_filesz stays the inflated size, the stub inflates the
+    # stream straight to p_paddr.
+    phoff, = struct.unpack(">I", elf[0x1C:0x20])
+    phentsize, phnum = struct.unpack(">HH", elf[0x2A:0x2E])
+    phend = phoff + phentsize * phnum
+
+    out = bytearray(elf[:max(0x34, phend)])
+    # section headers are not carried over
+    struct.pack_into(">I", out, 0x20, 0)
+    struct.pack_into(">HH", out, 0x30, 0, 0)
+
+    for i in range(phnum):
+        off = phoff + i * phentsize
+        p_type, p_offset, p_vaddr, p_paddr, p_filesz = struct.unpack(">IIIII", elf[off:off+20])
+        if p_type != PT_LOAD or p_filesz == 0:
+            continue
+
+        comp = zlib.compress(elf[p_offset:p_offset+p_filesz], 9)
+        out += b"\x00" * (-len(out) & 3)
+        struct.pack_into(">I", out, off + 4, len(out))
+        out += comp
+        print("Segment %d:   0x%X -> 0x%X bytes." % (i, p_filesz, len(comp)))
+
+    return bytes(out)
 
 print("Building payload...\n")
 
@@ -40,6 +73,13 @@ elf = open(elffile,"rb").read()
 if elflen > 0:
     print("WARNING: loader already contains ELF, will replace.")
 
+elf_flags = 0
+if compress_elf:
+    rawlen = len(elf)
+    elf = deflate_elf(elf)
+    elf_flags |= IOSHDR_FLAG_DEFLATE
+    print("Compressed ELF from 0x%X to 0x%X bytes." % (rawlen, len(elf)))
+
 elflen = len(elf)
 
 if loaderlen < len(loader):
@@ -57,7 +97,7 @@ print("ELF size:    0x%X bytes." % elflen)
 if hybrid_mbr_ancast:
     hdrlen = 0xEA000002
 
-payload = struct.pack(">IIII", hdrlen, loaderlen, elflen, 0) + hdr[16:]
+payload = struct.pack(">IIII", hdrlen, loaderlen, elflen, elf_flags) + hdr[16:]
 payload += loader
 payload += elf
 
@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include "hollywood.h"
 #include "string.h"
 #include "elf.h"
+#include "uzlib/tinf.h"
 
 typedef struct {
     u32 hdrsize;
@@ -33,6 +34,10 @@ typedef struct {
     u32 argument;
 } ioshdr;
 
+// set by castify.py: PT_LOAD segments are zlib streams, p_filesz is the
+// inflated size
+#define IOSHDR_FLAG_DEFLATE (1<<0)
+
 void serial_send(u8 val);
 
 #define SERIAL_DELAY (1)
@@ -137,7 +142,30 @@ void serial_send(u8 val)
 }
 #endif
 
-void *loadelf(const u8 *elf) {
+// 1.3KiB, too big for the stub's stack
+static TINF_DATA d;
+
+static void inflate_segment(void *dst, const u8 *src, u32 size)
+{
+    if (!size)
+        return;
+
+    uzlib_init();
+    uzlib_uncompress_init(&d, NULL, 0);
+    d.source = src;
+    d.readSource = NULL;
+    d.dest = dst;
+    d.destSize = size;
+
+    if (uzlib_zlib_parse_header(&d) < 0)
+        panic(0xE5);
+
+    int res = uzlib_uncompress(&d);
+    if ((res != TINF_OK && res != TINF_DONE) || (u32)(d.dest - (u8*)dst) != size)
+        panic(0xE6);
+}
+
+void *loadelf(const u8 *elf, u32 flags) {
     if(memcmp("\x7F" "ELF\x01\x02\x01",elf,7)) {
         panic(0xE3);
     }
@@ -152,7 +180,10 @@ void *loadelf(const u8 *elf) {
     {
         if(phdr->p_type == PT_LOAD) {
             const void *src = elf + phdr->p_offset;
-            memcpy(phdr->p_paddr, src, phdr->p_filesz);
+            if (flags & IOSHDR_FLAG_DEFLATE)
+                inflate_segment(phdr->p_paddr, src, phdr->p_filesz);
+            else
+                memcpy(phdr->p_paddr, src, phdr->p_filesz);
         }
         phdr++;
     }
@@ -191,10 +222,6 @@ void *_main(void *base)
     ioshdr *hdr = (ioshdr*)base;
     u8 *elf;
     void *entry;
-#if 0
-    u8 dict[0x1000];
-    TINF_DATA d;
-#endif
 
     // boot1 doesn't have an IOS header
     int is_boot1 = 0;
@@ -268,27 +295,6 @@ void *_main(void *base)
     elf = (u8*) base;
     elf += hdr->hdrsize + hdr->loadersize;
 
-#if 0
-    d.source = elf;
-    d.dest = (uint8_t*)TODO;
-    d.destSize = TODO;
-    uzlib_uncompress_init(&d, dict, sizeof(dict));
-    
-    res = uzlib_zlib_parse_header(&d); // returns dict_opt
-    if (res < 0) {
-        return res;
-    }
-    
-    do {
-        res = uzlib_uncompress(&d);
-        d.destSize = 1;
-    } while (res == TINF_OK);
-    
-    if(res != TINF_DONE) {
-        return res;
-    }
-#endif
-
     disable_boot0(1);
 
     if (is_boot1) {
@@ -299,7 +305,7 @@ void *_main(void *base)
         serial_send_u32(0xF00FCAFF);
     }
 
-    entry = loadelf(elf);
+    entry = loadelf(elf, hdr->argument);
     if (is_boot1)
         gpio_debug_send(0x8A);
     if (!is_boot1) {
@@ -0,0 +1,288 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Copyright (C) 2016          SALT
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+/*
+ * Portable AES-128-CBC backend, used instead of the Latte AES engine when
+ * building with CRYPTO_SOFTWARE. T-tables are generated on first use.
+ */
+
+#ifdef CRYPTO_SOFTWARE
+
+#include "types.h"
+#include "crypto.h"
+
+#include <string.h>
+
+#define AES_ROUNDS      (10)
+#define AES_RK_WORDS    (4 * (AES_ROUNDS + 1))
+
+#define ROTL8(x, s)     ((u8)(((x) << (s)) | ((x) >> (8 - (s)))))
+#define ROTR32(x, s)    (((x) >> (s)) | ((x) << (32 - (s))))
+
+#define GETU32(p)       (((u32)(p)[0] << 24) | ((u32)(p)[1] << 16) | ((u32)(p)[2] << 8) | (u32)(p)[3])
+#define PUTU32(p, v)    do { (p)[0] = (u8)((v) >> 24); (p)[1] = (u8)((v) >> 16); \
+                             (p)[2] = (u8)((v) >> 8); (p)[3] = (u8)(v); } while(0)
+
+static u8 aes_sbox[256], aes_inv_sbox[256];
+static u32 aes_te[4][256], aes_td[4][256];
+static int aes_tables_ready = 0;
+
+static u32 aes_erk[AES_RK_WORDS], aes_drk[AES_RK_WORDS];
+static u8 aes_iv[16], aes_chain[16];
+static u32 aes_handle = 0;
+
+static u8 _aes_mul(u8 a, u8 b)
+{
+    u8 r = 0;
+    while(b) {
+        if(b & 1) r ^= a;
+        a = (a << 1) ^ ((a & 0x80) ? 0x1B : 0);
+        b >>= 1;
+    }
+    return r;
+}
+
+static void _aes_build_tables(void)
+{
+    u8 p = 1, q = 1;
+
+    // walk the multiplicative group with generator 3 and its inverse
+    do {
+        p = p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0);
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        q ^= (q & 0x80) ? 0x09 : 0;
+        aes_sbox[p] = q ^ ROTL8(q, 1) ^ ROTL8(q, 2) ^ ROTL8(q, 3) ^ ROTL8(q, 4) ^ 0x63;
+    } while(p != 1);
+    aes_sbox[0] = 0x63;
+
+    for(int i = 0; i < 256; i++)
+        aes_inv_sbox[aes_sbox[i]] = i;
+
+    for(int i = 0; i < 256; i++) {
+        u8 s = aes_sbox[i], is = aes_inv_sbox[i];
+        u32 te = ((u32)_aes_mul(s, 2) << 24) | ((u32)s << 16) | ((u32)s << 8) | _aes_mul(s, 3);
+        u32 td = ((u32)_aes_mul(is, 14) << 24) | ((u32)_aes_mul(is, 9) << 16) |
+                 ((u32)_aes_mul(is, 13) << 8) | _aes_mul(is, 11);
+        for(int t = 0; t < 4; t++) {
+            aes_te[t][i] = t ? ROTR32(te, 8 * t) : te;
+            aes_td[t][i] = t ? ROTR32(td, 8 * t) : td;
+        }
+    }
+
+    aes_tables_ready = 1;
+}
+
+static void _aes_encrypt_block(const u8 *in, u8 *out)
+{
+    const u32 *rk = aes_erk;
+    u32 s0, s1, s2, s3, t0, t1, t2, t3;
+
+    s0 = GETU32(in) ^ rk[0];
+    s1 = GETU32(in + 4) ^ rk[1];
+    s2 = GETU32(in + 8) ^ rk[2];
+    s3 = GETU32(in + 12) ^ rk[3];
+
+    for(int r = 1; r < AES_ROUNDS; r++) {
+        rk += 4;
+        t0 = aes_te[0][s0 >> 24] ^ aes_te[1][(s1 >> 16) & 0xff] ^ aes_te[2][(s2 >> 8) & 0xff] ^ aes_te[3][s3 & 0xff] ^ rk[0];
+        t1 = aes_te[0][s1 >> 24] ^ aes_te[1][(s2 >> 16) & 0xff] ^ aes_te[2][(s3 >> 8) & 0xff] ^ aes_te[3][s0 & 0xff] ^ rk[1];
+        t2 = aes_te[0][s2 >> 24] ^ aes_te[1][(s3 >> 16) & 0xff] ^ aes_te[2][(s0 >> 8) & 0xff] ^ aes_te[3][s1 & 0xff] ^ rk[2];
+        t3 = aes_te[0][s3 >> 24] ^ aes_te[1][(s0 >> 16) & 0xff] ^ aes_te[2][(s1 >> 8) & 0xff] ^ aes_te[3][s2 & 0xff] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    rk += 4;
+    t0 = ((u32)aes_sbox[s0 >> 24] << 24) ^ ((u32)aes_sbox[(s1 >> 16) & 0xff] << 16) ^
+         ((u32)aes_sbox[(s2 >> 8) & 0xff] << 8) ^ aes_sbox[s3 & 0xff] ^ rk[0];
+    t1 = ((u32)aes_sbox[s1 >> 24] << 24) ^ ((u32)aes_sbox[(s2 >> 16) & 0xff] << 16) ^
+         ((u32)aes_sbox[(s3 >> 8) & 0xff] << 8) ^ aes_sbox[s0 & 0xff] ^ rk[1];
+    t2 = ((u32)aes_sbox[s2 >> 24] << 24) ^ ((u32)aes_sbox[(s3 >> 16) & 0xff] << 16) ^
+         ((u32)aes_sbox[(s0 >> 8) & 0xff] << 8) ^ aes_sbox[s1 & 0xff] ^ rk[2];
+    t3 = ((u32)aes_sbox[s3 >> 24] << 24) ^ ((u32)aes_sbox[(s0 >> 16) & 0xff] << 16) ^
+         ((u32)aes_sbox[(s1 >> 8) & 0xff] << 8) ^ aes_sbox[s2 & 0xff] ^ rk[3];
+    PUTU32(out, t0);
+    PUTU32(out + 4, t1);
+    PUTU32(out + 8, t2);
+    PUTU32(out + 12, t3);
+}
+
+static void _aes_decrypt_block(const u8 *in, u8 *out)
+{
+    const u32 *rk = aes_drk;
+    u32 s0, s1, s2, s3, t0, t1, t2, t3;
+
+    s0 = GETU32(in) ^ rk[0];
+    s1 = GETU32(in + 4) ^ rk[1];
+    s2 = GETU32(in + 8) ^ rk[2];
+    s3 = GETU32(in + 12) ^ rk[3];
+
+    for(int r = 1; r < AES_ROUNDS; r++) {
+        rk += 4;
+        t0 = aes_td[0][s0 >> 24] ^ aes_td[1][(s3 >> 16) & 0xff] ^ aes_td[2][(s2 >> 8) & 0xff] ^ aes_td[3][s1 & 0xff] ^ rk[0];
+        t1 = aes_td[0][s1 >> 24] ^ aes_td[1][(s0 >> 16) & 0xff] ^ aes_td[2][(s3 >> 8) & 0xff] ^ aes_td[3][s2 & 0xff] ^ rk[1];
+        t2 = aes_td[0][s2 >> 24] ^ aes_td[1][(s1 >> 16) & 0xff] ^ aes_td[2][(s0 >> 8) & 0xff] ^ aes_td[3][s3 & 0xff] ^ rk[2];
+        t3 = aes_td[0][s3 >> 24] ^ aes_td[1][(s2 >> 16) & 0xff] ^ aes_td[2][(s1 >> 8) & 0xff] ^ aes_td[3][s0 & 0xff] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    rk += 4;
+    t0 = ((u32)aes_inv_sbox[s0 >> 24] << 24) ^ ((u32)aes_inv_sbox[(s3 >> 16) & 0xff] << 16) ^
+         ((u32)aes_inv_sbox[(s2 >> 8) & 0xff] << 8) ^ aes_inv_sbox[s1 & 0xff] ^ rk[0];
+    t1 = ((u32)aes_inv_sbox[s1 >> 24] << 24) ^ ((u32)aes_inv_sbox[(s0 >> 16) & 0xff] << 16) ^
+         ((u32)aes_inv_sbox[(s3 >> 8) & 0xff] << 8) ^ aes_inv_sbox[s2 & 0xff] ^ rk[1];
+    t2 = ((u32)aes_inv_sbox[s2 >> 24] << 24) ^ ((u32)aes_inv_sbox[(s1 >> 16) & 0xff] << 16) ^
+         ((u32)aes_inv_sbox[(s0 >> 8) & 0xff] << 8) ^ aes_inv_sbox[s3 & 0xff] ^ rk[2];
+    t3 = ((u32)aes_inv_sbox[s3 >> 24] << 24) ^ ((u32)aes_inv_sbox[(s2 >> 16) & 0xff] << 16) ^
+         ((u32)aes_inv_sbox[(s1 >> 8) & 0xff] << 8) ^ aes_inv_sbox[s0 & 0xff] ^ rk[3];
+    PUTU32(out, t0);
+    PUTU32(out + 4, t1);
+    PUTU32(out + 8, t2);
+    PUTU32(out + 12, t3);
+}
+
+void aes_irq(void)
+{
+}
+
+void aes_reset(void)
+{
+    if(!aes_tables_ready)
+        _aes_build_tables();
+
+    memset(aes_iv, 0, sizeof(aes_iv));
+    memset(aes_chain, 0, sizeof(aes_chain));
+}
+
+void aes_set_iv(u8 *iv)
+{
+    memcpy(aes_iv, iv, sizeof(aes_iv));
+}
+
+void aes_empty_iv(void)
+{
+    memset(aes_iv, 0, sizeof(aes_iv));
+}
+
+void aes_set_key(u8 *key)
+{
+    u32 *rk = aes_erk;
+    u8 rcon = 1;
+
+    if(!aes_tables_ready)
+        _aes_build_tables();
+
+    for(int i = 0; i < 4; i++)
+        rk[i] = GETU32(key + 4 * i);
+
+    for(int r = 0; r < AES_ROUNDS; r++, rk += 4) {
+        u32 temp = rk[3];
+        rk[4] = rk[0] ^ ((u32)rcon << 24) ^
+                ((u32)aes_sbox[(temp >> 16) & 0xff] << 24) ^ ((u32)aes_sbox[(temp >> 8) & 0xff] << 16) ^
+                ((u32)aes_sbox[temp & 0xff] << 8) ^ aes_sbox[temp >> 24];
+        rk[5] = rk[1] ^ rk[4];
+        rk[6] = rk[2] ^ rk[5];
+        rk[7] = rk[3] ^ rk[6];
+        rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1B : 0);
+    }
+
+    // equivalent inverse cipher: reversed schedule, InvMixColumns on the inner rounds
+    for(int r = 0; r <= AES_ROUNDS; r++) {
+        for(int i = 0; i < 4; i++) {
+            u32 w = aes_erk[4 * (AES_ROUNDS - r) + i];
+            if(r && r != AES_ROUNDS)
+                w = aes_td[0][aes_sbox[w >> 24]] ^ aes_td[1][aes_sbox[(w >> 16) & 0xff]] ^
+                    aes_td[2][aes_sbox[(w >> 8) & 0xff]] ^ aes_td[3][aes_sbox[w & 0xff]];
+            aes_drk[4 * r + i] = w;
+        }
+    }
+}
+
+u32 aes_submit(u16 cmd, u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
+{
+    u8 block[16];
+
+    if(!keep_iv && cmd != AES_CMD_COPY)
+        memcpy(aes_chain, aes_iv, 16);
+
+    switch(cmd) {
+        case AES_CMD_DECRYPT:
+            for(u32 b = 0; b < blocks; b++, src += 16, dst += 16) {
+                memcpy(block, src, 16);
+                _aes_decrypt_block(block, dst);
+                for(int i = 0; i < 16; i++)
+                    dst[i] ^= aes_chain[i];
+                memcpy(aes_chain, block, 16);
+            }
+            break;
+        case AES_CMD_ENCRYPT:
+            for(u32 b = 0; b < blocks; b++, src += 16, dst += 16) {
+                for(int i = 0; i < 16; i++)
+                    block[i] = src[i] ^ aes_chain[i];
+                _aes_encrypt_block(block, dst);
+                memcpy(aes_chain, dst, 16);
+            }
+            break;
+        case AES_CMD_COPY:
+            memmove(dst, src, blocks * 16);
+            break;
+    }
+
+    return ++aes_handle;
+}
+
+int aes_poll(u32 handle)
+{
+    return 1;
+}
+
+void aes_wait(u32 handle)
+{
+}
+
+void aes_session_init(aes_session *session, u16 cmd, const u8 *key, const u8 *iv)
+{
+    session->cmd = cmd;
+    memcpy(session->key, key, sizeof(session->key));
+    if(iv)
+        memcpy(session->iv, iv, sizeof(session->iv));
+    else
+        memset(session->iv, 0, sizeof(session->iv));
+}
+
+u32 aes_session_submit(aes_session *session, const aes_segment *segs, u32 count)
+{
+    aes_set_key(session->key);
+
+    for(u32 i = 0; i < count; i++) {
+        if(!segs[i].keep_iv)
+            aes_set_iv(session->iv);
+        aes_submit(session->cmd, segs[i].src, segs[i].dst, segs[i].blocks, segs[i].keep_iv);
+    }
+
+    return aes_handle;
+}
+
+void aes_decrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
+{
+    aes_submit(AES_CMD_DECRYPT, src, dst, blocks, keep_iv);
+}
+
+void aes_encrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
+{
+    aes_submit(AES_CMD_ENCRYPT, src, dst, blocks, keep_iv);
+}
+
+void aes_copy(u8 *src, u8 *dst, u32 blocks)
+{
+    aes_submit(AES_CMD_COPY, src, dst, blocks, false);
+}
+
+#endif // CRYPTO_SOFTWARE
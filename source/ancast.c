@@ -14,11 +14,13 @@
 #include "gfx.h"
 #include "utils.h"
 #include "memory.h"
+#include "latte.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <sys/stat.h>
 #include <elf.h>
 #include <stddef.h>
 #include <dirent.h>
@@ -33,10 +35,14 @@
 #include "ff.h"
 
 #include "rednand.h"
+#include "crc32.h"
 
 extern bool minute_on_slc;
 extern bool minute_on_sd;
 
+// raw sector images are read 1 MiB at a time
+#define ANCAST_SD_BATCH (0x100000 / SDMMC_DEFAULT_BLOCKLEN)
+
 char sd_read_buffer[0x200] ALIGNED(0x20);
 const char wafel_core_fn[] = "wafel_core.ipx"; 
 
@@ -188,6 +194,24 @@ int ancast_init_from_memory(ancast_ctx* ctx, void* ancast_mem)
     return 0;
 }
 
+#ifndef MINUTE_BOOT1
+// feed the body bytes loaded so far to the SHA engine, it keeps hashing
+// in the background while the next chunk is read
+static u32 _ancast_hash_upto(ancast_ctx* ctx, sha_ctx* sha, u32* hashed, u32 loaded)
+{
+    if(loaded <= ctx->header_size)
+        return 0;
+
+    u32 body_loaded = min(loaded - ctx->header_size, ctx->header.body_size);
+    if(body_loaded <= *hashed)
+        return 0;
+
+    u32 handle = sha_update_async(sha, (u8*)ctx->body + *hashed, body_loaded - *hashed);
+    *hashed = body_loaded;
+    return handle;
+}
+#endif
+
 int ancast_load(ancast_ctx* ctx)
 {
     if(!ctx) return -1;
@@ -223,10 +247,24 @@ int ancast_load(ancast_ctx* ctx)
 
     ctx->body = ctx->load + ctx->header_size;
 
+#ifndef MINUTE_BOOT1
+    sha_ctx body_sha;
+    u32 body_hashed = 0;
+    u32 sha_handle = 0;
+    sha_init(&body_sha);
+#endif
+
     if (ctx->memory_load)
     {
         u32 total_size = ctx->header_size + ctx->header.body_size;
-        memcpy(ctx->load, ctx->memory_load, total_size);
+        for (u32 i = 0; i < total_size; i += 0x100000)
+        {
+            u32 to_copy = min(total_size - i, 0x100000);
+            memcpy(ctx->load + i, ctx->memory_load + i, to_copy);
+#ifndef MINUTE_BOOT1
+            sha_handle = _ancast_hash_upto(ctx, &body_sha, &body_hashed, i + to_copy);
+#endif
+        }
     }
 #if !defined(MINUTE_BOOT1) || defined(ISFSHAX_STAGE2)
     else if (ctx->file)
@@ -258,9 +296,15 @@ int ancast_load(ancast_ctx* ctx)
             int count = fread(ctx->load + i, to_read, 1, ctx->file);
             if(count != 1) {
                 printf("ancast: failed to read offs=%08x, %s (%d).\n", i, ctx->path, errno);
+#ifndef MINUTE_BOOT1
+                sha_wait(sha_handle);
+#endif
                 ancast_fini(ctx);
                 return errno;
             }
+#ifndef MINUTE_BOOT1
+            sha_handle = _ancast_hash_upto(ctx, &body_sha, &body_hashed, i + to_read);
+#endif
         }
 #endif
 
@@ -279,43 +323,58 @@ int ancast_load(ancast_ctx* ctx)
 #endif
     else if (ctx->sector_idx)
     {
-        void* sdcard_dst = ctx->load;
-        u32 num_sectors = ctx->header_size + ctx->header.body_size;
-        num_sectors /= 0x200;
-        num_sectors += 1; // sloppy, but not the end of the world.
+        u32 total_size = ctx->header_size + ctx->header.body_size;
+        u32 num_sectors = (total_size + SDMMC_DEFAULT_BLOCKLEN - 1) / SDMMC_DEFAULT_BLOCKLEN;
 
 #ifdef MINUTE_BOOT1
         serial_send_u32(num_sectors);
         serial_send_u32(ctx->header.body_size);
 #endif
 
-        memset(sdcard_dst, 0, ctx->header_size + ctx->header.body_size);
-
+        u32 start = read32(LT_TIMER);
         int led_alternate = 0;
-        for (int i = 0; i < num_sectors; i++)
+        for (u32 i = 0; i < num_sectors; i += ANCAST_SD_BATCH)
         {
-            sdcard_dst = (void*)((u32)ctx->load + (i*0x200));
-            //serial_send_u32(i);
+            void* sdcard_dst = (void*)((u32)ctx->load + (i * SDMMC_DEFAULT_BLOCKLEN));
+            u32 count = min(num_sectors - i, ANCAST_SD_BATCH);
 
 #ifdef MINUTE_BOOT1
-            if (i % 0x10 == 0) {
-                serial_send_u32(i);
-                if (led_alternate) {
-                    smc_set_notification_led(LEDRAW_BLUE);
-                }
-                else {
-                    smc_set_notification_led(LEDRAW_PURPLE);
+            serial_send_u32(i);
+            if (led_alternate) {
+                smc_set_notification_led(LEDRAW_BLUE);
+            }
+            else {
+                smc_set_notification_led(LEDRAW_PURPLE);
+            }
+            led_alternate = !led_alternate;
+#endif
+
+            /* sdcard_read splits this into as few commands as the host
+             * allows, DMA or in boot1 multi-block PIO, single sectors are
+             * only used if that fails */
+            if (sdcard_read(ctx->sector_idx + i, count, sdcard_dst)) {
+                printf("ancast: batch read at sector %lu failed, retrying single sectors\n", ctx->sector_idx + i);
+                for (u32 j = 0; j < count; j++) {
+                    if (sdcard_read(ctx->sector_idx + i + j, 1, sdcard_dst + j * SDMMC_DEFAULT_BLOCKLEN)) {
+                        printf("ancast: failed to read sector %lu\n", ctx->sector_idx + i + j);
+#ifndef MINUTE_BOOT1
+                        sha_wait(sha_handle);
+#endif
+                        return -4;
+                    }
                 }
-                led_alternate = !led_alternate;
             }
+
+#ifndef MINUTE_BOOT1
+            sha_handle = _ancast_hash_upto(ctx, &body_sha, &body_hashed, (i + count) * SDMMC_DEFAULT_BLOCKLEN);
 #endif
-            //serial_send_u32((u32)sdcard_dst);
-            sdcard_read(ctx->sector_idx + i, 1, sdcard_dst);
-            //serial_send_u32(*(u32*)sdcard_dst);
-            //sdcard_read(ctx->sector_idx + i, 1, sdcard_dst);
-            //serial_send_u32(*(u32*)sdcard_dst);
-            // TODO: why???
         }
+
+        // LT_TIMER runs at ~1.9MHz, see udelay()
+        u32 ms = (read32(LT_TIMER) - start) / 1900;
+        if (!ms) ms = 1;
+        u32 rate = total_size / ms / 10; // 1/100 MB/s
+        printf("ancast: loaded 0x%lx bytes in %lu ms (%lu.%02lu MB/s)\n", total_size, ms, rate / 100, rate % 100);
 #ifdef MINUTE_BOOT1
         smc_set_notification_led(LEDRAW_PURPLE);
 #endif
@@ -323,7 +382,9 @@ int ancast_load(ancast_ctx* ctx)
 
 #ifndef MINUTE_BOOT1
     u32 hash[SHA_HASH_WORDS] = {0};
-    sha_hash(ctx->body, hash, ctx->header.body_size);
+    /* whatever wasn't streamed through the engine yet */
+    _ancast_hash_upto(ctx, &body_sha, &body_hashed, ctx->header_size + ctx->header.body_size);
+    sha_final(&body_sha, hash);
 
     u32* h1 = ctx->header.body_hash;
     u32* h2 = hash;
@@ -741,46 +802,226 @@ u32 ancast_plugin_size(uintptr_t base)
     return ALIGN_FORWARD(wafel_plugin_max_addr(base) - base, 0x1000);
 }
 
-u32 ancast_plugin_check_size(const char* fn_plugin, const char* plugins_fpath)
+// Load sizes of every plugin, keyed by name, file size and mtime, so an
+// unchanged plugin is only opened once per boot.
+#define IPX_MANIFEST_MAGIC   (0x49505843) // IPXC
+#define IPX_MANIFEST_VERSION (1)
+#define IPX_MANIFEST_FN      ".ipx_manifest"
+#define IPX_MANIFEST_MAX     (MAX_PLUGINS + 1)
+
+typedef struct {
+    char name[64];
+    u32 file_size;
+    u32 mtime;
+    u32 load_size;  // memory footprint, page aligned
+    u32 read_size;  // file bytes covered by the headers and segments
+    u32 abi_version;
+} ipx_manifest_entry;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 count;
+    u32 crc;
+} ipx_manifest_header;
+
+static ipx_manifest_entry* ipx_manifest = NULL;
+static u32 ipx_manifest_count = 0;
+static bool ipx_manifest_dirty = false;
+
+// only kept on SD, never write to the NAND filesystems for this
+static bool ancast_manifest_enabled(const char* plugins_fpath)
+{
+    return !strncmp(plugins_fpath, "sdmc:", 5);
+}
+
+static void ancast_manifest_load(const char* plugins_fpath)
 {
     char tmp[256];
+    ipx_manifest_header hdr;
+
+    ipx_manifest_count = 0;
+    ipx_manifest_dirty = false;
+    if (!ancast_manifest_enabled(plugins_fpath)) {
+        free(ipx_manifest);
+        ipx_manifest = NULL;
+        return;
+    }
+
+    if (!ipx_manifest) {
+        ipx_manifest = malloc(IPX_MANIFEST_MAX * sizeof(ipx_manifest_entry));
+        if (!ipx_manifest) return;
+    }
+
+    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, IPX_MANIFEST_FN);
+    FILE* f = fopen(tmp, "rb");
+    if (!f) return;
+
+    if (fread(&hdr, sizeof(hdr), 1, f) == 1
+        && hdr.magic == IPX_MANIFEST_MAGIC && hdr.version == IPX_MANIFEST_VERSION
+        && hdr.count <= IPX_MANIFEST_MAX
+        && fread(ipx_manifest, sizeof(ipx_manifest_entry), hdr.count, f) == hdr.count
+        && crc32(ipx_manifest, hdr.count * sizeof(ipx_manifest_entry)) == hdr.crc) {
+        ipx_manifest_count = hdr.count;
+    }
+    fclose(f);
+}
+
+static void ancast_manifest_save(const char* plugins_fpath)
+{
+    char tmp[256];
+    ipx_manifest_header hdr;
+
+    if (!ipx_manifest || !ipx_manifest_dirty) return;
+
+    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, IPX_MANIFEST_FN);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        printf("ancast: failed to write plugin manifest `%s`\n", tmp);
+        return;
+    }
+
+    hdr.magic = IPX_MANIFEST_MAGIC;
+    hdr.version = IPX_MANIFEST_VERSION;
+    hdr.count = ipx_manifest_count;
+    hdr.crc = crc32(ipx_manifest, ipx_manifest_count * sizeof(ipx_manifest_entry));
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(ipx_manifest, sizeof(ipx_manifest_entry), ipx_manifest_count, f);
+    fclose(f);
+
+    ipx_manifest_dirty = false;
+}
+
+// drop plugins that are gone from the directory
+static void ancast_manifest_prune(void)
+{
+    u32 kept = 0;
+    for (u32 i = 0; i < ipx_manifest_count; i++) {
+        bool present = !strcmp(ipx_manifest[i].name, wafel_core_fn);
+        for (int j = 0; j < ancast_plugins_count && !present; j++)
+            present = !strcmp(ipx_manifest[i].name, ancast_plugins_list[j]);
+
+        if (present)
+            ipx_manifest[kept++] = ipx_manifest[i];
+    }
+
+    if (kept != ipx_manifest_count) {
+        ipx_manifest_count = kept;
+        ipx_manifest_dirty = true;
+    }
+}
+
+static ipx_manifest_entry* ancast_manifest_find(const char* fn_plugin)
+{
+    for (u32 i = 0; i < ipx_manifest_count; i++) {
+        if (!strncmp(ipx_manifest[i].name, fn_plugin, sizeof(ipx_manifest[i].name)))
+            return &ipx_manifest[i];
+    }
+    return NULL;
+}
+
+static ipx_manifest_entry* ancast_manifest_add(const char* fn_plugin)
+{
+    if (!ipx_manifest || strlen(fn_plugin) >= sizeof(ipx_manifest->name))
+        return NULL;
+
+    ipx_manifest_entry* e = ancast_manifest_find(fn_plugin);
+    if (!e) {
+        if (ipx_manifest_count >= IPX_MANIFEST_MAX)
+            return NULL;
+        e = &ipx_manifest[ipx_manifest_count++];
+        memset(e, 0, sizeof(*e));
+        strcpy(e->name, fn_plugin);
+    }
+    ipx_manifest_dirty = true;
+    return e;
+}
+
+static int ancast_plugin_parse(const char* path, u32* load_size, u32* read_size)
+{
     Elf32_Ehdr hdr;
-    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, fn_plugin);
+    Elf32_Phdr phdr;
 
-    FILE* f_plugin = fopen(tmp, "rb");
+    FILE* f_plugin = fopen(path, "rb");
     if(!f_plugin)
     {
-        printf("ancast: failed to open plugin `%s` for pre-parsing!\n", tmp);
-        return 0;
+        printf("ancast: failed to open plugin `%s` for pre-parsing!\n", path);
+        return -1;
     }
     else {
-        printf("ancast: pre-parsing plugin `%s`\n", tmp);
+        printf("ancast: pre-parsing plugin `%s`\n", path);
     }
-    fread(&hdr, sizeof(hdr), 1, f_plugin);
 
     // Verify magic
-    if (read32((uintptr_t)hdr.e_ident) != IPX_ELF_MAGIC) {
+    if (fread(&hdr, sizeof(hdr), 1, f_plugin) != 1 || read32((uintptr_t)hdr.e_ident) != IPX_ELF_MAGIC) {
         fclose(f_plugin);
-        return 0;
+        return -2;
     }
 
-    fseek(f_plugin, hdr.e_phoff, SEEK_SET);
-    Elf32_Phdr* paPhdrs = malloc(sizeof(Elf32_Phdr) * hdr.e_phnum);
-    fread(paPhdrs, sizeof(Elf32_Phdr) * hdr.e_phnum, 1, f_plugin);
-
     uintptr_t max_addr = 0;
+    u32 max_offset = hdr.e_phoff + hdr.e_phnum * sizeof(Elf32_Phdr);
+    fseek(f_plugin, hdr.e_phoff, SEEK_SET);
     for (u32 i = 0; i < hdr.e_phnum; i++)
     {
-        uintptr_t end = paPhdrs[i].p_vaddr + paPhdrs[i].p_memsz;
+        if (fread(&phdr, sizeof(phdr), 1, f_plugin) != 1) {
+            fclose(f_plugin);
+            return -3;
+        }
+
+        uintptr_t end = phdr.p_vaddr + phdr.p_memsz;
         if (end > max_addr) {
             max_addr = end;
         }
+        if (phdr.p_offset + phdr.p_filesz > max_offset) {
+            max_offset = phdr.p_offset + phdr.p_filesz;
+        }
     }
-    free(paPhdrs);
 
     fclose(f_plugin);
 
-    return (u32)ALIGN_FORWARD(max_addr, 0x1000);
+    *load_size = (u32)ALIGN_FORWARD(max_addr, 0x1000);
+    *read_size = max_offset;
+    return 0;
+}
+
+// Returns the manifest entry for a plugin, re-parsing it if the file changed
+static ipx_manifest_entry* ancast_plugin_info(const char* fn_plugin, const char* plugins_fpath)
+{
+    static ipx_manifest_entry scratch;
+    char tmp[256];
+    struct stat st;
+    snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, fn_plugin);
+
+    if (stat(tmp, &st)) {
+        printf("ancast: failed to stat plugin `%s`!\n", tmp);
+        return NULL;
+    }
+
+    ipx_manifest_entry* e = ipx_manifest ? ancast_manifest_find(fn_plugin) : NULL;
+    if (e && e->file_size == (u32)st.st_size && e->mtime == (u32)st.st_mtime)
+        return e;
+
+    u32 load_size, read_size;
+    if (ancast_plugin_parse(tmp, &load_size, &read_size))
+        return NULL;
+
+    e = ancast_manifest_add(fn_plugin);
+    if (!e) {
+        memset(&scratch, 0, sizeof(scratch));
+        e = &scratch;
+    }
+    e->file_size = st.st_size;
+    e->mtime = st.st_mtime;
+    e->load_size = load_size;
+    e->read_size = min(read_size, (u32)st.st_size);
+    e->abi_version = 0;
+    return e;
+}
+
+u32 ancast_plugin_check_size(const char* fn_plugin, const char* plugins_fpath)
+{
+    ipx_manifest_entry* e = ancast_plugin_info(fn_plugin, plugins_fpath);
+    return e ? e->load_size : 0;
 }
 
 u32 ancast_plugin_load(uintptr_t base, const char* fn_plugin, const char* plugins_fpath)
@@ -789,6 +1030,15 @@ u32 ancast_plugin_load(uintptr_t base, const char* fn_plugin, const char* plugin
     u8* plugin_base = (u8*)base; // TODO dynamic
     snprintf(tmp, sizeof(tmp)-1, "%s/%s", plugins_fpath, fn_plugin);
 
+    // only read what the segments cover, the rest of the footprint is bss
+    u32 read_size = CARVEOUT_SZ;
+    u32 load_size = 0;
+    ipx_manifest_entry* e = ipx_manifest ? ancast_manifest_find(fn_plugin) : NULL;
+    if (e && e->read_size && e->load_size <= CARVEOUT_SZ) {
+        read_size = min(e->read_size, CARVEOUT_SZ);
+        load_size = e->load_size;
+    }
+
     FILE* f_plugin = fopen(tmp, "rb");
     if(!f_plugin)
     {
@@ -798,12 +1048,14 @@ u32 ancast_plugin_load(uintptr_t base, const char* fn_plugin, const char* plugin
     else {
         printf("ancast: loading plugin `%s` to %08x\n", tmp, base);
     }
-    fread(plugin_base, CARVEOUT_SZ, 1, f_plugin);
+    size_t f_len = fread(plugin_base, 1, read_size, f_plugin);
     fclose(f_plugin);
-    if(read32(base) != IPX_ELF_MAGIC) {
+    if(f_len < sizeof(Elf32_Ehdr) || read32(base) != IPX_ELF_MAGIC) {
         printf("ancast: plugin `%s` has invalid magic %08x, skipping...\n", tmp, read32(base));
         return (u32)base;
     }
+    if (load_size > f_len)
+        memset(plugin_base + f_len, 0, load_size - f_len);
 
     // Update last plugin's plugin_next
     ancast_plugin_set_next(ancast_plugin_last, base);
@@ -896,6 +1148,8 @@ int ancast_plugins_load(const char* plugins_fpath, bool rednand)
 {
     u32 tmp = 0;
     ancast_plugins_search(plugins_fpath);
+    ancast_manifest_load(plugins_fpath);
+    ancast_manifest_prune();
 
     u32 total_size = ancast_plugin_check_size(wafel_core_fn, plugins_fpath) + 0x1000;
     for (int i = 0; i < ancast_plugins_count; i++)
@@ -918,6 +1172,13 @@ int ancast_plugins_load(const char* plugins_fpath, bool rednand)
     }
 
     u32 abi_version = ancast_get_abi_version(ancast_plugins_base);
+    ipx_manifest_entry* core = ipx_manifest ? ancast_manifest_find(wafel_core_fn) : NULL;
+    if (core && core->abi_version != abi_version) {
+        core->abi_version = abi_version;
+        ipx_manifest_dirty = true;
+    }
+    ancast_manifest_save(plugins_fpath);
+
     if(abi_version != STROOPWAFEL_ABI_VERSION) {
         printf("Incompatible stroopwafel ABI version. minute abi: 0x%X, stroopwafel abi: 0x%X\n", STROOPWAFEL_ABI_VERSION, abi_version);
         return -2;
@@ -46,5 +46,6 @@
 #define __CRC32_H
 
 uint32_t crc32(const void *buf, size_t size);
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t size);
 
 #endif // __CRC32_H
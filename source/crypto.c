@@ -21,11 +21,9 @@
 #include "seeprom.h"
 #include "crc32.h"
 #include "serial.h"
+#include "sha.h"
 
-#define     AES_CMD_RESET   0
-#define     AES_CMD_DECRYPT 0x9800
-#define     AES_CMD_ENCRYPT 0x9000
-#define     AES_CMD_COPY    0x8000
+#include <malloc.h>
 
 otp_t otp;
 seeprom_t seeprom;
@@ -122,7 +120,10 @@ void crypto_initialize(void)
     crypto_read_seeprom();
 
     aes_reset();
+#ifndef CRYPTO_SOFTWARE
     irq_enable(IRQ_AES);
+    irq_enable(IRQ_SHA1);
+#endif
 
     memcpy(&seeprom_decrypted, &seeprom, sizeof(seeprom));
 }
@@ -249,40 +250,237 @@ int crypto_encrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom)
     return crypto_decrypt_verify_seeprom_ptr(&extra_verify, pOut);
 }
 
-static int _aes_irq = 0;
+#ifndef CRYPTO_SOFTWARE
+
+#define AES_CTRL_EXEC   (1<<31)
+#define AES_CTRL_IRQ    (1<<30)
+#define AES_CTRL_KEEP_IV (1<<12)
+
+// the engine takes one request at a time, commands are chained from the
+// IRQ (or from aes_wait() when nobody takes it) until every segment is done
+static struct {
+    u16 cmd;
+    const u8 *iv;
+    const aes_segment *segs;
+    u32 seg_count;
+    aes_segment single;
+    u8 keep_iv;
+    u8 *src;
+    u8 *dst;
+    u32 blocks;
+    u32 max_blocks;
+    u32 handle;
+    volatile u32 done;
+} aes_job = {0};
+
+// session whose key currently sits in the engine
+static const aes_session *aes_loaded = NULL;
+
+static inline int _aes_pending(u32 handle)
+{
+    return (s32)(handle - aes_job.done) > 0;
+}
+
+static void _aes_load_iv(const u8 *iv)
+{
+    u32 iv_tmp[4];
+    memcpy(iv_tmp, iv, 4*sizeof(u32));
+
+    for(int i = 0; i < 4; i++) {
+        write32(AES_IV, iv_tmp[i]);
+    }
+}
+
+static int _aes_next_segment(void)
+{
+    while(!aes_job.blocks && aes_job.seg_count) {
+        const aes_segment *seg = aes_job.segs++;
+        aes_job.seg_count--;
+
+        aes_job.src = seg->src;
+        aes_job.dst = seg->dst;
+        aes_job.blocks = seg->blocks;
+        aes_job.keep_iv = (aes_job.cmd == AES_CMD_COPY) ? 0 : seg->keep_iv;
+        if(aes_job.blocks && !aes_job.keep_iv && aes_job.iv)
+            _aes_load_iv(aes_job.iv);
+    }
+
+    return aes_job.blocks != 0;
+}
+
+static void _aes_issue(void)
+{
+    u32 this_blocks = min(aes_job.blocks, aes_job.max_blocks);
+
+    write32(AES_SRC, dma_addr(aes_job.src));
+    write32(AES_DEST, dma_addr(aes_job.dst));
+    write32(AES_CTRL, (aes_job.cmd << 16) | AES_CTRL_IRQ |
+            (aes_job.keep_iv ? AES_CTRL_KEEP_IV : 0) | ((this_blocks - 1) & 0xfff));
+
+    aes_job.blocks -= this_blocks;
+    aes_job.src += this_blocks<<4;
+    aes_job.dst += this_blocks<<4;
+    aes_job.keep_iv = 1;
+}
+
+static void _aes_finish(void)
+{
+    ahb_flush_from(WB_AES);
+    ahb_flush_to(RB_IOD);
+    aes_job.done = aes_job.handle;
+}
+
+// must be called with IRQs off
+static void _aes_advance(void)
+{
+    if(!_aes_pending(aes_job.handle))
+        return;
+    if(read32(AES_CTRL) & AES_CTRL_EXEC)
+        return;
+
+    if(_aes_next_segment()) {
+        _aes_issue();
+        return;
+    }
+
+    _aes_finish();
+}
 
 void aes_irq(void)
 {
-    _aes_irq = 1;
+    _aes_advance();
+}
+
+// Kinda have to do both flush/invalidate on both because if you crypt
+// 1 block, an invalidate will corrupt the periphery memory in the cache
+// line. Adjacent ranges are merged, so a batch over one buffer costs a
+// single flush/invalidate.
+static void _aes_cache_range(u8 **lo, u8 **hi, u8 *ptr, u32 size)
+{
+    if(*hi && ptr <= *hi && ptr + size >= *lo) {
+        if(ptr < *lo) *lo = ptr;
+        if(ptr + size > *hi) *hi = ptr + size;
+        return;
+    }
+
+    if(*hi) {
+        dc_flushrange(*lo, *hi - *lo);
+        dc_invalidaterange(*lo, *hi - *lo);
+    }
+    *lo = ptr;
+    *hi = ptr + size;
+}
+
+// the engine must be idle
+static u32 _aes_start(u16 cmd, const u8 *iv, const aes_segment *segs, u32 count)
+{
+    u8 *lo = NULL, *hi = NULL;
+    for(u32 i = 0; i < count; i++) {
+        if(!segs[i].blocks)
+            continue;
+        _aes_cache_range(&lo, &hi, segs[i].src, segs[i].blocks * 16);
+        _aes_cache_range(&lo, &hi, segs[i].dst, segs[i].blocks * 16);
+    }
+    if(!hi)
+        return aes_job.handle;
+    dc_flushrange(lo, hi - lo);
+    dc_invalidaterange(lo, hi - lo);
+    ahb_flush_to(RB_AES);
+
+    u32 cookie = irq_kill();
+    aes_job.cmd = cmd;
+    aes_job.iv = iv;
+    aes_job.segs = segs;
+    aes_job.seg_count = count;
+    aes_job.blocks = 0;
+    aes_job.max_blocks = (cmd == AES_CMD_COPY) ? 0xFFF : 0x80;
+    aes_job.handle++;
+    if(_aes_next_segment())
+        _aes_issue();
+    else
+        _aes_finish();
+    irq_restore(cookie);
+
+    return aes_job.handle;
+}
+
+u32 aes_submit(u16 cmd, u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
+{
+    aes_wait(aes_job.handle);
+
+    aes_job.single.src = src;
+    aes_job.single.dst = dst;
+    aes_job.single.blocks = blocks;
+    aes_job.single.keep_iv = keep_iv;
+    return _aes_start(cmd, NULL, &aes_job.single, 1);
 }
 
-static inline void aes_command(u16 cmd, u8 iv_keep, u32 blocks)
+void aes_session_init(aes_session *session, u16 cmd, const u8 *key, const u8 *iv)
 {
-    if (blocks != 0)
-        blocks--;
-    _aes_irq = 0;
-    write32(AES_CTRL, (cmd << 16) | (iv_keep ? 0x1000 : 0) | (blocks&0x7f));
-    while (read32(AES_CTRL) & 0x80000000);
+    aes_wait(aes_job.handle);
+    if(aes_loaded == session)
+        aes_loaded = NULL;
+
+    session->cmd = cmd;
+    memcpy(session->key, key, sizeof(session->key));
+    if(iv)
+        memcpy(session->iv, iv, sizeof(session->iv));
+    else
+        memset(session->iv, 0, sizeof(session->iv));
+}
+
+u32 aes_session_submit(aes_session *session, const aes_segment *segs, u32 count)
+{
+    aes_wait(aes_job.handle);
+
+    if(aes_loaded != session) {
+        aes_reset();
+        aes_set_key(session->key);
+        aes_loaded = session;
+    }
+
+    return _aes_start(session->cmd, session->iv, segs, count);
+}
+
+int aes_poll(u32 handle)
+{
+    u32 cookie = irq_kill();
+    _aes_advance();
+    irq_restore(cookie);
+
+    return !_aes_pending(handle);
+}
+
+void aes_wait(u32 handle)
+{
+    while(_aes_pending(handle)) {
+        u32 cookie = irq_kill();
+        _aes_advance();
+        // only sleep if the IRQ is going to wake us up again
+        if(_aes_pending(handle) && (read32(AES_CTRL) & AES_CTRL_EXEC) &&
+           (read32(LT_INTMR_AHBALL_ARM) & IRQF_AES))
+            irq_wait();
+        irq_restore(cookie);
+    }
 }
 
 void aes_reset(void)
 {
+    aes_wait(aes_job.handle);
+    aes_loaded = NULL;
     write32(AES_CTRL, 0);
     while (read32(AES_CTRL) != 0);
 }
 
 void aes_set_iv(u8 *iv)
 {
-    u32 iv_tmp[4];
-    memcpy(iv_tmp, iv, 4*sizeof(u32));
-
-    for(int i = 0; i < 4; i++) {
-        write32(AES_IV, iv_tmp[i]);
-    }
+    aes_wait(aes_job.handle);
+    _aes_load_iv(iv);
 }
 
 void aes_empty_iv(void)
 {
+    aes_wait(aes_job.handle);
     for(int i = 0; i < 4; i++) {
         write32(AES_IV, 0);
     }
@@ -293,6 +491,8 @@ void aes_set_key(u8 *key)
     u32 key_tmp[4];
     memcpy(key_tmp, key, 4*sizeof(u32));
 
+    aes_wait(aes_job.handle);
+    aes_loaded = NULL;
     for(int i = 0; i < 4; i++) {
         write32(AES_KEY, key_tmp[i]);
     }
@@ -300,101 +500,76 @@ void aes_set_key(u8 *key)
 
 void aes_decrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
 {
-    // Kinda have to do both flush/invalidate on both because if you crypt
-    // 1 block, an invalidate will corrupt the periphery memory in the cache
-    // line.
-    dc_flushrange(src, blocks * 16);
-    dc_invalidaterange(src, blocks * 16);
-    dc_flushrange(dst, blocks * 16);
-    dc_invalidaterange(dst, blocks * 16);
-    ahb_flush_to(RB_AES);
-
-    int this_blocks = 0;
-    while(blocks > 0) {
-        this_blocks = blocks;
-        if (this_blocks > 0x80)
-            this_blocks = 0x80;
-
-        write32(AES_SRC, dma_addr(src));
-        write32(AES_DEST, dma_addr(dst));
-
-        aes_command(AES_CMD_DECRYPT, keep_iv, this_blocks);
-
-        blocks -= this_blocks;
-        src += this_blocks<<4;
-        dst += this_blocks<<4;
-        keep_iv = 1;
-    }
-
-    ahb_flush_from(WB_AES);
-    ahb_flush_to(RB_IOD);
-    //dc_flushrange(dst, blocks * 16);
-    //dc_invalidaterange(dst, blocks * 16);
+    aes_wait(aes_submit(AES_CMD_DECRYPT, src, dst, blocks, keep_iv));
 }
 
 void aes_encrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv)
 {
-    // Kinda have to do both flush/invalidate on both because if you crypt
-    // 1 block, an invalidate will corrupt the periphery memory in the cache
-    // line.
-    dc_flushrange(src, blocks * 16);
-    dc_invalidaterange(src, blocks * 16);
-    dc_flushrange(dst, blocks * 16);
-    dc_invalidaterange(dst, blocks * 16);
-    ahb_flush_to(RB_AES);
+    aes_wait(aes_submit(AES_CMD_ENCRYPT, src, dst, blocks, keep_iv));
+}
 
-    int this_blocks = 0;
-    while(blocks > 0) {
-        this_blocks = blocks;
-        if (this_blocks > 0x80)
-            this_blocks = 0x80;
+void aes_copy(u8 *src, u8 *dst, u32 blocks)
+{
+    aes_wait(aes_submit(AES_CMD_COPY, src, dst, blocks, false));
+}
 
-        write32(AES_SRC, dma_addr(src));
-        write32(AES_DEST, dma_addr(dst));
+#endif // CRYPTO_SOFTWARE
 
-        aes_command(AES_CMD_ENCRYPT, keep_iv, this_blocks);
+#ifndef MINUTE_BOOT1
 
-        blocks -= this_blocks;
-        src += this_blocks<<4;
-        dst += this_blocks<<4;
-        keep_iv = 1;
-    }
+#define CRYPTO_BENCH_SIZE   (0x40000)
+#define CRYPTO_BENCH_ROUNDS (16)
 
-    ahb_flush_from(WB_AES);
-    ahb_flush_to(RB_IOD);
-    //dc_flushrange(dst, blocks * 16);
-    //dc_invalidaterange(dst, blocks * 16);
+static void _crypto_print_rate(const char* name, u32 ticks)
+{
+    // LT_TIMER runs at ~1.9MHz, see udelay()
+    u64 ms = ticks / 1900;
+    if(!ms) ms = 1;
+    u32 rate = (u64)CRYPTO_BENCH_SIZE * CRYPTO_BENCH_ROUNDS / ms / 10; // 1/100 MB/s
+
+    printf("crypto: %s: %lu.%02lu MB/s\n", name, rate / 100, rate % 100);
 }
 
-void aes_copy(u8 *src, u8 *dst, u32 blocks)
+void crypto_benchmark(void)
 {
-    // Kinda have to do both flush/invalidate on both because if you crypt
-    // 1 block, an invalidate will corrupt the periphery memory in the cache
-    // line.
-    dc_flushrange(src, blocks * 16);
-    dc_invalidaterange(src, blocks * 16);
-    dc_flushrange(dst, blocks * 16);
-    dc_invalidaterange(dst, blocks * 16);
-    ahb_flush_to(RB_AES);
+    static u8 key[16] = {0};
+    u8 hash[SHA_HASH_SIZE];
+    u8* buf = memalign(64, CRYPTO_BENCH_SIZE);
+    if(!buf) {
+        printf("crypto: out of memory\n");
+        return;
+    }
+    memset(buf, 0x5A, CRYPTO_BENCH_SIZE);
 
-    int this_blocks = 0;
-    while(blocks > 0) {
-        this_blocks = blocks;
-        if (this_blocks > 0xFFF)
-            this_blocks = 0xFFF;
+#ifdef CRYPTO_SOFTWARE
+    printf("crypto: software backend\n");
+#else
+    printf("crypto: hardware backend\n");
+#endif
 
-        write32(AES_SRC, dma_addr(src));
-        write32(AES_DEST, dma_addr(dst));
+    aes_reset();
+    aes_set_key(key);
 
-        aes_command(AES_CMD_COPY, false, this_blocks);
+    u32 start = read32(LT_TIMER);
+    for(int i = 0; i < CRYPTO_BENCH_ROUNDS; i++) {
+        aes_empty_iv();
+        aes_decrypt(buf, buf, CRYPTO_BENCH_SIZE / 16, 0);
+    }
+    _crypto_print_rate("AES-128-CBC decrypt", read32(LT_TIMER) - start);
 
-        blocks -= this_blocks;
-        src += this_blocks<<4;
-        dst += this_blocks<<4;
+    start = read32(LT_TIMER);
+    for(int i = 0; i < CRYPTO_BENCH_ROUNDS; i++) {
+        aes_empty_iv();
+        aes_encrypt(buf, buf, CRYPTO_BENCH_SIZE / 16, 0);
     }
+    _crypto_print_rate("AES-128-CBC encrypt", read32(LT_TIMER) - start);
 
-    ahb_flush_from(WB_AES);
-    ahb_flush_to(RB_IOD);
-    //dc_flushrange(dst, blocks * 16);
-    //dc_invalidaterange(dst, blocks * 16);
+    start = read32(LT_TIMER);
+    for(int i = 0; i < CRYPTO_BENCH_ROUNDS; i++)
+        sha_hash(buf, hash, CRYPTO_BENCH_SIZE);
+    _crypto_print_rate("SHA-1", read32(LT_TIMER) - start);
+
+    free(buf);
 }
+
+#endif // MINUTE_BOOT1
@@ -259,6 +259,33 @@ void crypto_decrypt_seeprom(void);
 int crypto_decrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom);
 int crypto_encrypt_verify_seeprom_ptr(seeprom_t* pOut, seeprom_t* pSeeprom);
 
+#define     AES_CMD_RESET   0
+#define     AES_CMD_DECRYPT 0x9800
+#define     AES_CMD_ENCRYPT 0x9000
+#define     AES_CMD_COPY    0x8000
+
+void aes_irq(void);
+void crypto_benchmark(void);
+
+// one piece of a batched AES request. Segments that don't keep the IV
+// restart from the session IV, the others chain from the previous segment.
+typedef struct {
+    u8 *src;
+    u8 *dst;
+    u32 blocks;
+    u8 keep_iv;
+} aes_segment;
+
+// key, IV and direction for a series of batches. The key is only loaded
+// into the engine when another key was used in between.
+typedef struct {
+    u16 cmd;
+    u8 key[16];
+    u8 iv[16];
+} aes_session;
+
+// the AES/SHA backend is picked at build time: the Latte engines by default,
+// the portable implementations in aes_sw.c/sha_sw.c with CRYPTO_SOFTWARE
 void aes_reset(void);
 void aes_set_iv(u8 *iv);
 void aes_empty_iv();
@@ -267,5 +294,16 @@ void aes_decrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv);
 void aes_encrypt(u8 *src, u8 *dst, u32 blocks, u8 keep_iv);
 void aes_copy(u8 *src, u8 *dst, u32 blocks);
 
+// queue a request on the engine and return a handle for aes_poll/aes_wait,
+// buffers must not be touched until it completed
+u32 aes_submit(u16 cmd, u8 *src, u8 *dst, u32 blocks, u8 keep_iv);
+int aes_poll(u32 handle);
+void aes_wait(u32 handle);
+
+// iv may be NULL for an all zero IV
+void aes_session_init(aes_session *session, u16 cmd, const u8 *key, const u8 *iv);
+// segments must stay valid until the returned handle completed
+u32 aes_session_submit(aes_session *session, const aes_segment *segs, u32 count);
+
 #endif
 
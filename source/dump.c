@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <malloc.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -82,6 +83,8 @@ menu menu_dump = {
             {"Dump sys crash logs", &dump_logs_slc},
             {"Dump sys crash logs from redslc", &dump_logs_redslc},
             {"Format redNAND", &dump_format_rednand},
+            {"Resume redNAND MLC dump", &dump_resume_rednand},
+            {"Dump sparse MLC image", &dump_mlc_sparse},
             {"Restore SLC.RAW", &dump_restore_slc_raw},
             {"Restore SLCCMPT.RAW", &dump_restore_slccmpt_raw},
             {"Restore BOOT1_SLC.RAW", &dump_restore_boot1_raw},
@@ -94,13 +97,14 @@ menu menu_dump = {
             {"Delete SLCCMPT scfm.img", &_dump_delete_scfm_slccmpt},
             {"Delete redNAND scfm.img", &_dump_delete_scfm_rednand},
             {"Restore redNAND MLC", &dump_restore_rednand},
+            {"Restore sparse MLC image", &dump_restore_mlc_sparse},
             {"Sync SEEPROM boot1 versions with NAND", &dump_sync_seeprom_boot1_versions},
             {"Set SEEPROM SATA device type", &dump_set_sata_type},
             {"Test SLC and Restore SLC.RAW", &dump_restore_test_slc_raw},
             {"Print SLC superblocks", &dump_print_slc_superblocks},
             {"Return to Main Menu", &menu_close},
     },
-    28, // number of options
+    31, // number of options
     0,
     0
 };
@@ -770,7 +774,484 @@ ret:
     console_power_or_eject_to_return();
 }
 
-int _dump_mlc(u32 base)
+// Sidecar manifests: one line per 64 MiB region of a dump/restore with its offset and
+// crc32, so a backup can be checked (and bad regions pinpointed) without reading it
+// all back. The digests are computed on the chunks as they pass through memory.
+#define DUMP_MANIFEST_REGION    (64 * 1024 * 1024)
+#define DUMP_MANIFEST_LINE      (20) // "%010llX %08lX\n"
+
+typedef struct {
+    char path[64];
+    u64 offset;     // bytes hashed
+    u32 crc;        // crc32 of the current region so far
+    u32 count;      // regions finished
+    u32 written;    // regions already in the file
+    u32 max;
+    u32* regions;
+} dump_manifest;
+
+// Resuming keeps the regions before `offset` that are already in the file.
+static int _dump_manifest_open(dump_manifest* m, const char* name, u64 size, u64 offset, u32 crc)
+{
+    FIL file = {0}; UINT btx = 0;
+
+    memset(m, 0, sizeof(*m));
+    snprintf(m->path, sizeof(m->path), "%s.crc", name);
+    m->max = size / DUMP_MANIFEST_REGION + 1;
+    m->regions = malloc(m->max * sizeof(u32));
+    if(!m->regions)
+        return -1;
+
+    m->offset = offset;
+    m->crc = crc;
+    m->count = m->written = offset / DUMP_MANIFEST_REGION;
+
+    if(f_open(&file, m->path, FA_WRITE | (m->written ? FA_OPEN_ALWAYS : FA_CREATE_ALWAYS)) != FR_OK) {
+        printf("Failed to create %s.\n", m->path);
+        free(m->regions);
+        m->regions = NULL;
+        return -2;
+    }
+    // keep the offsets lined up if the old manifest is shorter than expected
+    u32 have = min(f_size(&file) / DUMP_MANIFEST_LINE, m->written);
+    f_lseek(&file, have * DUMP_MANIFEST_LINE);
+    f_truncate(&file);
+    for(; have < m->written; have++) {
+        char line[DUMP_MANIFEST_LINE + 1];
+        snprintf(line, sizeof(line), "%010llX ????????\n", (u64)have * DUMP_MANIFEST_REGION);
+        f_write(&file, line, DUMP_MANIFEST_LINE, &btx);
+    }
+    f_close(&file);
+
+    return 0;
+}
+
+// Returns the region crc including `data`, which must not cross a region boundary.
+static u32 _dump_manifest_hash(const dump_manifest* m, const void* data, u32 len)
+{
+    if(!m->regions)
+        return 0;
+    return crc32_update(m->crc, data, len);
+}
+
+static void _dump_manifest_advance(dump_manifest* m, u32 crc, u32 len)
+{
+    if(!m->regions)
+        return;
+
+    m->crc = crc;
+    m->offset += len;
+    if(!(m->offset % DUMP_MANIFEST_REGION)) {
+        if(m->count < m->max)
+            m->regions[m->count++] = m->crc;
+        m->crc = 0;
+    }
+}
+
+static void _dump_manifest_update(dump_manifest* m, const void* data, u32 len)
+{
+    const u8* ptr = data;
+
+    while(len) {
+        u32 step = min(len, DUMP_MANIFEST_REGION - (u32)(m->offset % DUMP_MANIFEST_REGION));
+        _dump_manifest_advance(m, _dump_manifest_hash(m, ptr, step), step);
+        ptr += step;
+        len -= step;
+    }
+}
+
+// Writes out the finished regions, and the trailing partial one if `final`.
+// FatFS goes through the SD card, so only call this while it's idle.
+static int _dump_manifest_flush(dump_manifest* m, bool final)
+{
+    FIL file = {0}; UINT btx = 0;
+    char line[DUMP_MANIFEST_LINE + 1];
+
+    if(!m->regions)
+        return -1;
+    if(m->written == m->count && !(final && (m->offset % DUMP_MANIFEST_REGION)))
+        return 0;
+
+    if(f_open(&file, m->path, FA_WRITE | FA_OPEN_ALWAYS) != FR_OK)
+        return -2;
+    f_lseek(&file, m->written * DUMP_MANIFEST_LINE);
+    for(; m->written < m->count; m->written++) {
+        snprintf(line, sizeof(line), "%010llX %08lX\n", (u64)m->written * DUMP_MANIFEST_REGION, m->regions[m->written]);
+        f_write(&file, line, DUMP_MANIFEST_LINE, &btx);
+    }
+    if(final && (m->offset % DUMP_MANIFEST_REGION)) {
+        snprintf(line, sizeof(line), "%010llX %08lX\n", (u64)m->written * DUMP_MANIFEST_REGION, m->crc);
+        f_write(&file, line, DUMP_MANIFEST_LINE, &btx);
+    }
+    f_close(&file);
+
+    return 0;
+}
+
+static void _dump_manifest_close(dump_manifest* m)
+{
+    if(!m->regions)
+        return;
+
+    if(!_dump_manifest_flush(m, true))
+        printf("Wrote %s\n", m->path);
+    free(m->regions);
+    m->regions = NULL;
+}
+
+// Block copy engine for the MLC <-> SD card transfers. The two sides are separate
+// host controllers using DMA, so instead of waiting for both at the end of every
+// iteration the source fills a ring of buffers as far ahead as there is room, the
+// sink drains it in order, and each side is handed its next command as soon as its
+// own previous one completed.
+#define DUMP_COPY_DEPTH     (8)
+#define DUMP_COPY_BLOCKS    (SDHC_BLOCK_COUNT_MAX)
+#define DUMP_COPY_RETRIES   (16)
+// how often the resume checkpoint is written (256 MiB)
+#define DUMP_CHECKPOINT_INTERVAL    (0x80000)
+
+#define DUMP_CHECKPOINT_PATH    "MLC_RESUME.BIN"
+#define DUMP_BADLOG_PATH        "MLC_BAD.TXT"
+#define DUMP_CHECKPOINT_MAGIC   (0x4D4C4352) // MLCR
+
+enum {
+    DUMP_MLC_TO_SD = 0,
+    DUMP_SD_TO_MLC = 1,
+};
+
+typedef struct {
+    u32 magic;
+    u32 direction;
+    u32 base;       // redNAND MLC partition start
+    u32 total;      // sectors to copy
+    u32 done;       // sectors completed
+    u32 crc;        // crc32 of the current manifest region up to `done`
+    u32 bad;        // sectors that couldn't be read
+    u32 checksum;   // crc32 of the fields above
+} dump_checkpoint;
+
+typedef struct {
+    const char* name;
+    int (*start)(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf);
+    int (*end)(struct sdmmc_command* cmdbuf);
+    int (*poll)(struct sdmmc_command* cmdbuf);
+    // synchronous read used to salvage what's left of a failing chunk,
+    // unreadable sectors are zeroed and logged. NULL aborts the copy instead.
+    int (*salvage)(u32 blk_start, u32 blk_count, void *data);
+    u32 base;
+
+    struct sdmmc_command cmd;
+    bool busy;
+    u32 done;       // chunks completed, also the chunk in flight
+    u32 tries;      // failed attempts on the current chunk
+    u32 started;
+    u64 ticks;      // LT_TIMER ticks spent on commands
+    u32 retries;
+} dump_copy_dev;
+
+#define DUMP_BADLOG_MAX     (32)
+
+static struct {
+    u32 sector;
+    u32 count;
+} dump_bad_log[DUMP_BADLOG_MAX];
+static u32 dump_bad_log_count = 0;
+// bad sectors that didn't fit in before the next flush
+static struct {
+    u32 count;
+    u32 first;
+    u32 last;
+} dump_bad_log_dropped;
+
+static void _dump_print_rate(const char* name, u64 bytes, u64 ticks)
+{
+    // LT_TIMER runs at ~1.9MHz, see udelay()
+    u64 ms = ticks / 1900;
+    if(!ms) ms = 1;
+    u32 rate = bytes / ms / 10; // 1/100 MB/s
+
+    printf("%s: %lu.%02lu MB/s\n", name, rate / 100, rate % 100);
+}
+
+static u32 _dump_checkpoint_checksum(const dump_checkpoint* ckpt)
+{
+    return crc32(ckpt, offsetof(dump_checkpoint, checksum));
+}
+
+// Returns 0 if a checkpoint for the same copy exists.
+static int _dump_checkpoint_load(dump_checkpoint* ckpt, u32 direction, u32 base, u32 total)
+{
+    FIL file = {0}; UINT btx = 0;
+    dump_checkpoint tmp;
+
+    if(f_open(&file, DUMP_CHECKPOINT_PATH, FA_READ) != FR_OK)
+        return -1;
+    FRESULT fres = f_read(&file, &tmp, sizeof(tmp), &btx);
+    f_close(&file);
+    if(fres != FR_OK || btx != sizeof(tmp))
+        return -2;
+
+    if(tmp.magic != DUMP_CHECKPOINT_MAGIC || tmp.checksum != _dump_checkpoint_checksum(&tmp))
+        return -3;
+    if(tmp.direction != direction || tmp.base != base || tmp.total != total || tmp.done >= total)
+        return -4;
+
+    *ckpt = tmp;
+    return 0;
+}
+
+// Appends the bad sectors found since the last flush to the log. Sectors that
+// didn't fit in between get a marker line with their count and range.
+static void _dump_bad_log_flush(void)
+{
+    FIL file = {0}; UINT btx = 0;
+    char line[80];
+
+    if(!dump_bad_log_count && !dump_bad_log_dropped.count)
+        return;
+
+    if(f_open(&file, DUMP_BADLOG_PATH, FA_WRITE | FA_OPEN_ALWAYS) == FR_OK) {
+        f_lseek(&file, f_size(&file));
+        for(u32 i = 0; i < dump_bad_log_count; i++) {
+            int len = snprintf(line, sizeof(line), "0x%08lX +0x%lX\n", dump_bad_log[i].sector, dump_bad_log[i].count);
+            f_write(&file, line, len, &btx);
+        }
+        if(dump_bad_log_dropped.count) {
+            int len = snprintf(line, sizeof(line), "# overflow: 0x%lX more bad sectors in 0x%08lX-0x%08lX\n",
+                               dump_bad_log_dropped.count, dump_bad_log_dropped.first, dump_bad_log_dropped.last);
+            f_write(&file, line, len, &btx);
+        }
+        f_close(&file);
+    }
+    dump_bad_log_count = 0;
+    memset(&dump_bad_log_dropped, 0, sizeof(dump_bad_log_dropped));
+}
+
+// Only call this while neither controller has a command in flight, FatFS goes through the SD card.
+static int _dump_checkpoint_save(dump_checkpoint* ckpt)
+{
+    FIL file = {0}; UINT btx = 0;
+
+    // Append the bad sectors found since the last checkpoint first, so the
+    // checkpoint never claims more than the log covers.
+    _dump_bad_log_flush();
+
+    ckpt->magic = DUMP_CHECKPOINT_MAGIC;
+    ckpt->checksum = _dump_checkpoint_checksum(ckpt);
+
+    FRESULT fres = f_open(&file, DUMP_CHECKPOINT_PATH, FA_WRITE | FA_CREATE_ALWAYS);
+    if(fres == FR_OK) {
+        fres = f_write(&file, ckpt, sizeof(*ckpt), &btx);
+        f_close(&file);
+    }
+    if(fres != FR_OK || btx != sizeof(*ckpt)) {
+        printf("Failed to write %s (%d).\n", DUMP_CHECKPOINT_PATH, fres);
+        return -1;
+    }
+    return 0;
+}
+
+static void _dump_log_bad(dump_checkpoint* ckpt, u32 sector)
+{
+    ckpt->bad++;
+
+    if(dump_bad_log_count) {
+        u32 last = dump_bad_log_count - 1;
+        if(dump_bad_log[last].sector + dump_bad_log[last].count == sector) {
+            dump_bad_log[last].count++;
+            return;
+        }
+    }
+    if(dump_bad_log_count < DUMP_BADLOG_MAX) {
+        dump_bad_log[dump_bad_log_count].sector = sector;
+        dump_bad_log[dump_bad_log_count].count = 1;
+        dump_bad_log_count++;
+    } else {
+        if(!dump_bad_log_dropped.count)
+            dump_bad_log_dropped.first = sector;
+        dump_bad_log_dropped.last = sector;
+        dump_bad_log_dropped.count++;
+    }
+    printf("Bad sector 0x%08lX, zeroed\n", sector);
+}
+
+// Read a chunk that keeps failing sector by sector.
+static void _dump_copy_salvage(dump_copy_dev* dev, dump_checkpoint* ckpt, u32 blk, u32 count, u8* buf)
+{
+    for(u32 i = 0; i < count; i++) {
+        u8* sector_buf = buf + i * SDMMC_DEFAULT_BLOCKLEN;
+        int res = -1;
+        for(u32 tries = 0; res && tries < DUMP_COPY_RETRIES; tries++)
+            res = dev->salvage(dev->base + blk + i, 1, sector_buf);
+        if(res) {
+            memset(sector_buf, 0, SDMMC_DEFAULT_BLOCKLEN);
+            _dump_log_bad(ckpt, blk + i);
+        }
+    }
+}
+
+static int _dump_copy_blocks(dump_copy_dev* src, dump_copy_dev* dst, dump_checkpoint* ckpt, dump_manifest* m, u32 depth, u32 chunk)
+{
+    const u32 chunk_size = chunk * SDMMC_DEFAULT_BLOCKLEN;
+    const u32 blk_count = ckpt->total;
+    const u32 chunks = (blk_count + chunk - 1) / chunk;
+    dump_copy_dev* devs[2] = { src, dst };
+    int ret = 0;
+
+    u8* ring = memalign(32, depth * chunk_size);
+    if(!ring)
+        return -1;
+
+    // the checkpoint always sits on a chunk boundary
+    src->done = dst->done = ckpt->done / chunk;
+    const u32 first_blk = dst->done * chunk;
+    u32 hashed = ~0, hashed_crc = 0;
+    u32 next_checkpoint = dst->done + DUMP_CHECKPOINT_INTERVAL / chunk;
+    dump_bad_log_count = 0;
+    memset(&dump_bad_log_dropped, 0, sizeof(dump_bad_log_dropped));
+
+    u32 last = read32(LT_TIMER);
+    u64 elapsed = 0;
+
+    while(dst->done < chunks)
+    {
+        // Stop queueing once a checkpoint is due and write it when both sides are idle.
+        // A full bad sector log brings it forward, the checkpoint flushes the log.
+        bool pause = dst->done >= next_checkpoint || dump_bad_log_count >= DUMP_BADLOG_MAX;
+        if(pause && !src->busy && !dst->busy) {
+            ckpt->done = dst->done * chunk;
+            _dump_manifest_flush(m, false);
+            _dump_checkpoint_save(ckpt);
+            next_checkpoint = dst->done + DUMP_CHECKPOINT_INTERVAL / chunk;
+            pause = false;
+        }
+
+        for(int d = 0; d < 2; d++)
+        {
+            dump_copy_dev* dev = devs[d];
+            // The source needs a free buffer, the sink a filled one.
+            u32 limit = d ? src->done : min(chunks, dst->done + depth);
+            u32 blk = dev->done * chunk;
+            u32 count = min(chunk, blk_count - blk);
+            u8* buf = ring + (dev->done % depth) * chunk_size;
+
+            if(!pause && !dev->busy && dev->done < limit) {
+                if(dev->start(dev->base + blk, count, buf, &dev->cmd) == 0) {
+                    dev->busy = true;
+                    dev->started = read32(LT_TIMER);
+                    // hash while the sink is busy, the buffer stays untouched until it's done.
+                    // Chunks never straddle a manifest region.
+                    if(d && hashed != dev->done) {
+                        hashed = dev->done;
+                        hashed_crc = _dump_manifest_hash(m, buf, count * SDMMC_DEFAULT_BLOCKLEN);
+                    }
+                } else {
+                    dev->tries++;
+                }
+            }
+
+            // Only block in end() once the controller says it's done.
+            bool completed = false;
+            if(dev->busy && (!dev->poll || dev->poll(&dev->cmd))) {
+                int res = dev->end(&dev->cmd);
+                dev->busy = false;
+                dev->ticks += read32(LT_TIMER) - dev->started;
+                if(res)
+                    dev->tries++;
+                else
+                    completed = true;
+            }
+
+            if(!completed && dev->tries >= DUMP_COPY_RETRIES) {
+                if(!dev->salvage) {
+                    printf("%s: Giving up on sector 0x%08lX\n", dev->name, dev->base + blk);
+                    ret = -2;
+                    goto abort;
+                }
+                printf("%s: Salvaging sectors 0x%08lX-0x%08lX\n", dev->name, dev->base + blk, dev->base + blk + count - 1);
+                _dump_copy_salvage(dev, ckpt, blk, count, buf);
+                completed = true;
+            }
+
+            if(completed) {
+                dev->retries += dev->tries;
+                dev->tries = 0;
+                dev->done++;
+                if(d) {
+                    _dump_manifest_advance(m, hashed_crc, count * SDMMC_DEFAULT_BLOCKLEN);
+                    ckpt->crc = m->crc;
+                    if(((dev->done * chunk) % 0x10000) == 0)
+                        printf("%s: Sector 0x%08lX completed\n", dev->name, dev->base + dev->done * chunk);
+                }
+            }
+        }
+
+        u32 now = read32(LT_TIMER);
+        elapsed += now - last;
+        last = now;
+    }
+
+    ckpt->done = blk_count;
+    _dump_bad_log_flush();
+    u64 bytes = (u64)(blk_count - first_blk) * SDMMC_DEFAULT_BLOCKLEN;
+    printf("%s -> %s: %lu bad sectors, %lu retries\n", src->name, dst->name,
+           ckpt->bad, src->retries + dst->retries);
+    _dump_print_rate(src->name, bytes, src->ticks);
+    _dump_print_rate(dst->name, bytes, dst->ticks);
+    _dump_print_rate("Total", bytes, elapsed);
+
+    free(ring);
+    return 0;
+
+abort:
+    // Let the other side finish, then leave a checkpoint to resume from.
+    for(int d = 0; d < 2; d++) {
+        if(devs[d]->busy)
+            devs[d]->end(&devs[d]->cmd);
+    }
+    ckpt->done = dst->done * chunk;
+    _dump_manifest_flush(m, false);
+    if(!_dump_checkpoint_save(ckpt))
+        printf("Checkpoint saved at sector 0x%08lX, the copy can be resumed.\n", ckpt->done);
+
+    free(ring);
+    return ret;
+}
+
+// Sets up a fresh copy, or picks up from the last checkpoint if the user wants to.
+// With `resume` there's no fresh copy: no checkpoint or a no from the user fails.
+static int _dump_checkpoint_init(dump_checkpoint* ckpt, u32 direction, u32 base, bool resume)
+{
+    if(!_dump_checkpoint_load(ckpt, direction, base, TOTAL_SECTORS)) {
+        printf("MLC: Found a checkpoint at sector 0x%08lX / 0x%08lX, resume?\n", ckpt->done, ckpt->total);
+        if(!console_abort_confirmation_power_no_eject_yes())
+            return 0;
+    } else if(resume) {
+        printf("MLC: No checkpoint to resume from.\n");
+    }
+
+    if(resume)
+        return -1;
+
+    memset(ckpt, 0, sizeof(*ckpt));
+    ckpt->direction = direction;
+    ckpt->base = base;
+    ckpt->total = TOTAL_SECTORS;
+    f_unlink(DUMP_BADLOG_PATH);
+    return 0;
+}
+
+static int _dump_checkpoint_finish(const dump_checkpoint* ckpt, int res)
+{
+    if(!res) {
+        f_unlink(DUMP_CHECKPOINT_PATH);
+        if(ckpt->bad)
+            printf("MLC: %lu unreadable sectors were zeroed, see %s\n", ckpt->bad, DUMP_BADLOG_PATH);
+    }
+    return res;
+}
+
+int _dump_mlc(u32 base, bool resume)
 {
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -781,78 +1262,367 @@ int _dump_mlc(u32 base)
     if(mlc_init())
         return -1;
 
-    int res = 0, mres = 0, sres = 0;
     if(base == 0) return -2;
 
-    // This uses "async" read/write functions, combined with double buffering to achieve a
-    // much faster dump. This works because these are two separate host controllers using DMA.
-    // Instead of running a single command and waiting for completion, we queue both commands
-    // and then wait for them both to complete at the end of each iteration.
-    struct sdmmc_command mlc_cmd = {0}, sdcard_cmd = {0};
+    dump_checkpoint ckpt;
+    if(_dump_checkpoint_init(&ckpt, DUMP_MLC_TO_SD, base, resume))
+        return -3;
+
+    dump_copy_dev mlc = {
+        .name = "MLC", .base = 0,
+        .start = mlc_start_read, .end = mlc_end_read, .poll = mlc_poll,
+        .salvage = mlc_read,
+    };
+    dump_copy_dev sd = {
+        .name = "SD", .base = base,
+        .start = sdcard_start_write, .end = sdcard_end_write, .poll = sdcard_poll,
+    };
+
+    dump_manifest manifest;
+    _dump_manifest_open(&manifest, "redNAND_MLC", (u64)ckpt.total * SDMMC_DEFAULT_BLOCKLEN,
+                        (u64)ckpt.done * SDMMC_DEFAULT_BLOCKLEN, ckpt.crc);
+
+    int res = _dump_copy_blocks(&mlc, &sd, &ckpt, &manifest, DUMP_COPY_DEPTH, DUMP_COPY_BLOCKS);
+    _dump_manifest_close(&manifest);
+    return _dump_checkpoint_finish(&ckpt, res);
+}
+
+int _dump_restore_mlc(u32 base)
+{
+    sdcard_ack_card();
+    if(sdcard_check_card() != SDMMC_INSERTED) {
+        printf("SD card is not initialized.\n");
+        return -1;
+    }
+
+    if(mlc_init())
+        return -2;
 
-    u8* sector_buf1 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
-    u8* sector_buf2 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+    int res = 0;
+    if(base == 0) return -2;
 
-    u8* mlc_buf = sector_buf2;
-    u8* sdcard_buf = sector_buf1;
+    dump_checkpoint ckpt;
+    _dump_checkpoint_init(&ckpt, DUMP_SD_TO_MLC, base, false);
 
-    // Fill one of the buffers in advance, so SD card has something to work with.
-    do res = mlc_read(0, SDHC_BLOCK_COUNT_MAX, sdcard_buf);
-    while(res);
+    // The safety check only makes sense before anything was written.
+    if(!ckpt.done) {
+        u8* sd_buf = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+        u8* mlc_buf = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
 
-    // Do one less iteration than we need, due to having to special case the start and end.
-    u32 sdcard_sector = base;
-    for(u32 sector = SDHC_BLOCK_COUNT_MAX; sector < TOTAL_SECTORS; sector += SDHC_BLOCK_COUNT_MAX)
-    {
-        int complete = 0;
-        // Make sure to retry until the command succeeded, probably superfluous but harmless...
-        while(complete != 0b11) {
-            // Issue commands if we didn't already complete them.
-            if(!(complete & 0b01))
-                mres = mlc_start_read(sector, SDHC_BLOCK_COUNT_MAX, mlc_buf, &mlc_cmd);
-            if(!(complete & 0b10))
-                sres = sdcard_start_write(sdcard_sector, SDHC_BLOCK_COUNT_MAX, sdcard_buf, &sdcard_cmd);
-
-            // Only end the command if starting it succeeded.
-            // If starting and ending the command succeeds, mark it as complete.
-            if(!(complete & 0b01) && mres == 0) {
-                mres = mlc_end_read(&mlc_cmd);
-                if(mres == 0) complete |= 0b01;
-            }
-            if(!(complete & 0b10) && sres == 0) {
-                sres = sdcard_end_write(&sdcard_cmd);
-                if(sres == 0) complete |= 0b10;
-            }
+        // Read first block from both sides to compare against for safety checks.
+        for(int tries = 0; tries < DUMP_COPY_RETRIES; tries++) {
+            res = sdcard_read(base, SDHC_BLOCK_COUNT_MAX, sd_buf);
+            if(!res) res = mlc_read(0, SDHC_BLOCK_COUNT_MAX, mlc_buf);
+            if(!res) break;
+        }
+        if(res) {
+            printf("MLC: Failed to read the first block!\n");
+            free(sd_buf);
+            free(mlc_buf);
+            return -5;
         }
 
-        // Swap buffers.
-        if(mlc_buf == sector_buf1) {
-            mlc_buf = sector_buf2;
-            sdcard_buf = sector_buf1;
+        bool allzero = true;
+        for(size_t i = 0; i < SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX; i++){
+            if(sd_buf[i]){
+                allzero = false;
+                break;
+            }
+        }
+        // Check to see if the first block matches, if so, ask the user if they want to continue.
+        if(allzero){
+            printf("MLC: First block is empty, continue restoring?\n");
+        } else if(memcmp(mlc_buf, sd_buf, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX) == 0) {
+            printf("MLC: First blocks match, continue restoring?\n");
         } else {
-            mlc_buf = sector_buf1;
-            sdcard_buf = sector_buf2;
+            printf("MLC: First blocks do not match!\n");
+            printf("MLC: Aborting restore.\n");
+            free(sd_buf);
+            free(mlc_buf);
+            return -3;
         }
+        free(sd_buf);
+        free(mlc_buf);
+
+        if(console_abort_confirmation_power_no_eject_yes()) 
+            return -4;
+    }
+    printf("MLC: Continuing restore...\n");
 
-        sdcard_sector += SDHC_BLOCK_COUNT_MAX;
+    // Unreadable backup sectors are not papered over with zeroes, the restore stops instead.
+    dump_copy_dev sd = {
+        .name = "SD", .base = base,
+        .start = sdcard_start_read, .end = sdcard_end_read, .poll = sdcard_poll,
+    };
+    dump_copy_dev mlc = {
+        .name = "MLC", .base = 0,
+        .start = mlc_start_write, .end = mlc_end_write, .poll = mlc_poll,
+    };
+
+    dump_manifest manifest;
+    _dump_manifest_open(&manifest, "redNAND_MLC.restore", (u64)ckpt.total * SDMMC_DEFAULT_BLOCKLEN,
+                        (u64)ckpt.done * SDMMC_DEFAULT_BLOCKLEN, ckpt.crc);
+
+    res = _dump_copy_blocks(&sd, &mlc, &ckpt, &manifest, DUMP_COPY_DEPTH, DUMP_COPY_BLOCKS);
+    _dump_manifest_close(&manifest);
+    return _dump_checkpoint_finish(&ckpt, res);
+}
+
+// Sparse MLC images: only the runs that hold data are stored, split over FAT files
+// (FAT32 caps them at 4 GiB) next to a map of all the extents. Grains that are all
+// zeroes or all erased (0xFF) become holes, so a mostly empty MLC dumps to a small
+// fraction of its size and the restore can skip what an erase already produced.
+#define DUMP_SPARSE_MAP_PATH    "MLC_SPARSE.MAP"
+#define DUMP_SPARSE_DATA_PATH   "MLC_SPARSE.%03lu"
+#define DUMP_SPARSE_MAGIC       (0x4D4C4353) // MLCS
+#define DUMP_SPARSE_VERSION     (1)
+#define DUMP_SPARSE_GRAIN       (8) // sectors, 4 KiB
+#define DUMP_SPARSE_PART_SIZE   (0x80000000ull)
+#define DUMP_SPARSE_MAX_EXTENTS (0x10000)
+
+enum {
+    DUMP_SPARSE_DATA = 0,
+    DUMP_SPARSE_ZERO = 1,
+    DUMP_SPARSE_ERASED = 2,
+};
 
-        if((sector % 0x10000) == 0) {
-            printf("MLC: Sector 0x%08lX completed\n", sector);
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 total;      // sectors covered by the map
+    u32 grain;
+    u32 count;      // extents
+    u32 data;       // sectors stored in the data files
+    u32 data_crc;   // crc32 of the data files, in order
+    u32 map_crc;    // crc32 of the extents
+    u32 checksum;   // crc32 of the fields above
+} dump_sparse_header;
+
+typedef struct {
+    u32 sector;
+    u32 count;
+    u32 type;
+} dump_sparse_extent;
+
+typedef struct {
+    dump_sparse_header hdr;
+    dump_sparse_extent* extents;
+    u32 max;
+} dump_sparse_map;
+
+// The data files, read or written front to back.
+typedef struct {
+    FIL file;
+    bool open;
+    u32 part;
+    u64 offset;
+} dump_sparse_data;
+
+static u32 _dump_sparse_header_checksum(const dump_sparse_header* hdr)
+{
+    return crc32(hdr, offsetof(dump_sparse_header, checksum));
+}
+
+// Scans a grain a word at a time, bailing out on the first word that differs.
+static u32 _dump_sparse_classify(const void* data, u32 len)
+{
+    const u32* words = data;
+    const u32 first = words[0];
+
+    if(first != 0 && first != 0xFFFFFFFF)
+        return DUMP_SPARSE_DATA;
+    for(u32 i = 1; i < len / sizeof(u32); i++) {
+        if(words[i] != first)
+            return DUMP_SPARSE_DATA;
+    }
+    return first ? DUMP_SPARSE_ERASED : DUMP_SPARSE_ZERO;
+}
+
+static void _dump_sparse_add(dump_sparse_map* map, u32 sector, u32 count, u32 type)
+{
+    if(map->hdr.count) {
+        dump_sparse_extent* last = &map->extents[map->hdr.count - 1];
+        if(last->type == type && last->sector + last->count == sector) {
+            last->count += count;
+            return;
         }
     }
+    map->extents[map->hdr.count].sector = sector;
+    map->extents[map->hdr.count].count = count;
+    map->extents[map->hdr.count].type = type;
+    map->hdr.count++;
+}
 
-    // Finish up the last iteration.
-    do res = sdcard_write(sdcard_sector, SDHC_BLOCK_COUNT_MAX, sdcard_buf);
-    while(res);
+static int _dump_sparse_data_open(dump_sparse_data* d, u32 part, BYTE mode)
+{
+    char path[32];
 
-    free(sector_buf1);
-    free(sector_buf2);
+    if(d->open)
+        f_close(&d->file);
+    d->open = false;
 
+    snprintf(path, sizeof(path), DUMP_SPARSE_DATA_PATH, part);
+    FRESULT fres = f_open(&d->file, path, mode);
+    if(fres != FR_OK) {
+        printf("Failed to open %s (%d).\n", path, fres);
+        return -1;
+    }
+    d->open = true;
+    d->part = part;
     return 0;
 }
 
-int _dump_restore_mlc(u32 base)
+static int _dump_sparse_data_write(dump_sparse_data* d, const u8* buf, u32 len)
+{
+    UINT btx = 0;
+
+    while(len) {
+        u32 part = d->offset / DUMP_SPARSE_PART_SIZE;
+        if((!d->open || d->part != part) && _dump_sparse_data_open(d, part, FA_WRITE | FA_CREATE_ALWAYS))
+            return -1;
+
+        u32 step = min(len, (u32)(DUMP_SPARSE_PART_SIZE - d->offset % DUMP_SPARSE_PART_SIZE));
+        FRESULT fres = f_write(&d->file, buf, step, &btx);
+        if(fres != FR_OK || btx != step) {
+            printf("Failed to write part %lu (%d).\n", d->part, fres);
+            return -2;
+        }
+        d->offset += step;
+        buf += step;
+        len -= step;
+    }
+    return 0;
+}
+
+static int _dump_sparse_data_read(dump_sparse_data* d, u8* buf, u32 len)
+{
+    UINT btx = 0;
+
+    while(len) {
+        u32 part = d->offset / DUMP_SPARSE_PART_SIZE;
+        if((!d->open || d->part != part) && _dump_sparse_data_open(d, part, FA_READ))
+            return -1;
+
+        u32 step = min(len, (u32)(DUMP_SPARSE_PART_SIZE - d->offset % DUMP_SPARSE_PART_SIZE));
+        FRESULT fres = f_read(&d->file, buf, step, &btx);
+        if(fres != FR_OK || btx != step) {
+            printf("Failed to read part %lu (%d).\n", d->part, fres);
+            return -2;
+        }
+        d->offset += step;
+        buf += step;
+        len -= step;
+    }
+    return 0;
+}
+
+static int _dump_sparse_data_close(dump_sparse_data* d)
 {
+    FRESULT fres = FR_OK;
+
+    if(d->open)
+        fres = f_close(&d->file);
+    d->open = false;
+    return fres == FR_OK ? 0 : -1;
+}
+
+static int _dump_sparse_map_save(dump_sparse_map* map)
+{
+    FIL file = {0}; UINT btx = 0;
+    const u32 size = map->hdr.count * sizeof(dump_sparse_extent);
+
+    map->hdr.magic = DUMP_SPARSE_MAGIC;
+    map->hdr.version = DUMP_SPARSE_VERSION;
+    map->hdr.map_crc = crc32(map->extents, size);
+    map->hdr.checksum = _dump_sparse_header_checksum(&map->hdr);
+
+    FRESULT fres = f_open(&file, DUMP_SPARSE_MAP_PATH, FA_WRITE | FA_CREATE_ALWAYS);
+    if(fres == FR_OK) {
+        fres = f_write(&file, &map->hdr, sizeof(map->hdr), &btx);
+        if(fres == FR_OK && btx == sizeof(map->hdr))
+            fres = f_write(&file, map->extents, size, &btx);
+        f_close(&file);
+    }
+    if(fres != FR_OK || btx != size) {
+        printf("Failed to write %s (%d).\n", DUMP_SPARSE_MAP_PATH, fres);
+        return -1;
+    }
+    return 0;
+}
+
+static int _dump_sparse_map_load(dump_sparse_map* map)
+{
+    FIL file = {0}; UINT btx = 0;
+
+    memset(map, 0, sizeof(*map));
+    FRESULT fres = f_open(&file, DUMP_SPARSE_MAP_PATH, FA_READ);
+    if(fres != FR_OK) {
+        printf("Failed to open %s (%d).\n", DUMP_SPARSE_MAP_PATH, fres);
+        return -1;
+    }
+
+    int ret = 0;
+    fres = f_read(&file, &map->hdr, sizeof(map->hdr), &btx);
+    if(fres != FR_OK || btx != sizeof(map->hdr) || map->hdr.magic != DUMP_SPARSE_MAGIC ||
+       map->hdr.checksum != _dump_sparse_header_checksum(&map->hdr)) {
+        ret = -2;
+        goto out;
+    }
+    if(map->hdr.version != DUMP_SPARSE_VERSION || map->hdr.total != TOTAL_SECTORS ||
+       !map->hdr.count || map->hdr.count > DUMP_SPARSE_MAX_EXTENTS) {
+        ret = -3;
+        goto out;
+    }
+
+    const u32 size = map->hdr.count * sizeof(dump_sparse_extent);
+    map->extents = malloc(size);
+    if(!map->extents) {
+        ret = -4;
+        goto out;
+    }
+    fres = f_read(&file, map->extents, size, &btx);
+    if(fres != FR_OK || btx != size || crc32(map->extents, size) != map->hdr.map_crc) {
+        ret = -5;
+        goto out;
+    }
+
+    // the extents have to tile the MLC exactly
+    u32 next = 0, data = 0;
+    for(u32 i = 0; i < map->hdr.count; i++) {
+        const dump_sparse_extent* e = &map->extents[i];
+        if(e->sector != next || !e->count || e->type > DUMP_SPARSE_ERASED) {
+            ret = -6;
+            goto out;
+        }
+        next += e->count;
+        if(e->type == DUMP_SPARSE_DATA)
+            data += e->count;
+    }
+    if(next != map->hdr.total || data != map->hdr.data)
+        ret = -6;
+
+out:
+    f_close(&file);
+    if(ret) {
+        printf("%s is not a valid sparse MLC map (%d).\n", DUMP_SPARSE_MAP_PATH, ret);
+        free(map->extents);
+        map->extents = NULL;
+    }
+    return ret;
+}
+
+// Reads the MLC through a pair of buffers, the next chunk comes in while the data
+// runs of the current one are written out through FatFS.
+int _dump_mlc_sparse(void)
+{
+    const u32 chunk = DUMP_COPY_BLOCKS;
+    const u32 chunk_size = chunk * SDMMC_DEFAULT_BLOCKLEN;
+    const u32 chunks = (TOTAL_SECTORS + chunk - 1) / chunk;
+    struct sdmmc_command cmd;
+    dump_sparse_map map = {0};
+    dump_sparse_data data = {0};
+    int res = 0;
+
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
         printf("SD card is not initialized.\n");
@@ -862,115 +1632,369 @@ int _dump_restore_mlc(u32 base)
     if(mlc_init())
         return -2;
 
-    int res = 0, mres = 0, sres = 0;
-    if(base == 0) return -2;
+    map.max = DUMP_SPARSE_MAX_EXTENTS;
+    map.extents = malloc(map.max * sizeof(dump_sparse_extent));
+    u8* ring = memalign(32, 2 * chunk_size);
+    if(!map.extents || !ring) {
+        res = -3;
+        goto out;
+    }
+    map.hdr.total = TOTAL_SECTORS;
+    map.hdr.grain = DUMP_SPARSE_GRAIN;
 
-    // This uses "async" read/write functions, combined with double buffering to achieve a
-    // much faster dump. This works because these are two separate host controllers using DMA.
-    // Instead of running a single command and waiting for completion, we queue both commands
-    // and then wait for them both to complete at the end of each iteration.
-    struct sdmmc_command mlc_cmd = {0}, sdcard_cmd = {0};
+    // a u32 of timer ticks wraps after ~37 minutes, far less than a full pass
+    u32 last = read32(LT_TIMER);
+    u64 elapsed = 0;
+    u32 bad = 0;
+    bool busy = !mlc_start_read(0, min(chunk, TOTAL_SECTORS), ring, &cmd);
 
-    u8* sector_buf1 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
-    u8* sector_buf2 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX);
+    for(u32 i = 0; i < chunks; i++)
+    {
+        const u32 blk = i * chunk;
+        const u32 count = min(chunk, TOTAL_SECTORS - blk);
+        u8* buf = ring + (i & 1) * chunk_size;
+
+        int rres = busy ? mlc_end_read(&cmd) : -1;
+        for(u32 tries = 0; rres && tries < DUMP_COPY_RETRIES; tries++)
+            rres = mlc_read(blk, count, buf);
+        if(rres) {
+            // same as the raw dump, unreadable sectors end up as zeroes
+            for(u32 s = 0; s < count; s++) {
+                u8* sector_buf = buf + s * SDMMC_DEFAULT_BLOCKLEN;
+                if(mlc_read(blk + s, 1, sector_buf)) {
+                    memset(sector_buf, 0, SDMMC_DEFAULT_BLOCKLEN);
+                    printf("Bad sector 0x%08lX, zeroed\n", blk + s);
+                    bad++;
+                }
+            }
+        }
 
-    u8* mlc_buf = sector_buf2;
-    u8* sdcard_buf = sector_buf1;
+        busy = false;
+        if(i + 1 < chunks) {
+            const u32 next = blk + chunk;
+            busy = !mlc_start_read(next, min(chunk, TOTAL_SECTORS - next), ring + ((i + 1) & 1) * chunk_size, &cmd);
+        }
 
-    // Fill one of the buffers in advance, so SD card has something to work with.
-    do res = sdcard_read(base, SDHC_BLOCK_COUNT_MAX, mlc_buf);
-    while(res);
+        // Once the map is about to run out, everything that's left goes in as data.
+        for(u32 g = 0; g < count;)
+        {
+            const u32 run_start = g;
+            const bool full = map.hdr.count >= map.max - 1;
+            u32 step = min(DUMP_SPARSE_GRAIN, count - g);
+            u32 type = full ? DUMP_SPARSE_DATA : _dump_sparse_classify(buf + g * SDMMC_DEFAULT_BLOCKLEN, step * SDMMC_DEFAULT_BLOCKLEN);
+
+            for(g += step; g < count; g += step) {
+                step = min(DUMP_SPARSE_GRAIN, count - g);
+                u32 next_type = full ? DUMP_SPARSE_DATA : _dump_sparse_classify(buf + g * SDMMC_DEFAULT_BLOCKLEN, step * SDMMC_DEFAULT_BLOCKLEN);
+                if(next_type != type)
+                    break;
+            }
 
-    // Read first block from MLC to compare against for safety checks.
-    do res = mlc_read(0, SDHC_BLOCK_COUNT_MAX, sdcard_buf);
-    while(res);
+            const u32 run = g - run_start;
+            _dump_sparse_add(&map, blk + run_start, run, type);
+            if(type != DUMP_SPARSE_DATA)
+                continue;
+
+            const u8* ptr = buf + run_start * SDMMC_DEFAULT_BLOCKLEN;
+            map.hdr.data += run;
+            map.hdr.data_crc = crc32_update(map.hdr.data_crc, ptr, run * SDMMC_DEFAULT_BLOCKLEN);
+            if(_dump_sparse_data_write(&data, ptr, run * SDMMC_DEFAULT_BLOCKLEN)) {
+                res = -4;
+                goto abort;
+            }
+        }
+
+        if(((blk + count) % 0x10000) == 0)
+            printf("MLC: Sector 0x%08lX completed, %lu stored\n", blk + count, map.hdr.data);
+
+        u32 now = read32(LT_TIMER);
+        elapsed += now - last;
+        last = now;
+    }
+
+    if(_dump_sparse_data_close(&data)) {
+        res = -5;
+        goto out;
+    }
+    if(_dump_sparse_map_save(&map)) {
+        res = -6;
+        goto out;
+    }
 
-    bool allzero = true;
-    for(size_t i = 0; i < SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX; i++){
-        if(mlc_buf[i]){
-            allzero = false;
+    printf("MLC: %lu of %lu sectors stored in %lu extents, %lu bad sectors\n",
+           map.hdr.data, map.hdr.total, map.hdr.count, bad);
+    _dump_print_rate("MLC", (u64)TOTAL_SECTORS * SDMMC_DEFAULT_BLOCKLEN, elapsed);
+    goto out;
+
+abort:
+    if(busy)
+        mlc_end_read(&cmd);
+    _dump_sparse_data_close(&data);
+
+out:
+    free(ring);
+    free(map.extents);
+    return res;
+}
+
+// Makes sure every data file is there with exactly the size the map asks for, and
+// optionally reads them all back against the data checksum, before the MLC is touched.
+static int _dump_sparse_data_check(const dump_sparse_map* map, bool check_crc)
+{
+    const u32 chunk_size = DUMP_COPY_BLOCKS * SDMMC_DEFAULT_BLOCKLEN;
+    const u64 total = (u64)map->hdr.data * SDMMC_DEFAULT_BLOCKLEN;
+    const u32 parts = (total + DUMP_SPARSE_PART_SIZE - 1) / DUMP_SPARSE_PART_SIZE;
+    dump_sparse_data data = {0};
+    int res = 0;
+
+    for(u32 part = 0; part < parts; part++) {
+        const u64 expected = min(total - (u64)part * DUMP_SPARSE_PART_SIZE, DUMP_SPARSE_PART_SIZE);
+        if(_dump_sparse_data_open(&data, part, FA_READ)) {
+            res = -1;
+            break;
+        }
+        if(f_size(&data.file) != expected) {
+            printf("Part %lu holds %llu bytes, the map expects %llu.\n", part, (u64)f_size(&data.file), expected);
+            res = -2;
             break;
         }
     }
-    // Check to see if the first block matches, if so, ask the user if they want to continue.
-    if(allzero){
-        printf("MLC: First block is empty, continue restoring?\n");
-    } else if(memcmp(sdcard_buf, mlc_buf, SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX) == 0) {
-        printf("MLC: First blocks match, continue restoring?\n");
-    } else {
-        printf("MLC: First blocks do not match!\n");
-        printf("MLC: Aborting restore.\n");
+    _dump_sparse_data_close(&data);
+    if(res || !check_crc)
+        return res;
+
+    u8* buf = memalign(32, chunk_size);
+    if(!buf)
         return -3;
+
+    u32 crc = 0;
+    memset(&data, 0, sizeof(data));
+    for(u64 done = 0; done < total; ) {
+        const u32 step = min(total - done, (u64)chunk_size);
+        if(_dump_sparse_data_read(&data, buf, step)) {
+            res = -4;
+            break;
+        }
+        crc = crc32_update(crc, buf, step);
+        done += step;
     }
-    if(console_abort_confirmation_power_no_eject_yes()) 
-        return -4;
-    printf("MLC: Continuing restore...\n");
+    _dump_sparse_data_close(&data);
+    free(buf);
 
-    // Do one less iteration than we need, due to having to special case the start and end.
-    u32 sdcard_sector = base + SDHC_BLOCK_COUNT_MAX;
-    u32 mlc_sector = 0;
+    if(!res && crc != map->hdr.data_crc) {
+        printf("The data files don't match the map checksum (%08lX != %08lX)!\n", crc, map->hdr.data_crc);
+        res = -5;
+    }
+    return res;
+}
 
-    while(mlc_sector < (TOTAL_SECTORS - SDHC_BLOCK_COUNT_MAX))
+typedef struct {
+    struct sdmmc_command cmd;
+    bool busy;
+    bool failed;    // the command couldn't even be started
+    u32 blk;
+    u32 count;
+    u8* buf;
+} dump_sparse_writer;
+
+// Waits for the write in flight and retries it synchronously if it failed.
+static int _dump_sparse_writer_end(dump_sparse_writer* w)
+{
+    if(!w->busy)
+        return 0;
+    w->busy = false;
+
+    int res = w->failed ? -1 : mlc_end_write(&w->cmd);
+    for(u32 tries = 0; res && tries < DUMP_COPY_RETRIES; tries++)
+        res = mlc_write(w->blk, w->count, w->buf);
+    if(res)
+        printf("MLC: Giving up on sector 0x%08lX\n", w->blk);
+    return res;
+}
+
+static int _dump_sparse_writer_start(dump_sparse_writer* w, u32 blk, u32 count, u8* buf)
+{
+    int res = _dump_sparse_writer_end(w);
+    if(res)
+        return res;
+
+    w->blk = blk;
+    w->count = count;
+    w->buf = buf;
+    w->failed = mlc_start_write(blk, count, buf, &w->cmd) != 0;
+    w->busy = true;
+    return 0;
+}
+
+// Holes are written out with their fill pattern, except those of type `skip_fill`
+// (what the freshly erased MLC reads back as). DUMP_SPARSE_DATA writes everything.
+static int _dump_restore_mlc_sparse(const dump_sparse_map* map, u32 skip_fill)
+{
+    const u32 chunk = DUMP_COPY_BLOCKS;
+    const u32 chunk_size = chunk * SDMMC_DEFAULT_BLOCKLEN;
+    dump_sparse_data data = {0};
+    dump_sparse_writer w = {0};
+    u32 fill = ~0;
+    u32 crc = 0, written = 0, skipped = 0, report = 0x10000;
+    int res = 0;
+
+    // two buffers for the data files, one holding the current fill pattern
+    u8* ring = memalign(32, 3 * chunk_size);
+    if(!ring)
+        return -2;
+    u8* fill_buf = ring + 2 * chunk_size;
+    u32 k = 0;
+
+    printf("MLC: Restoring %lu of %lu sectors from %lu extents...\n", map->hdr.data, map->hdr.total, map->hdr.count);
+    u32 last = read32(LT_TIMER);
+    u64 elapsed = 0;
+
+    for(u32 i = 0; i < map->hdr.count; i++)
     {
-        int complete = 0;
-        int retries = 0;
-        // Make sure to retry until the command succeeded, probably superfluous but harmless...
-        while(complete != 0b11) {
-            // Issue commands if we didn't already complete them.
-            if(!(complete & 0b01))
-                sres = sdcard_start_read(sdcard_sector, SDHC_BLOCK_COUNT_MAX, sdcard_buf, &sdcard_cmd);
-            if(!(complete & 0b10))
-                mres = mlc_start_write(mlc_sector, SDHC_BLOCK_COUNT_MAX, mlc_buf, &mlc_cmd);
-
-            // Only end the command if starting it succeeded.
-            // If starting and ending the command succeeds, mark it as complete.
-            if(!(complete & 0b01) && sres == 0) {
-                sres = sdcard_end_read(&sdcard_cmd);
-                if(sres == 0) complete |= 0b01;
-            }
-            if(!(complete & 0b10) && mres == 0) {
-                mres = mlc_end_write(&mlc_cmd);
-                if(mres == 0) complete |= 0b10;
+        const dump_sparse_extent* e = &map->extents[i];
+
+        if(e->type != DUMP_SPARSE_DATA && e->type == skip_fill) {
+            skipped += e->count;
+            continue;
+        }
+        if(e->type != DUMP_SPARSE_DATA && e->type != fill) {
+            // nothing may still be reading the old pattern
+            if((res = _dump_sparse_writer_end(&w)))
+                goto out;
+            memset(fill_buf, e->type == DUMP_SPARSE_ERASED ? 0xFF : 0x00, chunk_size);
+            fill = e->type;
+        }
+
+        for(u32 blk = 0; blk < e->count; blk += chunk)
+        {
+            const u32 count = min(chunk, e->count - blk);
+            u8* buf = fill_buf;
+
+            if(e->type == DUMP_SPARSE_DATA) {
+                // the write in flight uses the other buffer
+                buf = ring + k * chunk_size;
+                k ^= 1;
+                if(_dump_sparse_data_read(&data, buf, count * SDMMC_DEFAULT_BLOCKLEN)) {
+                    res = -3;
+                    goto out;
+                }
+                crc = crc32_update(crc, buf, count * SDMMC_DEFAULT_BLOCKLEN);
             }
 
-            if (retries > 9999999) {
-                printf("MLC: Still working on sector 0x%08lX\n", mlc_sector);
-                retries = 0;
+            if((res = _dump_sparse_writer_start(&w, e->sector + blk, count, buf)))
+                goto out;
+
+            written += count;
+            if(written >= report) {
+                printf("MLC: %lu sectors written, at 0x%08lX\n", written, e->sector + blk + count);
+                report += 0x10000;
             }
 
-            retries++;
+            u32 now = read32(LT_TIMER);
+            elapsed += now - last;
+            last = now;
         }
+    }
+    res = _dump_sparse_writer_end(&w);
+    elapsed += read32(LT_TIMER) - last;
+    if(res)
+        goto out;
 
-        // Swap buffers.
-        if(mlc_buf == sector_buf1) {
-            mlc_buf = sector_buf2;
-            sdcard_buf = sector_buf1;
-        } else {
-            mlc_buf = sector_buf1;
-            sdcard_buf = sector_buf2;
-        }
+    if(crc != map->hdr.data_crc) {
+        printf("MLC: The data files don't match the map checksum (%08lX != %08lX)!\n", crc, map->hdr.data_crc);
+        res = -4;
+        goto out;
+    }
+    printf("MLC: %lu sectors written, %lu left erased\n", written, skipped);
+    _dump_print_rate("MLC", (u64)written * SDMMC_DEFAULT_BLOCKLEN, elapsed);
 
-        if((mlc_sector % 0x10000) == 0) {
-            printf("MLC: Sector 0x%08lX written\n", mlc_sector);
-        }
+out:
+    _dump_sparse_writer_end(&w);
+    _dump_sparse_data_close(&data);
+    free(ring);
+    return res;
+}
+
+void dump_mlc_sparse(void)
+{
+    gfx_clear(GFX_ALL, BLACK);
+    printf("Dumping sparse MLC image...\n");
+
+    int res = _dump_mlc_sparse();
+    if(res)
+        printf("Failed to dump sparse MLC image (%d)!\n", res);
+    else
+        printf("Sparse MLC dump complete!\n");
+
+    console_power_to_exit();
+}
+
+void dump_restore_mlc_sparse(void)
+{
+    dump_sparse_map map = {0};
+
+    gfx_clear(GFX_ALL, BLACK);
+    printf("Restoring sparse MLC image...\n");
 
-        sdcard_sector += SDHC_BLOCK_COUNT_MAX;
-        mlc_sector += SDHC_BLOCK_COUNT_MAX;
+    if(!isfs_slc_has_isfshax_installed() && !crypto_otp_is_de_Fused){
+        printf("MLC restore not allowed!\nNeither ISFShax nor defuse is detected\nMLC restore would brick the consolse.");
+        goto restore_exit;
     }
 
-    // Finish up the last iteration.
-    do res = mlc_write(mlc_sector, SDHC_BLOCK_COUNT_MAX, mlc_buf);
-    while(res);
+    sdcard_ack_card();
+    if(sdcard_check_card() != SDMMC_INSERTED) {
+        printf("SD card is not initialized.\n");
+        goto restore_exit;
+    }
+    if(mlc_init())
+        goto restore_exit;
+    if(_dump_sparse_map_load(&map))
+        goto restore_exit;
 
-    free(sector_buf1);
-    free(sector_buf2);
+    smc_get_events(); // Eat all existing events
 
-    return 0;
+    printf("This overwrites the whole MLC with %s, continue?\n", DUMP_SPARSE_MAP_PATH);
+    if(console_abort_confirmation_power_no_eject_yes())
+        goto restore_exit;
+
+    // A missing or short data file would otherwise only show up halfway through.
+    printf("Also check the data checksum first? This reads all %lu MiB once more.\n", map.hdr.data / 2048);
+    bool check_crc = !console_abort_confirmation_power_no_eject_yes();
+    printf("Checking the data files...\n");
+    if(_dump_sparse_data_check(&map, check_crc)) {
+        printf("The sparse MLC image is incomplete or damaged, the MLC was not touched.\n");
+        goto restore_exit;
+    }
+
+    // An erase is far quicker than writing the holes, but whether erased sectors read
+    // back as zeroes or ones is up to the chip, so check before skipping either.
+    u32 skip_fill = DUMP_SPARSE_DATA;
+    printf("Erase the MLC first and skip the empty runs?\n");
+    if(!console_abort_confirmation_power_no_eject_yes()) {
+        static u8 sector_buf[SDMMC_DEFAULT_BLOCKLEN] ALIGNED(32);
+        printf("Erasing...\n");
+        if(mlc_erase() || mlc_read(0, 1, sector_buf)) {
+            printf("MLC erase failed\n");
+            goto restore_exit;
+        }
+        skip_fill = _dump_sparse_classify(sector_buf, sizeof(sector_buf));
+    }
+
+    int res = _dump_restore_mlc_sparse(&map, skip_fill);
+    if(res)
+        printf("Failed to restore sparse MLC image (%d)!\n", res);
+    else
+        printf("Sparse MLC restore complete!\n");
+
+restore_exit:
+    free(map.extents);
+    console_power_to_exit();
 }
 
 int _dump_slc_raw(u32 bank, int boot1_only)
 {
-    #define PAGES_PER_ITERATION (0x10)
+    // a whole erase block per f_write, FatFS has no async path to overlap with
+    #define PAGES_PER_ITERATION (BLOCK_PAGES)
     #define TOTAL_ITERATIONS ((boot1_only ? BOOT1_MAX_PAGE : NAND_MAX_PAGE) / PAGES_PER_ITERATION)
 
     static u8 file_buf[PAGES_PER_ITERATION][PAGE_SIZE + PAGE_SPARE_SIZE];
@@ -1003,6 +2027,9 @@ int _dump_slc_raw(u32 bank, int boot1_only)
         return -3;
     }
 
+    dump_manifest manifest;
+    _dump_manifest_open(&manifest, path, (u64)TOTAL_ITERATIONS * sizeof(file_buf), 0, 0);
+
     printf("Initializing %s...\n", name);
     nand_initialize(bank);
 
@@ -1016,21 +2043,26 @@ int _dump_slc_raw(u32 bank, int boot1_only)
 
             memcpy(file_buf[page], nand_page_buf, PAGE_SIZE);
             memcpy(file_buf[page] + PAGE_SIZE, nand_ecc_buf, PAGE_SPARE_SIZE);
+            // hash the page while it's still hot in the cache
+            _dump_manifest_update(&manifest, file_buf[page], sizeof(file_buf[page]));
         }
 
         fres = f_write(&file, file_buf, sizeof(file_buf), &btx);
         if(fres != FR_OK || btx != sizeof(file_buf)) {
             f_close(&file);
+            _dump_manifest_close(&manifest);
             printf("Failed to write %s (%d).\n", path, fres);
             return -4;
         }
+        _dump_manifest_flush(&manifest, false);
 
-        if((i % 0x100) == 0) {
+        if((i % (0x1000 / PAGES_PER_ITERATION)) == 0) {
             printf("%s-RAW: Page 0x%05lX / 0x%05lX completed\n", name, page_base, PAGES_PER_ITERATION * TOTAL_ITERATIONS);
         }
     }
 
     fres = f_close(&file);
+    _dump_manifest_close(&manifest);
     if(fres != FR_OK) {
         printf("Failed to close %s (%d).\n", path, fres);
         return -5;
@@ -1086,6 +2118,7 @@ static bool check_all32(u8* arr, u32 length, u8 value){
 static u8* dump_get_new_super(FIL *f, isfs_ctx *ctx, bool *same_slots){
     isfs_ctx file_ctx = *ctx;
     file_ctx.file = f;
+    file_ctx.lookup = NULL;
     file_ctx.super = memalign(NAND_DATA_ALIGN, ISFSSUPER_SIZE);
     int res = isfs_load_super(&file_ctx);
     if(res){
@@ -1239,13 +2272,21 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
     u32 program_failed = 0;
 
 
+    char manifest_name[64];
+    dump_manifest manifest;
+    snprintf(manifest_name, sizeof(manifest_name), "%s.restore", path);
+    _dump_manifest_open(&manifest, manifest_name, (u64)total_pages * PAGE_STRIDE, 0, 0);
+
     for(u32 page_base=0; page_base < total_pages; page_base += BLOCK_PAGES){
         fres = f_read(&file, file_buf, FILE_BUF_SIZE, &btx);
         if(fres != FR_OK || btx != min(FILE_BUF_SIZE, (total_pages-page_base) * PAGE_STRIDE)) {
             f_close(&file);
+            _dump_manifest_close(&manifest);
             printf("Failed to read %s (%d).\n", path, fres);
             return -4;
         }
+        _dump_manifest_update(&manifest, file_buf, btx);
+        _dump_manifest_flush(&manifest, false);
 
         if(protect_isfshax){
             if(page_base == boot1_page || page_base == boot1_copy_page)
@@ -1341,6 +2382,7 @@ int _dump_restore_slc_raw(u32 bank, int boot1_only, bool nand_test)
     }
 
     fres = f_close(&file);
+    _dump_manifest_close(&manifest);
     if(fres != FR_OK) {
         printf("Failed to close %s (%d).\n", path, fres);
         ret = -5;
@@ -1476,6 +2518,18 @@ int _dump_restore_slc_img(u32 bank, int boot1_only)
     #undef FILE_BUF_SIZE
 }
 
+// Finish an async SD card write, falling back to synchronous retries if it failed.
+static int _dump_sdcard_end_write(struct sdmmc_command* cmd, int started, u32 sector, u32 count, void* data)
+{
+    int res = started ? sdcard_end_write(cmd) : -1;
+
+    for(u32 tries = 0; res && tries < DUMP_COPY_RETRIES; tries++)
+        res = sdcard_write(sector, count, data);
+    if(res)
+        printf("SD: Giving up on sector 0x%08lX\n", sector);
+    return res;
+}
+
 int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
 {
     // how many sectors needed for a page (4)
@@ -1487,7 +2541,9 @@ int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
     // the number of SD transfer iterations required to complete the SLC dump (0x800)
     #define TOTAL_ITERATIONS (NAND_MAX_PAGE / PAGES_PER_ITERATION)
 
-    static u8 page_buf[PAGES_PER_ITERATION][PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    // Double buffered: the SD card writes out one buffer while the next one
+    // is read from NAND and ECC corrected.
+    static u8 page_buf[2][PAGES_PER_ITERATION][PAGE_SIZE] ALIGNED(NAND_DATA_ALIGN);
 
     sdcard_ack_card();
     if(sdcard_check_card() != SDMMC_INSERTED) {
@@ -1495,7 +2551,6 @@ int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
         return -1;
     }
 
-    int res = 0;
     if(base == 0) return -2;
 
     const char* name = NULL;
@@ -1508,27 +2563,50 @@ int _dump_slc_to_sdcard_sectors(u32 base, u32 bank)
     printf("Initializing %s...\n", name);
     nand_initialize(bank);
 
+    char manifest_name[32];
+    dump_manifest manifest;
+    snprintf(manifest_name, sizeof(manifest_name), "redNAND_%s", name);
+    _dump_manifest_open(&manifest, manifest_name, (u64)NAND_MAX_PAGE * PAGE_SIZE, 0, 0);
+
+    struct sdmmc_command sdcard_cmd = {0};
+    int sdcard_started = 0;
     u32 sdcard_sector = base;
     for(u32 i = 0; i < TOTAL_ITERATIONS; i++)
     {
         u32 page_base = i * PAGES_PER_ITERATION;
+        u8 (*buf)[PAGE_SIZE] = page_buf[i & 1];
         for(u32 page = 0; page < PAGES_PER_ITERATION; page++)
         {
-            nand_read_page(page_base + page, page_buf[page], nand_ecc_buf);
-            nand_correct(page_base + page, page_buf[page], nand_ecc_buf);
+            nand_read_page(page_base + page, buf[page], nand_ecc_buf);
+            nand_correct(page_base + page, buf[page], nand_ecc_buf);
         }
 
-        do res = sdcard_write(sdcard_sector, SECTORS_PER_ITERATION, page_buf);
-        while(res);
+        // Wait for the previous buffer before queueing this one.
+        if(i) {
+            if(_dump_sdcard_end_write(&sdcard_cmd, sdcard_started, sdcard_sector - SECTORS_PER_ITERATION,
+                                      SECTORS_PER_ITERATION, page_buf[(i - 1) & 1])) {
+                _dump_manifest_close(&manifest);
+                return -4;
+            }
+            _dump_manifest_flush(&manifest, false);
+        }
 
+        sdcard_started = !sdcard_start_write(sdcard_sector, SECTORS_PER_ITERATION, buf, &sdcard_cmd);
         sdcard_sector += SECTORS_PER_ITERATION;
 
+        // hash while the SD card DMAs the buffer out
+        _dump_manifest_update(&manifest, buf, PAGES_PER_ITERATION * PAGE_SIZE);
+
         if((i % 0x100) == 0) {
             printf("%s: Page 0x%05lX completed\n", name, page_base);
         }
     }
 
-    return 0;
+    int res = _dump_sdcard_end_write(&sdcard_cmd, sdcard_started, sdcard_sector - SECTORS_PER_ITERATION,
+                                     SECTORS_PER_ITERATION, page_buf[(TOTAL_ITERATIONS - 1) & 1]);
+    _dump_manifest_close(&manifest);
+
+    return res ? -4 : 0;
 
     #undef SECTORS_PER_PAGE
     #undef SECTORS_PER_ITERATION
@@ -1548,19 +2626,37 @@ int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base)
         return -2;
     }
 
+    int res = 0;
+
+    // A copy of the MLC only goes with the SLC it was cloned next to.
+    if(slc_base != 0 || slccmpt_base != 0)
+        f_unlink(DUMP_CHECKPOINT_PATH);
+
     // Dump SLC.
     if(slc_base != 0) {
-        _dump_slc_to_sdcard_sectors(slc_base, NAND_BANK_SLC);
+        res = _dump_slc_to_sdcard_sectors(slc_base, NAND_BANK_SLC);
+        if(res) {
+            printf("Failed to copy SLC (%d)!\n", res);
+            return -3;
+        }
     }
 
     // Dump SLCCMPT.
     if(slccmpt_base != 0) {
-        _dump_slc_to_sdcard_sectors(slccmpt_base, NAND_BANK_SLCCMPT);
+        res = _dump_slc_to_sdcard_sectors(slccmpt_base, NAND_BANK_SLCCMPT);
+        if(res) {
+            printf("Failed to copy SLCCMPT (%d)!\n", res);
+            return -4;
+        }
     }
 
     // Dump MLC.
     if(mlc_base != 0) {
-        _dump_mlc(mlc_base);
+        res = _dump_mlc(mlc_base, false);
+        if(res) {
+            printf("Failed to copy MLC (%d)!\n", res);
+            return -5;
+        }
     }
 
     return 0;
@@ -1657,6 +2753,9 @@ int _dump_partition_rednand(void)
         return -4;
     }
 
+    // whatever was copied to the old partitions is gone
+    f_unlink(DUMP_CHECKPOINT_PATH);
+
     // Mandatory backup
     mandatory_seeprom_otp_backups();
 
@@ -1949,6 +3048,32 @@ format_exit:
     console_power_to_exit();
 }
 
+void dump_resume_rednand(void)
+{
+    gfx_clear(GFX_ALL, BLACK);
+    printf("Resuming redNAND MLC dump...\n");
+
+    int res = rednand_load_mbr();
+    if(res < 0 || !rednand.mlc.lba_length){
+        printf("Failed to find redNAND MLC partition\n");
+        goto resume_exit;
+    }
+
+    smc_get_events(); // Eat all existing events
+
+    res = _dump_mlc(rednand.mlc.lba_start, true);
+    if(res) {
+        printf("Failed to dump MLC (%d)!\n", res);
+        goto resume_exit;
+    }
+
+    printf("redNAND MLC dump complete!\n");
+
+resume_exit:
+    clear_rednand();
+    console_power_to_exit();
+}
+
 void dump_erase_mlc(void){
     gfx_clear(GFX_ALL, BLACK);
     printf("Erase MLC\n");
@@ -17,11 +17,12 @@ void dump_menu_show();
 
 void dump_restore_seeprom(void);
 
-int _dump_mlc(u32 base);
+int _dump_mlc(u32 base, bool resume);
 int _dump_slc(u32 base, u32 bank);
 int _dump_slc_raw(u32 bank, int boot1_only);
 void dump_erase_mlc(void);
 int _dump_restore_mlc(u32 base);
+int _dump_mlc_sparse(void);
 
 int _dump_partition_rednand(void);
 int _dump_copy_rednand(u32 slc_base, u32 slccmpt_base, u32 mlc_base);
@@ -42,6 +43,9 @@ void dump_restore_boot1_vwii_img(void);
 void dump_slc(void);
 void dump_format_rednand(void);
 void dump_restore_rednand(void);
+void dump_resume_rednand(void);
+void dump_mlc_sparse(void);
+void dump_restore_mlc_sparse(void);
 void dump_seeprom_otp(void);
 void dump_espresso(void);
 void dump_factory_log(void);
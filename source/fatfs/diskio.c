@@ -16,9 +16,32 @@
 #include "sdcard.h"
 #include "sdhc.h"
 #include "utils.h"
+#include "memory.h"
 
+// Bounce buffer for callers whose buffers the SD host can't DMA to, everything
+// else goes straight to and from the caller's buffer.
 static u8 buffer[SDMMC_DEFAULT_BLOCKLEN * SDHC_BLOCK_COUNT_MAX] ALIGNED(32);
 
+static unsigned long long disk_direct_bytes = 0;
+static unsigned long long disk_bounced_bytes = 0;
+
+void disk_get_stats(unsigned long long* direct, unsigned long long* bounced)
+{
+    *direct = disk_direct_bytes;
+    *bounced = disk_bounced_bytes;
+}
+
+void disk_reset_stats(void)
+{
+    disk_direct_bytes = disk_bounced_bytes = 0;
+}
+
+// Both ends are checked, a buffer may run into memory the controller can't reach.
+static int disk_can_dma(const BYTE* buff, u32 len)
+{
+    return can_sdcard_dma_addr((void*)buff) && can_sdcard_dma_addr((void*)(buff + len - 0x20));
+}
+
 /*-----------------------------------------------------------------------*/
 /* Get Disk Status                                                       */
 /*-----------------------------------------------------------------------*/
@@ -72,12 +95,20 @@ DRESULT disk_read (
     (void)pdrv;
 
     while(count) {
-        u32 work = min(count, SDHC_BLOCK_COUNT_MAX);
-
-        if(sdcard_read(sector, work, buffer) != 0)
-            return RES_ERROR;
-
-        memcpy(buff, buffer, work * SDMMC_DEFAULT_BLOCKLEN);
+        // direct transfers go in one piece, sdcard_* splits them up as the host needs
+        u32 work = disk_can_dma(buff, count * SDMMC_DEFAULT_BLOCKLEN) ? count : min(count, SDHC_BLOCK_COUNT_MAX);
+        u32 len = work * SDMMC_DEFAULT_BLOCKLEN;
+
+        if(disk_can_dma(buff, len)) {
+            if(sdcard_read(sector, work, buff) != 0)
+                return RES_ERROR;
+            disk_direct_bytes += len;
+        } else {
+            if(sdcard_read(sector, work, buffer) != 0)
+                return RES_ERROR;
+            memcpy(buff, buffer, len);
+            disk_bounced_bytes += len;
+        }
 
         sector += work;
         count -= work;
@@ -104,12 +135,20 @@ DRESULT disk_write (
     (void)pdrv;
 
     while(count) {
-        u32 work = min(count, SDHC_BLOCK_COUNT_MAX);
-
-        memcpy(buffer, buff, work * SDMMC_DEFAULT_BLOCKLEN);
-
-        if(sdcard_write(sector, work, buffer) != 0)
-            return RES_ERROR;
+        // direct transfers go in one piece, sdcard_* splits them up as the host needs
+        u32 work = disk_can_dma(buff, count * SDMMC_DEFAULT_BLOCKLEN) ? count : min(count, SDHC_BLOCK_COUNT_MAX);
+        u32 len = work * SDMMC_DEFAULT_BLOCKLEN;
+
+        if(disk_can_dma(buff, len)) {
+            if(sdcard_write(sector, work, (void*)buff) != 0)
+                return RES_ERROR;
+            disk_direct_bytes += len;
+        } else {
+            memcpy(buffer, buff, len);
+            if(sdcard_write(sector, work, buffer) != 0)
+                return RES_ERROR;
+            disk_bounced_bytes += len;
+        }
 
         sector += work;
         count -= work;
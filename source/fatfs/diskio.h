@@ -37,6 +37,10 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+/* Bytes moved by DMA to/from the caller's buffer vs. through the bounce buffer */
+void disk_get_stats (unsigned long long* direct, unsigned long long* bounced);
+void disk_reset_stats (void);
+
 
 /* Disk Status Bits (DSTATUS) */
 
@@ -15,4 +15,7 @@ void hmac_init(hmac_ctx* ctx, const u8* key, int size);
 void hmac_update(hmac_ctx* ctx, const void* data, int size);
 void hmac_final(hmac_ctx *ctx, u8 *hmac); 
 
+// returns a handle for sha_wait, data must stay untouched until then
+u32 hmac_update_async(hmac_ctx* ctx, const void* data, int size);
+
 #endif /* _HMAC_H */
@@ -26,6 +26,9 @@
 #include "sha.h"
 #include "asic.h"
 #include "ppc.h"
+#include "crypto.h"
+#include "diskio.h"
+#include "sdcard.h"
 
 #define INTCON_HISTORY_DEPTH (64)
 #define INTCON_COMMAND_MAX_LEN (256)
@@ -103,7 +106,7 @@ void intcon_delete()
 
 void intcon_show_help(void)
 {
-    printf("Valid commands: exit, quit, reset, restart, shutdown, smc, peek, poke, set, clear, help, ?\n");
+    printf("Valid commands: exit, quit, reset, restart, shutdown, smc, peek, poke, set, clear, cryptobench, diskstats, sdstats, sdpredef, help, ?\n");
 }
 
 void intcon_smc_cmd(int argc, char** argv)
@@ -714,6 +717,26 @@ void intcon_handle_cmd(const char* pCmd)
             ppc_test(strtoll(argv[1], NULL, 0));
         }
     }
+    else if (!strcmp(cmd, "cryptobench")) {
+        crypto_benchmark();
+    }
+    else if (!strcmp(cmd, "diskstats")) {
+        unsigned long long direct, bounced;
+        disk_get_stats(&direct, &bounced);
+        printf("SD: %llu bytes direct, %llu bytes bounced\n", direct, bounced);
+        if (argc > 1 && !strcmp(argv[1], "reset"))
+            disk_reset_stats();
+    }
+    else if (!strcmp(cmd, "sdstats")) {
+        sdcard_print_stats();
+        if (argc > 1 && !strcmp(argv[1], "reset"))
+            sdcard_reset_stats();
+    }
+    else if (!strcmp(cmd, "sdpredef")) {
+        if (argc > 1)
+            sdcard_set_predef(!strcmp(argv[1], "on"));
+        printf("SD pre-declared writes: %s\n", sdcard_get_predef() ? "on" : "off");
+    }
     else if (!strcmp(cmd, "help") || !strcmp(cmd, "?")) {
         intcon_show_help();
     }
@@ -17,6 +17,7 @@
 #include "gfx.h"
 #include "utils.h"
 #include "crypto.h"
+#include "sha.h"
 #include "nand.h"
 #include "sdcard.h"
 #include "mlc.h"
@@ -98,12 +99,14 @@ void irq_handler(void)
         write32(LT_INTSR_AHBALL_ARM, IRQF_RESET);
     }*/
     if(all_mask & IRQF_SHA1) {
-        printf("IRQ: SHA1\n");
+//      printf("IRQ: SHA1\n");
         write32(LT_INTSR_AHBALL_ARM, IRQF_SHA1);
+        sha_irq();
     }
     if(all_mask & IRQF_AES) {
 //      printf("IRQ: AES\n");
         write32(LT_INTSR_AHBALL_ARM, IRQF_AES);
+        aes_irq();
     }
     if(all_mask & IRQF_SD0) {
 //      printf("IRQ: SD0\n");
@@ -42,6 +42,44 @@ static u8 ecc_buf[ECC_BUFFER_ALLOC] ALIGNED(NAND_DATA_ALIGN);
 
 static bool initialized = false;
 
+#ifdef MINUTE_BOOT1
+#define ISFS_CACHE_LINES        1
+#define ISFS_CACHE_READAHEAD    1
+#else
+#define ISFS_CACHE_LINES        4
+#define ISFS_CACHE_READAHEAD    4
+#endif
+
+typedef struct {
+    int volume;
+    u32 generation;
+    u16 cluster;
+    u16 count;
+    u32 last_used;
+    u8* data;
+} isfs_cache_line;
+
+static isfs_cache_line isfs_cache[ISFS_CACHE_LINES];
+static u8* isfs_cache_data = NULL;
+static u32 isfs_cache_tick = 0;
+
+#ifdef MINUTE_BOOT1
+#define ISFS_CLMT_POOL          1
+#else
+#define ISFS_CLMT_POOL          4
+#endif
+#define ISFS_CLMT_ENTRIES       64
+
+static u16 isfs_clmt_pool[ISFS_CLMT_POOL][ISFS_CLMT_ENTRIES];
+static bool isfs_clmt_used[ISFS_CLMT_POOL];
+
+#ifndef MINUTE_BOOT1
+// open addressed (parent, name) -> fst index table, followed by the parent of every fst
+#define ISFS_LOOKUP_SIZE        0x4000
+#define ISFS_LOOKUP_ALLOC       ((ISFS_LOOKUP_SIZE + ISFS_FST_COUNT) * sizeof(u16))
+#define ISFS_LOOKUP_MAX_DEPTH   16
+#endif
+
 isfs_ctx isfs[4] = {
     [ISFSVOL_SLC]
     {
@@ -108,11 +146,89 @@ static int _isfs_super_check_slot(isfs_ctx *ctx, u32 index)
     return 0;
 }
 
-static int _isfs_decrypt_cluster(const isfs_ctx* ctx, u8 *cluster_data){
-    aes_reset();
-    aes_set_key((u8*)ctx->aes);
-    aes_empty_iv();
-    aes_decrypt(cluster_data, cluster_data, CLUSTER_SIZE / ISFSAES_BLOCK_SIZE, 0);  
+// number of clusters from the chain at cluster that are also physically consecutive, up to max
+static u32 _isfs_cluster_run(isfs_ctx* ctx, u16 cluster, u32 max)
+{
+    u16* fat = _isfs_get_fat(ctx);
+    u32 count = 1;
+
+    while(count < max && fat[cluster] == cluster + 1) {
+        cluster++;
+        count++;
+    }
+
+    return count;
+}
+
+/* decrypted cluster cache, each line holds a run of up to ISFS_CACHE_READAHEAD clusters */
+static void _isfs_cache_invalidate(const isfs_ctx* ctx)
+{
+    for(int i = 0; i < ISFS_CACHE_LINES; i++) {
+        if(isfs_cache[i].volume != ctx->volume)
+            continue;
+        isfs_cache[i].count = 0;
+        isfs_cache[i].last_used = 0;
+    }
+}
+
+static u8* _isfs_cache_get(isfs_ctx* ctx, u16 cluster)
+{
+    u32 generation = _isfs_get_hdr(ctx)->generation;
+    isfs_cache_line* victim = NULL;
+
+    if(!isfs_cache_data) {
+        isfs_cache_data = memalign(NAND_DATA_ALIGN, ISFS_CACHE_LINES * ISFS_CACHE_READAHEAD * CLUSTER_SIZE);
+        if(!isfs_cache_data) return NULL;
+        for(int i = 0; i < ISFS_CACHE_LINES; i++)
+            isfs_cache[i].data = isfs_cache_data + i * ISFS_CACHE_READAHEAD * CLUSTER_SIZE;
+    }
+
+    for(int i = 0; i < ISFS_CACHE_LINES; i++) {
+        isfs_cache_line* line = &isfs_cache[i];
+        if(line->count && line->volume == ctx->volume && line->generation == generation &&
+           cluster >= line->cluster && cluster < line->cluster + line->count) {
+            line->last_used = ++isfs_cache_tick;
+            return line->data + (cluster - line->cluster) * CLUSTER_SIZE;
+        }
+        if(!victim || line->last_used < victim->last_used)
+            victim = line;
+    }
+
+    // read ahead along the FAT chain, as long as it stays physically consecutive
+    u32 count = _isfs_cluster_run(ctx, cluster, ISFS_CACHE_READAHEAD);
+
+    victim->count = 0;
+    victim->last_used = 0;
+    if(isfs_read_volume(ctx, cluster, count, ISFSVOL_FLAG_ENCRYPTED, NULL, victim->data) < 0)
+        return NULL;
+
+    victim->volume = ctx->volume;
+    victim->generation = generation;
+    victim->cluster = cluster;
+    victim->count = count;
+    victim->last_used = ++isfs_cache_tick;
+
+    return victim->data;
+}
+
+#define ISFS_AES_BATCH (16)
+
+static aes_session isfs_aes;
+
+static aes_session* _isfs_aes_session(const isfs_ctx* ctx){
+    if(isfs_aes.cmd != AES_CMD_DECRYPT || memcmp(isfs_aes.key, ctx->aes, sizeof(isfs_aes.key)))
+        aes_session_init(&isfs_aes, AES_CMD_DECRYPT, (const u8*)ctx->aes, NULL);
+    return &isfs_aes;
+}
+
+/* every cluster is its own CBC stream starting from a zero IV */
+static u32 _isfs_decrypt_clusters_async(const isfs_ctx* ctx, aes_segment *segs, u8 *data, u32 count){
+    for (u32 i = 0; i < count; i++){
+        segs[i].src = segs[i].dst = data + i * CLUSTER_SIZE;
+        segs[i].blocks = CLUSTER_SIZE / ISFSAES_BLOCK_SIZE;
+        segs[i].keep_iv = 0;
+    }
+    return aes_session_submit(_isfs_aes_session(ctx), segs, count);
 }
 
 static int _isfs_read_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count, u32 flags, void *data){
@@ -130,8 +246,10 @@ static int _isfs_read_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_cou
         return -1;
 
     if(flags & ISFSVOL_FLAG_ENCRYPTED){
-        for (int p = 0; p < cluster_count; p++){
-            _isfs_decrypt_cluster(ctx, data + p * CLUSTER_SIZE);
+        aes_segment segs[ISFS_AES_BATCH];
+        for (u32 p = 0; p < cluster_count; p += ISFS_AES_BATCH){
+            u32 count = min(cluster_count - p, ISFS_AES_BATCH);
+            aes_wait(_isfs_decrypt_clusters_async(ctx, segs, (u8*)data + p * CLUSTER_SIZE, count));
         }
     }
     return 0;
@@ -179,6 +297,18 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
     bool hmac_partial = false;
     bool nand_error = false;
 
+    /* NAND reads cluster N while AES decrypts N-1 and the HMAC absorbs N-2 */
+    hmac_ctx calc_hmac;
+    aes_segment aes_seg;
+    u32 aes_handle = 0;
+    u8 *aes_cluster = NULL;
+
+    if (flags & ISFSVOL_FLAG_HMAC)
+    {
+        hmac_init(&calc_hmac, ctx->hmac, 20);
+        hmac_update(&calc_hmac, (const u8 *)hmac_seed, SHA_BLOCK_SIZE);
+    }
+
     /* read all requested clusters */
     for (i = 0; i < cluster_count; i++)
     {
@@ -192,26 +322,30 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
             // make sure ECC fails, if read did nothing
             memset(ecc_buf, 0, ECC_BUFFER_ALLOC);
             /* attempt to read the page (and correct ecc errors) */
-            int nand_error;
+            int read_error;
+            int correct;
             if(ctx->file){
-                nand_error = _nand_read_page_rawfile(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf, ctx->file);
+                read_error = _nand_read_page_rawfile(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf, ctx->file);
+                /* raw images carry the stored ECC only, check it in software; a page that wasn't read is garbage */
+                correct = read_error ? NAND_ECC_UNCORRECTABLE : nand_correct_sw(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
             } else {
-                nand_error = nand_read_page(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
-                int correct = nand_correct(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
-                /* uncorrectable ecc error or other issues */
-                if (correct < 0) {
-                    ISFS_debug("Uncorrectable ECC ERROR\n");
-                    ecc_uncorrectable = true;
-                }
-
-                /* ECC errors, a refresh might be needed */
-                if (correct > 0){
-                    ISFS_debug("Corrected ECC ERROR\n");
-                    ecc_correctable = true;
-                }
+                read_error = nand_read_page(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
+                correct = nand_correct(cluster_start + p, &cluster_data[p * PAGE_SIZE], ecc_buf);
+            }
+
+            /* uncorrectable ecc error or other issues */
+            if (correct < 0) {
+                ISFS_debug("Uncorrectable ECC ERROR\n");
+                ecc_uncorrectable = true;
+            }
+
+            /* ECC errors, a refresh might be needed */
+            if (correct > 0){
+                ISFS_debug("Corrected ECC ERROR\n");
+                ecc_correctable = true;
             }
                 
-            if(nand_error){
+            if(read_error){
                 ISFS_debug("NAND ERROR on read\n");
                 nand_error = true;
             }
@@ -226,11 +360,30 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
                 memcpy(&saved_hmacs[1][12], &ecc_buf[1], 8);
         }
 
+        /* hash the previous cluster once it is decrypted */
+        if (aes_cluster) {
+            aes_wait(aes_handle);
+            if (flags & ISFSVOL_FLAG_HMAC)
+                hmac_update_async(&calc_hmac, aes_cluster, CLUSTER_SIZE);
+            aes_cluster = NULL;
+        }
+
         /* decrypt cluster */
-        if (flags & ISFSVOL_FLAG_ENCRYPTED)
-            _isfs_decrypt_cluster(ctx, cluster_data);
+        if (flags & ISFSVOL_FLAG_ENCRYPTED) {
+            aes_handle = _isfs_decrypt_clusters_async(ctx, &aes_seg, cluster_data, 1);
+            aes_cluster = cluster_data;
+        } else if (flags & ISFSVOL_FLAG_HMAC)
+            hmac_update_async(&calc_hmac, cluster_data, CLUSTER_SIZE);
+    }
 
+    /* drain the pipeline */
+    if (aes_cluster) {
+        aes_wait(aes_handle);
+        if (flags & ISFSVOL_FLAG_HMAC)
+            hmac_update_async(&calc_hmac, aes_cluster, CLUSTER_SIZE);
     }
+    if (flags & ISFSVOL_FLAG_HMAC)
+        hmac_final(&calc_hmac, hmac);
 
     if(nand_error)
         return ISFSVOL_ERROR_READ; 
@@ -241,15 +394,8 @@ int isfs_read_volume(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_count,
     /* verify hmac */
     if (flags & ISFSVOL_FLAG_HMAC)
     {
-        hmac_ctx calc_hmac;
         int matched = 0;
 
-        /* compute clusters hmac */
-        hmac_init(&calc_hmac, ctx->hmac, 20);
-        hmac_update(&calc_hmac, (const u8 *)hmac_seed, SHA_BLOCK_SIZE);
-        hmac_update(&calc_hmac, (const u8 *)data, cluster_count * CLUSTER_SIZE);
-        hmac_final(&calc_hmac, hmac);
-
         /* ensure at least one of the saved hmacs matches */
         matched += !memcmp(saved_hmacs[0], hmac, sizeof(hmac));
         matched += !memcmp(saved_hmacs[1], hmac, sizeof(hmac));
@@ -288,8 +434,10 @@ static int _isfs_write_sd(const isfs_ctx* ctx, u32 start_cluster, u32 cluster_co
         return -1;
 
     if(flags & ISFSVOL_FLAG_ENCRYPTED){
-        for (int p = 0; p < cluster_count; p++){
-            _isfs_decrypt_cluster(ctx, data + p * CLUSTER_SIZE);
+        aes_segment segs[ISFS_AES_BATCH];
+        for (u32 p = 0; p < cluster_count; p += ISFS_AES_BATCH){
+            u32 count = min(cluster_count - p, ISFS_AES_BATCH);
+            aes_wait(_isfs_decrypt_clusters_async(ctx, segs, (u8*)data + p * CLUSTER_SIZE, count));
         }
     }
     return 0;
@@ -524,7 +672,125 @@ static bool _isfs_fst_is_dir(const isfs_fst* fst)
     return _isfs_fst_get_type(fst) == 2;
 }
 
+#ifndef MINUTE_BOOT1
+static void _isfs_lookup_name(char key[12], const char* name, size_t size)
+{
+    memset(key, 0, 12);
+    for(size_t i = 0; i < size && name[i]; i++)
+        key[i] = name[i];
+}
+
+// a word at a time, the key is zero padded
+static u32 _isfs_lookup_hash(u16 parent, const char key[12])
+{
+    u32 words[3];
+    memcpy(words, key, sizeof(words));
+
+    u32 hash = 0x811C9DC5 ^ parent;
+    for(int i = 0; i < 3; i++)
+        hash = (hash ^ words[i]) * 0x01000193;
+    return (hash ^ (hash >> 15)) & (ISFS_LOOKUP_SIZE - 1);
+}
+
+static int _isfs_lookup_add_dir(isfs_ctx* ctx, u16 dir, int depth, u32* count)
+{
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u16* table = ctx->lookup;
+    u16* parents = &ctx->lookup[ISFS_LOOKUP_SIZE];
+    char key[12];
+
+    if(depth > ISFS_LOOKUP_MAX_DEPTH)
+        return -1;
+
+    for(u16 next = root[dir].sub; next != 0xFFFF; next = root[next].sib) {
+        // out of range or looping fst, leave it to the linear walker
+        if(next >= ISFS_FST_COUNT || ++(*count) >= ISFS_FST_COUNT)
+            return -1;
+
+        _isfs_lookup_name(key, root[next].name, sizeof(root[next].name));
+        u32 h = _isfs_lookup_hash(dir, key);
+        while(table[h] != 0xFFFF)
+            h = (h + 1) & (ISFS_LOOKUP_SIZE - 1);
+        table[h] = next;
+        parents[next] = dir;
+
+        if(!_isfs_fst_is_file(&root[next]) && _isfs_lookup_add_dir(ctx, next, depth + 1, count))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int _isfs_lookup_build(isfs_ctx* ctx)
+{
+    u32 count = 0;
+
+    memset(ctx->lookup, 0xFF, ISFS_LOOKUP_ALLOC);
+    if(_isfs_lookup_add_dir(ctx, 0, 0, &count))
+        return -1;
+
+    ctx->lookup_valid = true;
+    ISFS_debug("lookup index built with %lu entries\n", count);
+    return 0;
+}
+
+// returns -1 if the index can't answer, the linear walker has to be used then
+static int _isfs_lookup_fst(isfs_ctx* ctx, const char* path, isfs_fst** out)
+{
+    if(!ctx->lookup)
+        return -1;
+    if(!ctx->lookup_valid && _isfs_lookup_build(ctx))
+        return -1;
+
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u16* table = ctx->lookup;
+    u16* parents = &ctx->lookup[ISFS_LOOKUP_SIZE];
+    char key[12];
+    u16 dir = 0;
+
+    while(true) {
+        while(*path == '/') path++;
+        const char* remaining = strchr(path, '/');
+
+        size_t size = remaining ? remaining - path : strlen(path);
+        if(size > sizeof(key))
+            return -1;
+        _isfs_lookup_name(key, path, size);
+
+        u16 found = 0xFFFF;
+        for(u32 h = _isfs_lookup_hash(dir, key); table[h] != 0xFFFF; h = (h + 1) & (ISFS_LOOKUP_SIZE - 1)) {
+            u16 index = table[h];
+            const isfs_fst* fst = &root[index];
+            if(parents[index] != dir || (remaining && _isfs_fst_is_file(fst)))
+                continue;
+            // same match as the linear walker, whatever follows the terminator
+            if((size < sizeof(fst->name) && fst->name[size]) || memcmp(path, fst->name, size))
+                continue;
+            found = index;
+            break;
+        }
+
+        if(found == 0xFFFF) {
+            *out = NULL;
+            return 0;
+        }
+        if(!remaining) {
+            *out = &root[found];
+            return 0;
+        }
+        dir = found;
+        path = remaining;
+    }
+}
+#endif
+
 static isfs_fst* _isfs_find_fst(isfs_ctx* ctx, const char* path, void** parent){
+#ifndef MINUTE_BOOT1
+    isfs_fst* found = NULL;
+    if(!parent && _isfs_lookup_fst(ctx, path, &found) == 0)
+        return found;
+#endif
+
     isfs_fst* root = _isfs_get_fst(ctx);
     if(parent)
         *parent = &root->sub;
@@ -663,6 +929,8 @@ static int _isfs_load_super_range(isfs_ctx* ctx, u32 min_generation, u32 max_gen
 
 int isfs_load_super(isfs_ctx* ctx){
     u32 max_generation = 0xffffffff;
+    _isfs_cache_invalidate(ctx);
+    ctx->lookup_valid = false;
     ctx->isfshax = false;
     int res = _isfs_load_super_range(ctx, ISFSHAX_GENERATION_FIRST, 0xffffffff);
     if(res>=0){
@@ -704,6 +972,8 @@ bool isfs_is_isfshax_super(isfs_ctx* ctx, u8 index){
 
 int isfs_commit_super(isfs_ctx* ctx)
 {
+    _isfs_cache_invalidate(ctx);
+    ctx->lookup_valid = false;
     _isfs_get_hdr(ctx)->generation++;
 
     for(int i = 1; i <= ctx->super_count; i++)
@@ -801,11 +1071,94 @@ int isfs_open(isfs_file* file, const char* path)
 int isfs_close(isfs_file* file)
 {
     if(!file) return -1;
+
+    if(file->clmt_pooled)
+        isfs_clmt_used[(file->clmt - isfs_clmt_pool[0]) / ISFS_CLMT_ENTRIES] = false;
+
     memset(file, 0, sizeof(isfs_file));
 
     return 0;
 }
 
+// use a caller supplied buffer of size entries for the cluster link map
+int isfs_set_clmt(isfs_file* file, u16* clmt, u16 size)
+{
+    if(!file || !clmt || size < 3) return -1;
+
+    if(file->clmt_pooled)
+        isfs_clmt_used[(file->clmt - isfs_clmt_pool[0]) / ISFS_CLMT_ENTRIES] = false;
+
+    file->clmt = clmt;
+    file->clmt_size = size;
+    file->clmt_valid = false;
+    file->clmt_pooled = false;
+    file->clmt_failed = false;
+
+    return 0;
+}
+
+static int _isfs_build_clmt(isfs_ctx* ctx, isfs_file* file)
+{
+    if(!file->clmt) {
+        for(int i = 0; i < ISFS_CLMT_POOL; i++) {
+            if(isfs_clmt_used[i]) continue;
+            isfs_clmt_used[i] = true;
+            file->clmt = isfs_clmt_pool[i];
+            file->clmt_size = ISFS_CLMT_ENTRIES;
+            file->clmt_pooled = true;
+            break;
+        }
+        if(!file->clmt) return -1;
+    }
+
+    u16* fat = _isfs_get_fat(ctx);
+    u16 cluster = file->fst->sub;
+    u32 runs = 0;
+
+    for(u32 n = 0; cluster < FAT_CLUSTER_LAST && n < CLUSTER_COUNT; runs++) {
+        if(1 + (runs + 1) * 2 > file->clmt_size) {
+            // too fragmented, give the pool slot back and walk the FAT from now on
+            if(file->clmt_pooled) {
+                isfs_clmt_used[(file->clmt - isfs_clmt_pool[0]) / ISFS_CLMT_ENTRIES] = false;
+                file->clmt = NULL;
+                file->clmt_pooled = false;
+            }
+            file->clmt_failed = true;
+            return -2;
+        }
+
+        u16 start = cluster;
+        u16 length = 1;
+        while(fat[cluster] == cluster + 1) {
+            cluster++;
+            length++;
+        }
+
+        file->clmt[1 + runs * 2] = length;
+        file->clmt[2 + runs * 2] = start;
+        n += length;
+        cluster = fat[cluster];
+    }
+
+    file->clmt[0] = runs;
+    file->clmt_valid = true;
+
+    return 0;
+}
+
+static u16 _isfs_clmt_lookup(const isfs_file* file, u32 index)
+{
+    const u16* run = &file->clmt[1];
+
+    for(u32 i = 0; i < file->clmt[0]; i++, run += 2) {
+        if(index < run[0])
+            return run[1] + index;
+        index -= run[0];
+    }
+
+    return FAT_CLUSTER_LAST;
+}
+
 int isfs_seek(isfs_file* file, s32 offset, int whence)
 {
     if(!file) return -1;
@@ -834,12 +1187,17 @@ int isfs_seek(isfs_file* file, s32 offset, int whence)
             break;
     }
 
+    if(file->clmt_valid || (!file->clmt_failed && _isfs_build_clmt(ctx, file) == 0)) {
+        file->cluster = _isfs_clmt_lookup(file, file->offset / CLUSTER_SIZE);
+        return 0;
+    }
+
     u16 sub = fst->sub;
     size_t size = file->offset;
 
-    while(size > 8 * PAGE_SIZE) {
+    while(size >= CLUSTER_SIZE && sub < FAT_CLUSTER_LAST) {
         sub = _isfs_get_fat(ctx)[sub];
-        size -= 8 * PAGE_SIZE;
+        size -= CLUSTER_SIZE;
     }
 
     file->cluster = sub;
@@ -862,12 +1220,28 @@ int isfs_read(isfs_file* file, void* buffer, size_t size, size_t* bytes_read)
 
     while(size) {
         size_t pos = file->offset % CLUSTER_SIZE;
+
+        /* whole clusters go straight to the caller, merging physically consecutive ones */
+        if(!pos && size >= CLUSTER_SIZE && !((u32)buffer & (NAND_DATA_ALIGN - 1))) {
+            u32 count = _isfs_cluster_run(ctx, file->cluster, size / CLUSTER_SIZE);
+            if (isfs_read_volume(ctx, file->cluster, count, ISFSVOL_FLAG_ENCRYPTED, NULL, buffer) < 0)
+                return -4;
+
+            file->offset += count * CLUSTER_SIZE;
+            buffer += count * CLUSTER_SIZE;
+            size -= count * CLUSTER_SIZE;
+
+            file->cluster = _isfs_get_fat(ctx)[file->cluster + count - 1];
+            continue;
+        }
+
         size_t copy = CLUSTER_SIZE - pos;
         if(copy > size) copy = size;
 
-        if (isfs_read_volume(ctx, file->cluster, 1, ISFSVOL_FLAG_ENCRYPTED, NULL, slc_cluster_buf) < 0)
+        u8* cluster_data = _isfs_cache_get(ctx, file->cluster);
+        if (!cluster_data)
             return -4;
-        memcpy(buffer, slc_cluster_buf + pos, copy);
+        memcpy(buffer, cluster_data + pos, copy);
 
         file->offset += copy;
         buffer += copy;
@@ -969,6 +1343,10 @@ int isfs_init(unsigned int volume)
     }
     ctx->mounted = true;
 
+#ifndef MINUTE_BOOT1
+    if(!ctx->lookup) ctx->lookup = malloc(ISFS_LOOKUP_ALLOC);
+#endif
+
     int _isfsdev_init(isfs_ctx* ctx);
     _isfsdev_init(ctx);
 
@@ -991,6 +1369,13 @@ int isfs_unmount(int volume){
         ctx->super = NULL;
     }
 
+    if(ctx->lookup) {
+        free(ctx->lookup);
+        ctx->lookup = NULL;
+    }
+    ctx->lookup_valid = false;
+
+    _isfs_cache_invalidate(ctx);
     RemoveDevice(ctx->name);
     ctx->mounted = false;
     ctx->isfshax = false;
@@ -1007,6 +1392,11 @@ int isfs_fini(void)
         isfs_unmount(i);
     }
 
+    if(isfs_cache_data) {
+        free(isfs_cache_data);
+        isfs_cache_data = NULL;
+    }
+
     initialized = false;
 
     return 0;
@@ -23,6 +23,7 @@
 
 #define ISFSSUPER_CLUSTERS  0x10
 #define ISFSSUPER_SIZE      (ISFSSUPER_CLUSTERS * CLUSTER_SIZE)
+#define ISFS_FST_COUNT      (6143)
 #define ISFSVOL_FLAG_HMAC       1
 #define ISFSVOL_FLAG_ENCRYPTED  2
 #define ISFSVOL_FLAG_READBACK   4
@@ -76,6 +77,8 @@ typedef struct {
     u8 hmac[0x14];
     devoptab_t devoptab;
     FIL* file;
+    u16* lookup;
+    bool lookup_valid;
 } isfs_ctx;
 
 typedef struct {
@@ -83,6 +86,12 @@ typedef struct {
     isfs_fst* fst;
     size_t offset;
     u16 cluster;
+    // cluster link map for fast seeking: run count, then (length, start) pairs
+    u16* clmt;
+    u16 clmt_size;
+    bool clmt_valid;
+    bool clmt_pooled;
+    bool clmt_failed;   // too fragmented for the map, seeks walk the FAT
 } isfs_file;
 
 typedef struct {
@@ -127,6 +136,7 @@ isfs_fst* isfs_stat(const char* path);
 int isfs_open(isfs_file* file, const char* path);
 int isfs_close(isfs_file* file);
 
+int isfs_set_clmt(isfs_file* file, u16* clmt, u16 size);
 int isfs_seek(isfs_file* file, s32 offset, int whence);
 int isfs_read(isfs_file* file, void* buffer, size_t size, size_t* bytes_read);
 
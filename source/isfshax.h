@@ -48,7 +48,7 @@ typedef struct isfshax_super
     u32 generation;
     u32 x1;
     u16 fat[CLUSTER_COUNT];
-    isfs_fst fst[6143];
+    isfs_fst fst[ISFS_FST_COUNT];
     isfshax_info isfshax;
 } PACKED ALIGNED(NAND_DATA_ALIGN) isfshax_super;
 
@@ -696,6 +696,14 @@ int mlc_start_read(u32 blk_start, u32 blk_count, void *data, struct sdmmc_comman
     return 0;
 }
 
+int mlc_poll(struct sdmmc_command* cmdbuf)
+{
+    if (card.inserted == 0)
+        return 1;
+
+    return sdhc_async_ready(card.handle, cmdbuf);
+}
+
 int mlc_end_read(struct sdmmc_command* cmdbuf)
 {
 //  printf("%s(%u, %u, %p)\n", __FUNCTION__, blk_start, blk_count, data);
@@ -1075,6 +1083,11 @@ static void _mlc_do_init(void){
         .abort = &mlc_abort,
         .rb = RB_SD2,
         .wb = WB_SD2,
+#ifdef CAN_HAZ_IRQ
+        .irq_mask_reg = LT_INTMR_AHBLT_ARM,
+        .irq_status_reg = LT_INTSR_AHBLT_ARM,
+        .irq_flag = IRQLF_SD2,
+#endif
     };
 
 #ifdef CAN_HAZ_IRQ
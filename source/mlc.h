@@ -38,6 +38,8 @@ int mlc_end_read(struct sdmmc_command* cmdbuf);
 int mlc_start_write(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf);
 int mlc_end_write(struct sdmmc_command* cmdbuf);
 
+int mlc_poll(struct sdmmc_command* cmdbuf);
+
 int mlc_erase(void);
 
 #endif
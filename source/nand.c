@@ -367,16 +367,18 @@ int nand_correct(u32 pageno, void *data, void *ecc)
     (void) pageno;
 
     u8 *dp = (u8*)data;
-    u32 *ecc_read = (u32*)((u8*)ecc+0x30);
-    u32 *ecc_calc = (u32*)((u8*)ecc+0x40);
+    const u8 *ecc_read = (u8*)ecc+0x30;
+    const u8 *ecc_calc = (u8*)ecc+0x40;
     int i;
     int uncorrectable = 0;
     int corrected = 0;
 
     for(i=0;i<4;i++) {
-        u32 syndrome = *ecc_read ^ *ecc_calc; //calculate ECC syncrome
+        // big endian words, whatever runs this
+        u32 stored = read32_unaligned(ecc_read);
+        u32 syndrome = stored ^ read32_unaligned(ecc_calc); //calculate ECC syncrome
         // don't try to correct unformatted pages (all FF)
-        if ((*ecc_read != 0xFFFFFFFF) && syndrome) {
+        if ((stored != 0xFFFFFFFF) && syndrome) {
             if(!((syndrome-1)&syndrome)) {
                 // single-bit error in ECC
                 corrected++;
@@ -395,8 +397,8 @@ int nand_correct(u32 pageno, void *data, void *ecc)
             }
         }
         dp += 0x200;
-        ecc_read++;
-        ecc_calc++;
+        ecc_read += 4;
+        ecc_calc += 4;
     }
     if(uncorrectable || corrected)
         printf("ECC stats for NAND page 0x%lX: %d uncorrectable, %d corrected\n", pageno, uncorrectable, corrected);
@@ -407,66 +409,98 @@ int nand_correct(u32 pageno, void *data, void *ecc)
     return NAND_ECC_OK;
 }
 
-static u8 _nand_parity(u8 x)
+static u8 _nand_parity(u32 x)
 {
-    u8 y = 0;
-    while (x)
-    {
-        y ^= (x & 1);
-        x >>= 1;
-    }
-    return y;
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return x & 1;
 }
 
-void nand_create_ecc(void* in_data, void* spare_out)
+/* byte offset (low two bits) and parity of the odd-parity bytes of a word,
+ * indexed by a nibble holding one bit per byte (bit k = byte at offset k) */
+static const u8 _nand_ecc_nibble[16] = {
+    0x0, 0x4, 0x5, 0x1, 0x6, 0x2, 0x3, 0x7,
+    0x7, 0x3, 0x2, 0x6, 0x1, 0x5, 0x4, 0x0,
+};
+
+/* Hamming ECC of one 512 byte sector, bit exact with the controller.
+ * The line parities only depend on which byte offsets hold a byte of
+ * odd parity, so the sector is folded into the XOR of those offsets plus
+ * the XOR of all bytes (for the column parities), a word at a time. */
+static u32 _nand_ecc_sector(const u8* data)
 {
-    u8 a[12][2];
-    u32 a0, a1;
-    u8 x;
+    u32 col = 0, odd = 0;
 
-    u8* spare_buf = PTR_OFFS(spare_out, 0x0);
-    memset(spare_buf, 0, 0x40);
-    spare_buf[0] = 0xFF;
-
-    u8* ecc = PTR_OFFS(spare_out, 0x30);
-    const u8* data = (u8*)in_data;
-
-    for (int k = 0; k < 4; k++)
-    {
-        memset(a, 0, sizeof(a));
-        for (int i = 0; i < 0x200; i++)
+    if(!((u32)data & 3)) {
+        const u32* words = (const u32*)data;
+        for (u32 w = 0; w < 0x200 / 4; w++)
         {
-            x = data[i];
-            for (int j = 0; j < 9; j++)
-                a[3 + j][(i >> j) & 1] ^= x;
+            u32 v = words[w];
+            col ^= v;
+            v ^= v >> 4;
+            v ^= v >> 2;
+            v ^= v >> 1;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+            u32 m = (v & 1) | ((v >> 7) & 2) | ((v >> 14) & 4) | ((v >> 21) & 8);
+#else
+            u32 m = ((v >> 24) & 1) | ((v >> 15) & 2) | ((v >> 6) & 4) | ((v << 3) & 8);
+#endif
+            u32 n = _nand_ecc_nibble[m];
+            odd ^= (n & 3) | ((n & 4) ? w << 2 : 0);
         }
-
-        x = a[3][0] ^ a[3][1];
-        a[0][0] = x & 0x55;
-        a[0][1] = x & 0xaa;
-        a[1][0] = x & 0x33;
-        a[1][1] = x & 0xcc;
-        a[2][0] = x & 0x0f;
-        a[2][1] = x & 0xf0;
-
-        for (int j = 0; j < 12; j++)
+        col ^= col >> 16;
+        col ^= col >> 8;
+    } else {
+        for (u32 i = 0; i < 0x200; i++)
         {
-            a[j][0] = _nand_parity(a[j][0]);
-            a[j][1] = _nand_parity(a[j][1]);
+            u8 x = data[i];
+            col ^= x;
+            if (_nand_parity(x))
+                odd ^= i;
         }
-        a0 = a1 = 0;
+    }
+    col &= 0xFF;
 
-        for (int j = 0; j < 12; j++)
-        {
-            a0 |= a[j][0] << j;
-            a1 |= a[j][1] << j;
-        }
-        ecc[0] = a0;
-        ecc[1] = a0 >> 8;
-        ecc[2] = a1;
-        ecc[3] = a1 >> 8;
+    u32 even = _nand_parity(col) ? (~odd & 0x1FF) : odd;
+    u32 a0 = _nand_parity(col & 0x55) | (_nand_parity(col & 0x33) << 1) | (_nand_parity(col & 0x0F) << 2) | (even << 3);
+    u32 a1 = _nand_parity(col & 0xAA) | (_nand_parity(col & 0xCC) << 1) | (_nand_parity(col & 0xF0) << 2) | (odd << 3);
 
-        data += 512;
+    /* same byte order the controller stores it in the spare area */
+    return ((a0 & 0xFF) << 24) | ((a0 >> 8) << 16) | ((a1 & 0xFF) << 8) | (a1 >> 8);
+}
+
+void nand_calc_ecc(const void* in_data, void* ecc_out)
+{
+    const u8* data = (const u8*)in_data;
+    u8* ecc = (u8*)ecc_out;
+
+    for (int k = 0; k < 4; k++)
+    {
+        u32 sector = _nand_ecc_sector(data);
+        ecc[0] = sector >> 24;
+        ecc[1] = sector >> 16;
+        ecc[2] = sector >> 8;
+        ecc[3] = sector;
+
+        data += 0x200;
         ecc += 4;
     }
 }
+
+void nand_create_ecc(void* in_data, void* spare_out)
+{
+    u8* spare_buf = PTR_OFFS(spare_out, 0x0);
+    memset(spare_buf, 0, 0x40);
+    spare_buf[0] = 0xFF;
+
+    nand_calc_ecc(in_data, PTR_OFFS(spare_out, 0x30));
+}
+
+int nand_correct_sw(u32 pageno, void *data, void *ecc)
+{
+    nand_calc_ecc(data, PTR_OFFS(ecc, 0x40));
+    return nand_correct(pageno, data, ecc);
+}
@@ -56,7 +56,9 @@ void nand_wait(void);
 
 int nand_correct(u32 pageno, void *data, void *ecc);
 void nand_initialize(u32 bank);
+void nand_calc_ecc(const void* in_data, void* ecc_out);
 void nand_create_ecc(void* in_data, void* spare_out);
+int nand_correct_sw(u32 pageno, void *data, void *ecc);
 
 #endif
 
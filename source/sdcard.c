@@ -44,14 +44,39 @@ struct sdcard_ctx {
     int sdhc_blockmode;
     int selected;
     int new_card; // set to 1 everytime a new card is inserted
-    int multiple_fallback;
 
     u32 num_sectors;
     u16 rca;
+
+    u8 cid_mid;
+    u16 cid_oid;
+    char cid_pnm[6];
+    int cmd23;      // SCR says the card takes CMD23
+    u32 quirks;
 };
 
 static struct sdcard_ctx card;
 
+static void _sdcard_recovery_reset(void);
+
+#define SDCARD_QUIRK_NO_CMD23       (1<<0)  // advertises CMD23 but chokes on it
+#define SDCARD_QUIRK_NO_PRE_ERASE   (1<<1)  // ACMD23 fails or makes it slower
+
+// Cards that misbehave with pre-declared writes. A NULL name matches any product
+// of that manufacturer/OEM. None confirmed yet, until a card lands here its
+// failures at runtime go through the same backoff as the transfer modes.
+static const struct {
+    u8 mid;
+    u16 oid;
+    const char* pnm;
+    u32 quirks;
+} sdcard_quirks[] = {
+};
+
+// Send CMD23/ACMD23 ahead of multi-block writes. Off until the quirk table has seen
+// some real cards, turn it on from the console.
+static int sdcard_predef = 0;
+
 void sdcard_attach(sdmmc_chipset_handle_t handle)
 {
 #ifndef MINUTE_BOOT1
@@ -93,6 +118,57 @@ void sdcard_abort(void) {
     sdhc_exec_command(card.handle, &cmd);
 }
 
+static u32 _sdcard_lookup_quirks(void)
+{
+    u32 quirks = 0;
+    for (size_t i = 0; i < sizeof(sdcard_quirks) / sizeof(sdcard_quirks[0]); i++) {
+        if (sdcard_quirks[i].mid != card.cid_mid || sdcard_quirks[i].oid != card.cid_oid)
+            continue;
+        if (sdcard_quirks[i].pnm && strcmp(sdcard_quirks[i].pnm, card.cid_pnm))
+            continue;
+        quirks |= sdcard_quirks[i].quirks;
+    }
+    return quirks;
+}
+
+static void _sdcard_read_scr(void)
+{
+    struct sdmmc_command cmd;
+    // the SCR is 8 bytes, but keep the DMA target a whole cache line
+    u8 scr[32] ALIGNED(32) = {0};
+
+    card.cmd23 = 0;
+
+    DPRINTF(2, ("sdcard: MMC_APP_CMD\n"));
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.c_opcode = MMC_APP_CMD;
+    cmd.c_arg = ((u32)card.rca)<<16;
+    cmd.c_flags = SCF_RSP_R1;
+    sdhc_exec_command(card.handle, &cmd);
+    if (cmd.c_error) {
+        printf("sdcard: MMC_APP_CMD failed with %d\n", cmd.c_error);
+        return;
+    }
+
+    DPRINTF(2, ("sdcard: SD_APP_SEND_SCR\n"));
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.c_opcode = SD_APP_SEND_SCR;
+    cmd.c_data = scr;
+    cmd.c_datalen = 8;
+    cmd.c_blklen = 8;
+    cmd.c_flags = SCF_RSP_R1 | SCF_CMD_ADTC | SCF_CMD_READ;
+    sdhc_exec_command(card.handle, &cmd);
+    if (cmd.c_error) {
+        printf("sdcard: SD_APP_SEND_SCR failed with %d\n", cmd.c_error);
+        return;
+    }
+
+    card.cmd23 = !!(SD_SCR_CMD_SUPPORT(scr) & SD_SCR_CMD23_SUPPORT);
+    printf("SCR: %02X%02X%02X%02X%02X%02X%02X%02X, CMD23 %s, quirks %lx\n",
+        scr[0], scr[1], scr[2], scr[3], scr[4], scr[5], scr[6], scr[7],
+        card.cmd23 ? "supported" : "unsupported", card.quirks);
+}
+
 void sdcard_needs_discover(void)
 {
     struct sdmmc_command cmd;
@@ -156,7 +232,9 @@ void sdcard_needs_discover(void)
     card.sdhc_blockmode = 1;
     card.selected = 0;
     card.inserted = 1;
-    card.multiple_fallback = 0;
+    card.cmd23 = 0;
+    card.quirks = 0;
+    _sdcard_recovery_reset();
 
     int tries;
     for (tries = 100; tries > 0; tries--) {
@@ -221,6 +299,11 @@ void sdcard_needs_discover(void)
         resp[13],resp[12],resp[11],resp[10],resp[9],resp[8],resp[7], resp[6], resp[5] >> 4, resp[5] & 0xf,
         resp[4], resp[3], resp[2], resp[0] & 0xf, 2000 + (resp[0] >> 4));
 
+    card.cid_mid = SD_CID_MID(resp);
+    card.cid_oid = SD_CID_OID(resp);
+    SD_CID_PNM_CPY(resp, card.cid_pnm);
+    card.quirks = _sdcard_lookup_quirks();
+
     DPRINTF(2, ("sdcard: SD_SEND_RELATIVE_ADDRESS\n"));
     memset(&cmd, 0, sizeof(cmd));
     cmd.c_opcode = SD_SEND_RELATIVE_ADDR;
@@ -327,6 +410,8 @@ void sdcard_needs_discover(void)
 
     sdhc_bus_width(card.handle, 4);
 
+    _sdcard_read_scr();
+
     u16 ccc = SD_CSD_CCC(csd_bytes);
     printf("CCC (hex): %03X\n", ccc);
 
@@ -470,6 +555,401 @@ int sdcard_ack_card(void)
     return -1;
 }
 
+/*
+ * Multi-block DMA is what we want, but some cards (or card/host pairs)
+ * throw errors at it. A failing command drops to the next more conservative
+ * mode and is retried there. After `backoff' good commands the faster mode
+ * is probed again, and every failure doubles the backoff. It only goes back
+ * to the minimum after a long run without errors.
+ */
+enum {
+    SDCARD_MODE_MULTI = 0,  // multi-block DMA
+    SDCARD_MODE_SINGLE,     // single-block DMA
+    SDCARD_MODE_PIO,        // single-block PIO
+    SDCARD_MODE_COUNT
+};
+
+enum {
+    SDCARD_DIR_READ = 0,
+    SDCARD_DIR_WRITE,
+};
+
+#define SDCARD_BACKOFF_MIN      (16)
+#define SDCARD_BACKOFF_MAX      (4096)
+
+typedef struct {
+    u32 cmds;
+    u32 errors;
+    u64 blocks;
+    u64 ticks;      // LT_TIMER ticks spent on the commands
+} sdcard_mode_stats;
+
+typedef struct {
+    int mode;
+    int count;      // modes to fall back through
+    const char* const* names;
+    u32 backoff;    // good commands before the next probe
+    u32 countdown;
+    u32 streak;     // good commands since the last error
+    sdcard_mode_stats stats[SDCARD_MODE_COUNT];
+} sdcard_recovery;
+
+// Pre-declared writes fall back to open-ended ones the same way.
+enum {
+    SDCARD_PREDEF_ON = 0,
+    SDCARD_PREDEF_OFF,
+    SDCARD_PREDEF_COUNT
+};
+
+static sdcard_recovery sdcard_rec[2];
+static sdcard_recovery sdcard_predef_rec;
+static u32 sdcard_async_started;
+static int sdcard_async_predef = -1;
+
+static const char* const sdcard_mode_names[SDCARD_MODE_COUNT] = {
+    "multi-block DMA", "single-block DMA", "single-block PIO",
+};
+
+// Buffers the host can't DMA to (every buffer in boot1) go by PIO, and fall
+// back from multi-block to single-block PIO the same way.
+enum {
+    SDCARD_PIO_MULTI = 0,
+    SDCARD_PIO_SINGLE,
+    SDCARD_PIO_COUNT
+};
+
+static sdcard_recovery sdcard_pio_rec[2];
+
+static const char* const sdcard_pio_names[SDCARD_PIO_COUNT] = {
+    "multi-block PIO", "single-block PIO",
+};
+
+static const char* const sdcard_predef_names[SDCARD_PREDEF_COUNT] = {
+    "pre-declared writes", "open-ended writes",
+};
+
+static void _sdcard_recovery_init(sdcard_recovery* rec, int count, const char* const* names)
+{
+    rec->mode = 0;
+    rec->count = count;
+    rec->names = names;
+    rec->backoff = SDCARD_BACKOFF_MIN;
+    rec->countdown = 0;
+    rec->streak = 0;
+}
+
+static void _sdcard_recovery_reset(void)
+{
+    for (int d = 0; d < 2; d++) {
+        _sdcard_recovery_init(&sdcard_rec[d], SDCARD_MODE_COUNT, sdcard_mode_names);
+        _sdcard_recovery_init(&sdcard_pio_rec[d], SDCARD_PIO_COUNT, sdcard_pio_names);
+    }
+    _sdcard_recovery_init(&sdcard_predef_rec, SDCARD_PREDEF_COUNT, sdcard_predef_names);
+}
+
+// The mode for the next command, one faster than the current once the backoff ran out.
+static int _sdcard_pick_mode(const sdcard_recovery* rec)
+{
+    if (rec->mode > 0 && rec->countdown == 0)
+        return rec->mode - 1;
+    return rec->mode;
+}
+
+static void _sdcard_mode_ok(sdcard_recovery* rec, int mode)
+{
+    if (mode < rec->mode) {
+        printf("sdcard: %s works again\n", rec->names[mode]);
+        rec->mode = mode;
+    }
+    if (rec->mode > 0 && rec->countdown == 0)
+        rec->countdown = rec->backoff;
+    else if (rec->countdown)
+        rec->countdown--;
+
+    if (++rec->streak >= SDCARD_BACKOFF_MAX)
+        rec->backoff = SDCARD_BACKOFF_MIN;
+}
+
+// Returns non-zero if there is nothing left to fall back to.
+static int _sdcard_mode_failed(sdcard_recovery* rec, int mode)
+{
+    rec->streak = 0;
+    rec->backoff = min(rec->backoff * 2, SDCARD_BACKOFF_MAX);
+    rec->countdown = rec->backoff;
+
+    // a failed probe just stays where it was
+    if (mode < rec->mode) {
+        printf("sdcard: %s still failing, next try in %lu commands\n", rec->names[mode], rec->backoff);
+        return 0;
+    }
+    if (mode + 1 >= rec->count)
+        return 1;
+
+    rec->mode = mode + 1;
+    printf("sdcard: falling back to %s for %lu commands\n", rec->names[rec->mode], rec->backoff);
+    return 0;
+}
+
+// Async commands always go out as multi-block DMA, they're only counted.
+static void _sdcard_account_async(int dir, struct sdmmc_command* cmdbuf, int ok)
+{
+    int mode = SDCARD_MODE_MULTI;
+    if (!can_sdcard_dma_addr(cmdbuf->c_data))
+        mode = SDCARD_MODE_PIO;
+    else if (cmdbuf->c_datalen <= SDMMC_DEFAULT_BLOCKLEN)
+        mode = SDCARD_MODE_SINGLE;
+
+    sdcard_mode_stats* st = &sdcard_rec[dir].stats[mode];
+    st->cmds++;
+    if (!ok) {
+        st->errors++;
+        return;
+    }
+    st->blocks += cmdbuf->c_datalen / SDMMC_DEFAULT_BLOCKLEN;
+    st->ticks += read32(LT_TIMER) - sdcard_async_started;
+}
+
+// Announce a multi-block write: ACMD23 lets the card pre-erase the range, CMD23
+// lets it stop on its own. Returns the flags for the write command, `predef` is
+// what to report back to _sdcard_predef_done(), or -1 if nothing was announced.
+static int _sdcard_predeclare_write(u32 blk_count, int* predef)
+{
+    struct sdmmc_command cmd;
+    int flags = SCF_RSP_R1;
+    int sent = 0;
+
+    *predef = -1;
+    if (!sdcard_predef || blk_count < 2)
+        return flags;
+    if (!card.cmd23 && (card.quirks & SDCARD_QUIRK_NO_PRE_ERASE))
+        return flags;
+
+    *predef = _sdcard_pick_mode(&sdcard_predef_rec);
+    if (*predef == SDCARD_PREDEF_OFF)
+        return flags;
+
+    if (!(card.quirks & SDCARD_QUIRK_NO_PRE_ERASE)) {
+        DPRINTF(2, ("sdcard: SD_APP_SET_WR_BLK_ERASE_COUNT\n"));
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.c_opcode = MMC_APP_CMD;
+        cmd.c_arg = ((u32)card.rca)<<16;
+        cmd.c_flags = SCF_RSP_R1;
+        sdhc_exec_command(card.handle, &cmd);
+        if (!cmd.c_error) {
+            memset(&cmd, 0, sizeof(cmd));
+            cmd.c_opcode = SD_APP_SET_WR_BLK_ERASE_COUNT;
+            cmd.c_arg = blk_count & 0x7FFFFF;
+            cmd.c_flags = SCF_RSP_R1;
+            sdhc_exec_command(card.handle, &cmd);
+        }
+        if (cmd.c_error) {
+            printf("sdcard: SD_APP_SET_WR_BLK_ERASE_COUNT failed with %d\n", cmd.c_error);
+            goto failed;
+        }
+        sent = 1;
+    }
+
+    if (card.cmd23 && !(card.quirks & SDCARD_QUIRK_NO_CMD23)) {
+        DPRINTF(2, ("sdcard: MMC_SET_BLOCK_COUNT\n"));
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.c_opcode = MMC_SET_BLOCK_COUNT;
+        cmd.c_arg = blk_count;
+        cmd.c_flags = SCF_RSP_R1;
+        sdhc_exec_command(card.handle, &cmd);
+        if (cmd.c_error) {
+            printf("sdcard: MMC_SET_BLOCK_COUNT failed with %d\n", cmd.c_error);
+            goto failed;
+        }
+        flags |= SCF_CMD_PREDEF;
+        sent = 1;
+    }
+
+    if (!sent)
+        *predef = -1;
+    return flags;
+
+failed:
+    // the write still goes out, open-ended
+    sdcard_predef_rec.stats[SDCARD_PREDEF_ON].cmds++;
+    sdcard_predef_rec.stats[SDCARD_PREDEF_ON].errors++;
+    _sdcard_mode_failed(&sdcard_predef_rec, SDCARD_PREDEF_ON);
+    *predef = SDCARD_PREDEF_OFF;
+    return SCF_RSP_R1;
+}
+
+// Accounts a multi-block write against the pre-declared write policy. Only failures
+// of announced writes count, open-ended ones are up to the transfer modes.
+static void _sdcard_predef_done(int predef, u32 blocks, u32 ticks, int ok)
+{
+    if (predef < 0)
+        return;
+
+    sdcard_mode_stats* st = &sdcard_predef_rec.stats[predef];
+    st->cmds++;
+    if (!ok) {
+        st->errors++;
+        if (predef == SDCARD_PREDEF_ON)
+            _sdcard_mode_failed(&sdcard_predef_rec, predef);
+        return;
+    }
+    st->blocks += blocks;
+    st->ticks += ticks;
+    _sdcard_mode_ok(&sdcard_predef_rec, predef);
+}
+
+void sdcard_set_predef(int enable)
+{
+    sdcard_predef = enable;
+}
+
+int sdcard_get_predef(void)
+{
+    return sdcard_predef;
+}
+
+#ifndef MINUTE_BOOT1
+static void _sdcard_print_recovery(const char* name, const sdcard_recovery* rec)
+{
+    printf("SD %s: %s, backoff %lu\n", name, rec->names[rec->mode], rec->backoff);
+
+    for (int m = 0; m < rec->count; m++) {
+        const sdcard_mode_stats* st = &rec->stats[m];
+        if (!st->cmds)
+            continue;
+        // LT_TIMER runs at ~1.9MHz, see udelay()
+        u64 ms = st->ticks / 1900;
+        if (!ms) ms = 1;
+        u32 rate = st->blocks * SDMMC_DEFAULT_BLOCKLEN / ms / 10; // 1/100 MB/s
+        printf("  %s: %lu cmds, %lu errors, %llu blocks, %lu.%02lu MB/s\n", rec->names[m],
+               st->cmds, st->errors, st->blocks, rate / 100, rate % 100);
+    }
+}
+
+void sdcard_print_stats(void)
+{
+    _sdcard_print_recovery("read", &sdcard_rec[SDCARD_DIR_READ]);
+    _sdcard_print_recovery("write", &sdcard_rec[SDCARD_DIR_WRITE]);
+    _sdcard_print_recovery("PIO read", &sdcard_pio_rec[SDCARD_DIR_READ]);
+    _sdcard_print_recovery("PIO write", &sdcard_pio_rec[SDCARD_DIR_WRITE]);
+
+    printf("SD pre-declared writes %s, CMD23 %s, pre-erase %s\n", sdcard_predef ? "on" : "off",
+           card.cmd23 && !(card.quirks & SDCARD_QUIRK_NO_CMD23) ? "yes" : "no",
+           card.quirks & SDCARD_QUIRK_NO_PRE_ERASE ? "no" : "yes");
+    if (sdcard_predef)
+        _sdcard_print_recovery("multi-block writes", &sdcard_predef_rec);
+}
+
+void sdcard_reset_stats(void)
+{
+    for (int d = 0; d < 2; d++) {
+        memset(sdcard_rec[d].stats, 0, sizeof(sdcard_rec[d].stats));
+        memset(sdcard_pio_rec[d].stats, 0, sizeof(sdcard_pio_rec[d].stats));
+    }
+    memset(sdcard_predef_rec.stats, 0, sizeof(sdcard_predef_rec.stats));
+}
+#endif
+
+static int _sdcard_transfer(int dir, u32 blk_start, u32 blk_count, void *data)
+{
+    const char* name = dir == SDCARD_DIR_WRITE ? "WRITE" : "READ";
+    sdcard_recovery* rec = &sdcard_rec[dir];
+    struct sdmmc_command cmd;
+
+//  printf("%s(%u, %u, %p)\n", __FUNCTION__, blk_start, blk_count, data);
+    if (card.inserted == 0) {
+        printf("sdcard: %s: no card inserted.\n", name);
+        return -1;
+    }
+
+    if (card.selected == 0) {
+        if (sdcard_select() < 0) {
+            printf("sdcard: %s: cannot select card.\n", name);
+            return -1;
+        }
+    }
+
+    if (card.new_card == 1) {
+        printf("sdcard: new card inserted but not acknowledged yet.\n");
+        return -1;
+    }
+
+    while(blk_count){
+        int forced = !can_sdcard_dma_addr(data);
+        sdcard_recovery* r = forced ? &sdcard_pio_rec[dir] : rec;
+        int mode = _sdcard_pick_mode(r);
+        int multi = forced ? mode == SDCARD_PIO_MULTI : mode == SDCARD_MODE_MULTI;
+        u32 max_blk = forced ? SDHC_CMD_BLOCK_COUNT_MAX : sdhc_max_block_count(card.handle);
+        u32 cmd_blk_count = multi ? min(blk_count, max_blk) : 1;
+        const char* kind = cmd_blk_count > 1 ? "MULTIPLE" : "SINGLE";
+        int predef = -1;
+        memset(&cmd, 0, sizeof(cmd));
+
+        if (dir == SDCARD_DIR_WRITE) {
+            DPRINTF(2, ("sdcard: MMC_WRITE_BLOCK_%s\n", kind));
+            cmd.c_opcode = cmd_blk_count > 1 ? MMC_WRITE_BLOCK_MULTIPLE : MMC_WRITE_BLOCK_SINGLE;
+            cmd.c_flags = _sdcard_predeclare_write(cmd_blk_count, &predef);
+        } else {
+            DPRINTF(2, ("sdcard: MMC_READ_BLOCK_%s\n", kind));
+            cmd.c_opcode = cmd_blk_count > 1 ? MMC_READ_BLOCK_MULTIPLE : MMC_READ_BLOCK_SINGLE;
+            cmd.c_flags = SCF_RSP_R1 | SCF_CMD_READ;
+        }
+        if (card.sdhc_blockmode)
+            cmd.c_arg = blk_start;
+        else
+            cmd.c_arg = blk_start * SDMMC_DEFAULT_BLOCKLEN;
+        cmd.c_data = data;
+        cmd.c_datalen = cmd_blk_count * SDMMC_DEFAULT_BLOCKLEN;
+        cmd.c_blklen = SDMMC_DEFAULT_BLOCKLEN;
+
+        u32 started = read32(LT_TIMER);
+        sdcard_host.no_dma = forced || mode == SDCARD_MODE_PIO;
+        sdhc_exec_command(card.handle, &cmd);
+        sdcard_host.no_dma = 0;
+
+        sdcard_mode_stats* st = &r->stats[mode];
+        st->cmds++;
+
+        if (cmd.c_error) {
+            st->errors++;
+            printf("sdcard: MMC_%s_BLOCK_%s failed with %d\n", name, kind, cmd.c_error);
+            if (cmd.c_error == SDHC_EADMA) {
+                printf("sdcard: retrying with SDMA\n");
+                continue;
+            }
+            // an announced write gets retried open-ended while the backoff runs
+            _sdcard_predef_done(predef, 0, 0, 0);
+            if (predef == SDCARD_PREDEF_ON)
+                continue;
+            if (_sdcard_mode_failed(r, mode))
+                return -1;
+            continue;
+        }
+    #ifdef MINUTE_BOOT1 //on boot1 we get somehow ILLEGAL COMMAND (bit 22)
+        else if(dir == SDCARD_DIR_WRITE && (MMC_R1(cmd.c_resp) & MMC_R1_ANY_ERROR)){
+    #else
+        else if(MMC_R1(cmd.c_resp) & MMC_R1_ANY_ERROR){
+    #endif
+            st->errors++;
+            _sdcard_predef_done(predef, 0, 0, 0);
+            printf("sdcard: %s reported error. status: %08lx\n", dir == SDCARD_DIR_WRITE ? "write" : "read", MMC_R1(cmd.c_resp));
+            return -2;
+        }
+
+        u32 ticks = read32(LT_TIMER) - started;
+        st->blocks += cmd_blk_count;
+        st->ticks += ticks;
+        _sdcard_predef_done(predef, cmd_blk_count, ticks, 1);
+        _sdcard_mode_ok(r, mode);
+        DPRINTF(2, ("sdcard: MMC_%s_BLOCK_%s done\n", name, kind));
+
+        blk_count -= cmd_blk_count;
+        blk_start += cmd_blk_count;
+        data += cmd.c_datalen;
+    }
+
+    return 0;
+}
+
 int sdcard_start_read(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf)
 {
 //  printf("%s(%u, %u, %p)\n", __FUNCTION__, blk_start, blk_count, data);
@@ -507,10 +987,12 @@ int sdcard_start_read(u32 blk_start, u32 blk_count, void *data, struct sdmmc_com
     cmdbuf->c_datalen = blk_count * SDMMC_DEFAULT_BLOCKLEN;
     cmdbuf->c_blklen = SDMMC_DEFAULT_BLOCKLEN;
     cmdbuf->c_flags = SCF_RSP_R1 | SCF_CMD_READ;
+    sdcard_async_started = read32(LT_TIMER);
     sdhc_async_command(card.handle, cmdbuf);
 
     if (cmdbuf->c_error) {
         printf("sdcard: MMC_READ_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmdbuf->c_error);
+        _sdcard_account_async(SDCARD_DIR_READ, cmdbuf, 0);
         return -1;
     }
     if(blk_count > 1)
@@ -521,6 +1003,14 @@ int sdcard_start_read(u32 blk_start, u32 blk_count, void *data, struct sdmmc_com
     return 0;
 }
 
+int sdcard_poll(struct sdmmc_command* cmdbuf)
+{
+    if (card.inserted == 0)
+        return 1;
+
+    return sdhc_async_ready(card.handle, cmdbuf);
+}
+
 int sdcard_end_read(struct sdmmc_command* cmdbuf)
 {
 //  printf("%s(%u, %u, %p)\n", __FUNCTION__, blk_start, blk_count, data);
@@ -545,11 +1035,14 @@ int sdcard_end_read(struct sdmmc_command* cmdbuf)
 
     if (cmdbuf->c_error) {
         printf("sdcard: MMC_READ_BLOCK_%s failed with %d\n", cmdbuf->c_opcode == MMC_READ_BLOCK_MULTIPLE ? "MULTIPLE" : "SINGLE", cmdbuf->c_error);
+        _sdcard_account_async(SDCARD_DIR_READ, cmdbuf, 0);
         return -1;
     } else if(MMC_R1(cmdbuf->c_resp) & MMC_R1_ANY_ERROR){
         printf("sdcard: read reported error. status: %08lx\n", MMC_R1(cmdbuf->c_resp));
+        _sdcard_account_async(SDCARD_DIR_READ, cmdbuf, 0);
         return -2;
     }
+    _sdcard_account_async(SDCARD_DIR_READ, cmdbuf, 1);
     if(cmdbuf->c_opcode == MMC_READ_BLOCK_MULTIPLE)
         DPRINTF(2, ("sdcard: async MMC_READ_BLOCK_MULTIPLE finished\n"));
     else
@@ -560,94 +1053,7 @@ int sdcard_end_read(struct sdmmc_command* cmdbuf)
 
 int sdcard_read(u32 blk_start, u32 blk_count, void *data)
 {
-    struct sdmmc_command cmd;
-
-retry_single:
-    // TODO: wtf is this bug
-    if ((!can_sdcard_dma_addr(data) || card.multiple_fallback) && blk_count > 1) { // 
-        int ret = 0;
-        for (int i = 0; i < blk_count; i++)
-        {
-            ret = sdcard_read(blk_start + i, 1, data);
-            if (ret) return ret;
-            data = (void*)((intptr_t)data + SDMMC_DEFAULT_BLOCKLEN);
-        }
-        return ret;
-    }
-
-//  printf("%s(%u, %u, %p)\n", __FUNCTION__, blk_start, blk_count, data);
-    if (card.inserted == 0) 
-    {
-        printf("sdcard: READ: no card inserted.\n");
-        //gpio_debug_send(0xAA);
-        return -1;
-    }
-
-    if (card.selected == 0) {
-        if (sdcard_select() < 0) {
-            printf("sdcard: READ: cannot select card.\n");
-            return -1;
-        }
-    }
-
-    if (card.new_card == 1) {
-        printf("sdcard: new card inserted but not acknowledged yet.\n");
-        return -1;
-    }
-
-    while(blk_count){
-        u32 cmd_blk_count = min(blk_count, SDHC_BLOCK_COUNT_MAX);
-        memset(&cmd, 0, sizeof(cmd));
-
-        if(blk_count > 1) {
-            DPRINTF(2, ("sdcard: MMC_READ_BLOCK_MULTIPLE\n"));
-            cmd.c_opcode = MMC_READ_BLOCK_MULTIPLE;
-        } else {
-            DPRINTF(2, ("sdcard: MMC_READ_BLOCK_SINGLE\n"));
-            cmd.c_opcode = MMC_READ_BLOCK_SINGLE;
-        }
-        if (card.sdhc_blockmode)
-            cmd.c_arg = blk_start;
-        else
-            cmd.c_arg = blk_start * SDMMC_DEFAULT_BLOCKLEN;
-        cmd.c_data = data;
-        cmd.c_datalen = cmd_blk_count * SDMMC_DEFAULT_BLOCKLEN;
-        cmd.c_blklen = SDMMC_DEFAULT_BLOCKLEN;
-        cmd.c_flags = SCF_RSP_R1 | SCF_CMD_READ;
-        sdhc_exec_command(card.handle, &cmd);
-
-        if (cmd.c_error) {
-            printf("sdcard: MMC_READ_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmd.c_error);
-            if (blk_count > 1 && !card.multiple_fallback) {
-                printf("sdcard: trying only single blocks?\n");
-                card.multiple_fallback = 1;
-                goto retry_single; 
-            }
-            else if (blk_count <= 1 && !sdcard_host.no_dma) {
-                printf("sdcard: trying without DMA?\n");
-                sdcard_host.no_dma = 1;
-                goto retry_single;
-            }
-            return -1;
-        } 
-    #ifndef MINUTE_BOOT1 //on boot1 we get somehow ILLEGAL COMMAND (bit 22)
-        else if(MMC_R1(cmd.c_resp) & MMC_R1_ANY_ERROR){
-            printf("sdcard: read reported error. status: %08lx\n", MMC_R1(cmd.c_resp));
-            return -2;
-        }
-    #endif
-
-        if(blk_count > 1)
-            DPRINTF(2, ("sdcard: MMC_READ_BLOCK_MULTIPLE done\n"));
-        else
-            DPRINTF(2, ("sdcard: MMC_READ_BLOCK_SINGLE done\n"));
-
-        blk_count -= cmd_blk_count;
-        blk_start += cmd_blk_count;
-        data += cmd.c_datalen;
-    }
-
-    return 0;
+    return _sdcard_transfer(SDCARD_DIR_READ, blk_start, blk_count, data);
 }
 
 #ifndef LOADER
@@ -686,11 +1092,14 @@ int sdcard_start_write(u32 blk_start, u32 blk_count, void *data, struct sdmmc_co
     cmdbuf->c_data = data;
     cmdbuf->c_datalen = blk_count * SDMMC_DEFAULT_BLOCKLEN;
     cmdbuf->c_blklen = SDMMC_DEFAULT_BLOCKLEN;
-    cmdbuf->c_flags = SCF_RSP_R1;
+    cmdbuf->c_flags = _sdcard_predeclare_write(blk_count, &sdcard_async_predef);
+    sdcard_async_started = read32(LT_TIMER);
     sdhc_async_command(card.handle, cmdbuf);
 
     if (cmdbuf->c_error) {
         printf("sdcard: MMC_WRITE_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmdbuf->c_error);
+        _sdcard_predef_done(sdcard_async_predef, 0, 0, 0);
+        _sdcard_account_async(SDCARD_DIR_WRITE, cmdbuf, 0);
         return -1;
     }
     if(blk_count > 1)
@@ -724,11 +1133,18 @@ int sdcard_end_write(struct sdmmc_command* cmdbuf)
 
     if (cmdbuf->c_error) {
         printf("sdcard: MMC_WRITE_BLOCK_%s failed with %d\n", cmdbuf->c_opcode == MMC_WRITE_BLOCK_MULTIPLE ? "MULTIPLE" : "SINGLE", cmdbuf->c_error);
+        _sdcard_predef_done(sdcard_async_predef, 0, 0, 0);
+        _sdcard_account_async(SDCARD_DIR_WRITE, cmdbuf, 0);
         return -1;
     } else if(MMC_R1(cmdbuf->c_resp) & MMC_R1_ANY_ERROR){
         printf("sdcard: write reported error. status: %08lx\n", MMC_R1(cmdbuf->c_resp));
+        _sdcard_predef_done(sdcard_async_predef, 0, 0, 0);
+        _sdcard_account_async(SDCARD_DIR_WRITE, cmdbuf, 0);
         return -2;
     }
+    _sdcard_predef_done(sdcard_async_predef, cmdbuf->c_datalen / SDMMC_DEFAULT_BLOCKLEN,
+                        read32(LT_TIMER) - sdcard_async_started, 1);
+    _sdcard_account_async(SDCARD_DIR_WRITE, cmdbuf, 1);
     if(cmdbuf->c_opcode == MMC_WRITE_BLOCK_MULTIPLE)
         DPRINTF(2, ("sdcard: async MMC_WRITE_BLOCK_MULTIPLE finished\n"));
     else
@@ -739,91 +1155,7 @@ int sdcard_end_write(struct sdmmc_command* cmdbuf)
 
 int sdcard_write(u32 blk_start, u32 blk_count, void *data)
 {
-    struct sdmmc_command cmd;
-
-    if (sdcard_host.no_dma) {
-        panic(0);
-    }
-
-retry_single:
-    // TODO: wtf is this bug
-    if ((!can_sdcard_dma_addr(data) || card.multiple_fallback) && blk_count > 1) { // !can_sdcard_dma_addr(data) && 
-        int ret = 0;
-        for (int i = 0; i < blk_count; i++)
-        {
-            ret = sdcard_write(blk_start + i, 1, data);
-            if (ret) return ret;
-            data = (void*)((intptr_t)data + SDMMC_DEFAULT_BLOCKLEN);
-        }
-        return ret;
-    }
-
-    if (card.inserted == 0) {
-        printf("sdcard: WRITE: no card inserted.\n");
-        return -1;
-    }
-
-    if (card.selected == 0) {
-        if (sdcard_select() < 0) {
-            printf("sdcard: WRITE: cannot select card.\n");
-            return -1;
-        }
-    }
-
-    if (card.new_card == 1) {
-        printf("sdcard: new card inserted but not acknowledged yet.\n");
-        return -1;
-    }
-
-    while(blk_count){
-        u32 cmd_blk_count = min(blk_count, SDHC_BLOCK_COUNT_MAX);
-        memset(&cmd, 0, sizeof(cmd));
-
-        if(blk_count > 1) {
-            DPRINTF(2, ("sdcard: MMC_WRITE_BLOCK_MULTIPLE\n"));
-            cmd.c_opcode = MMC_WRITE_BLOCK_MULTIPLE;
-        } else {
-            DPRINTF(2, ("sdcard: MMC_WRITE_BLOCK_SINGLE\n"));
-            cmd.c_opcode = MMC_WRITE_BLOCK_SINGLE;
-        }
-        if (card.sdhc_blockmode)
-            cmd.c_arg = blk_start;
-        else
-            cmd.c_arg = blk_start * SDMMC_DEFAULT_BLOCKLEN;
-        cmd.c_data = data;
-        cmd.c_datalen = cmd_blk_count * SDMMC_DEFAULT_BLOCKLEN;
-        cmd.c_blklen = SDMMC_DEFAULT_BLOCKLEN;
-        cmd.c_flags = SCF_RSP_R1;
-        sdhc_exec_command(card.handle, &cmd);
-
-        if (cmd.c_error) {
-            printf("sdcard: MMC_WRITE_BLOCK_%s failed with %d\n", blk_count > 1 ? "MULTIPLE" : "SINGLE", cmd.c_error);
-            if (blk_count > 1 && !card.multiple_fallback) {
-                printf("sdcard: trying only single blocks?\n");
-                card.multiple_fallback = 1;
-                goto retry_single; 
-            }
-            else if (blk_count <= 1 && !sdcard_host.no_dma) {
-                printf("sdcard: trying without DMA?\n");
-                sdcard_host.no_dma = 1;
-                goto retry_single;
-            }
-            return -1;
-        } else if(MMC_R1(cmd.c_resp) & MMC_R1_ANY_ERROR){
-            printf("sdcard: write reported error. status: %08lx\n", MMC_R1(cmd.c_resp));
-            return -2;
-        } 
-        if(blk_count > 1)
-            DPRINTF(2, ("sdcard: MMC_WRITE_BLOCK_MULTIPLE done\n"));
-        else
-            DPRINTF(2, ("sdcard: MMC_WRITE_BLOCK_SINGLE done\n"));
-
-        blk_count -= cmd_blk_count;
-        blk_start += cmd_blk_count;
-        data += cmd.c_datalen;
-    }
-
-    return 0;
+    return _sdcard_transfer(SDCARD_DIR_WRITE, blk_start, blk_count, data);
 }
 
 int sdcard_wait_data(void)
@@ -877,6 +1209,11 @@ void sdcard_init(void)
         .abort = &sdcard_abort,
         .rb = RB_SD0,
         .wb = WB_SD0,
+#ifdef CAN_HAZ_IRQ
+        .irq_mask_reg = LT_INTMR_AHBALL_ARM,
+        .irq_status_reg = LT_INTSR_AHBALL_ARM,
+        .irq_flag = IRQF_SD0,
+#endif
     };
 
 #ifdef CAN_HAZ_IRQ
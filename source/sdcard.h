@@ -38,4 +38,12 @@ int sdcard_end_read(struct sdmmc_command* cmdbuf);
 int sdcard_start_write(u32 blk_start, u32 blk_count, void *data, struct sdmmc_command* cmdbuf);
 int sdcard_end_write(struct sdmmc_command* cmdbuf);
 
+int sdcard_poll(struct sdmmc_command* cmdbuf);
+
+void sdcard_set_predef(int enable);
+int sdcard_get_predef(void);
+
+void sdcard_print_stats(void);
+void sdcard_reset_stats(void);
+
 #endif
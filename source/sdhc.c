@@ -28,9 +28,11 @@
 #include "memory.h"
 #include "utils.h"
 #include "gpio.h"
+#include <malloc.h>
 
 #ifdef CAN_HAZ_IRQ
 #include "irq.h"
+#include "latte.h"
 #endif
 
 //#define SDHC_DEBUG
@@ -95,6 +97,12 @@ static inline void bus_space_write_1(bus_space_handle_t ioh, u32 r, u8 v)
 
 /* flag values */
 #define SHF_USE_DMA     0x0001
+#define SHF_USE_ADMA2   0x0002
+
+/* transfer types, picked per command by sdhc_select_xfer() */
+#define SDHC_XFER_PIO   0
+#define SDHC_XFER_SDMA  1
+#define SDHC_XFER_ADMA2 2
 
 #define HREAD1(hp, reg)                         \
     (bus_space_read_1((hp)->ioh, (reg)))
@@ -164,6 +172,8 @@ sdhc_host_found(struct sdhc_host *hp, struct sdhc_host_params *pa, bus_space_tag
     }
 #endif
 
+    /* keep the descriptor table across re-attaches */
+    struct sdhc_adma2_desc *adma_table = hp->adma_table;
     memset(hp, 0, sizeof(struct sdhc_host));
 
     /* Fill in the new host structure. */
@@ -183,6 +193,20 @@ sdhc_host_found(struct sdhc_host *hp, struct sdhc_host_params *pa, bus_space_tag
     if (usedma && ISSET(caps, SDHC_DMA_SUPPORT))
         SET(hp->flags, SHF_USE_DMA);
 
+#ifndef MINUTE_BOOT1
+    /* ADMA2 lets one command cover more memory than SDMA. */
+    if (ISSET(hp->flags, SHF_USE_DMA) && ISSET(caps, SDHC_ADMA2_SUPPORT) &&
+        SDHC_SPEC_VERSION(hp->version) >= SDHC_SPEC_V2) {
+        if (!adma_table)
+            adma_table = memalign(32, SDHC_ADMA2_MAX_DESC * sizeof(struct sdhc_adma2_desc));
+        hp->adma_table = adma_table;
+        if (hp->adma_table)
+            SET(hp->flags, SHF_USE_ADMA2);
+    }
+#else
+    (void)adma_table;
+#endif
+
     /*
      * Determine the base clock frequency. (2.2.24)
      */
@@ -617,6 +641,32 @@ sdhc_async_response(struct sdhc_host *hp, struct sdmmc_command *cmd)
     hp->data_command = 0;
 }
 
+/*
+ * Non-blocking check whether an async command has progressed far enough
+ * for sdhc_async_response() to finish it without waiting on the card.
+ */
+int
+sdhc_async_ready(struct sdhc_host *hp, struct sdmmc_command *cmd)
+{
+    int done = SDHC_ERROR_INTERRUPT | SDHC_ERROR_TIMEOUT;
+
+    if (ISSET(cmd->c_flags, SCF_ITSDONE))
+        return 1;
+
+#ifdef CAN_HAZ_IRQ
+    if((get_cpsr() & 0b11111) == 0b10010 || (get_cpsr() & 0b11111) == 0b11111)
+#endif
+        sdhc_intr(hp);
+
+    /* PIO transfers only move data inside sdhc_async_response() */
+    if (cmd->c_datalen > 0 && cmd->c_xfer != SDHC_XFER_PIO)
+        done |= SDHC_TRANSFER_COMPLETE;
+    else
+        done |= SDHC_COMMAND_COMPLETE;
+
+    return ISSET(hp->intr_status, done) ? 1 : 0;
+}
+
 void
 sdhc_exec_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
 {
@@ -633,6 +683,98 @@ sdhc_exec_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
 #endif
 }
 
+static inline u_int16_t
+sdhc_le16(u_int16_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return (v >> 8) | (v << 8);
+#else
+    return v;
+#endif
+}
+
+static inline u_int32_t
+sdhc_le32(u_int32_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(v);
+#else
+    return v;
+#endif
+}
+
+/*
+ * Fill `table' with transfer descriptors for `len' bytes at `data', split
+ * into pieces one descriptor can hold. Doesn't touch the hardware.
+ * Returns the number of descriptors used, or < 0 if the buffer can't be
+ * described (misaligned or not enough descriptors).
+ */
+int
+sdhc_adma2_build(struct sdhc_adma2_desc *table, int max, void *data, u_int32_t len)
+{
+    u_int32_t addr = (u_int32_t)(uintptr_t)data;
+    int n = 0;
+
+    /* 32-bit ADMA2 needs 4 byte aligned addresses and lengths (1.13.3) */
+    if (!len || (addr & 3) || (len & 3))
+        return -1;
+
+    while (len) {
+        u_int32_t step = MIN(len, SDHC_ADMA2_DESC_MAX_LEN);
+        if (n >= max)
+            return -2;
+
+        table[n].attr = sdhc_le16(SDHC_ADMA2_VALID | SDHC_ADMA2_ACT_TRAN);
+        table[n].len = sdhc_le16(step);
+        table[n].addr = sdhc_le32(addr);
+        addr += step;
+        len -= step;
+        n++;
+    }
+
+    table[n - 1].attr |= sdhc_le16(SDHC_ADMA2_END);
+    return n;
+}
+
+/*
+ * ADMA2 if the host has it and the buffer can be described, then SDMA for
+ * a DMA-reachable buffer, PIO otherwise. Builds the descriptor table for
+ * ADMA2 and returns the number of descriptors in `ndesc'.
+ */
+static int
+sdhc_select_xfer(struct sdhc_host *hp, struct sdmmc_command *cmd, int *ndesc)
+{
+    if (cmd->c_datalen <= 0 || hp->no_dma || !ISSET(hp->flags, SHF_USE_DMA))
+        return SDHC_XFER_PIO;
+
+    if (!can_sdcard_dma_addr(cmd->c_data))
+        return SDHC_XFER_PIO;
+
+#ifndef MINUTE_BOOT1
+    /* whole cache lines only, or invalidating would clobber the neighbours */
+    if (ISSET(hp->flags, SHF_USE_ADMA2) && !(cmd->c_datalen & 0x1F)) {
+        *ndesc = sdhc_adma2_build(hp->adma_table, SDHC_ADMA2_MAX_DESC, cmd->c_data, cmd->c_datalen);
+        if (*ndesc > 0)
+            return SDHC_XFER_ADMA2;
+    }
+#endif
+
+    return SDHC_XFER_SDMA;
+}
+
+/*
+ * Largest block count a caller should put into one command, callers doing
+ * their own chunking check this again for every chunk since the host may
+ * fall back from ADMA2.
+ */
+u_int32_t
+sdhc_max_block_count(struct sdhc_host *hp)
+{
+    if (ISSET(hp->flags, SHF_USE_ADMA2) && ISSET(hp->flags, SHF_USE_DMA) && !hp->no_dma)
+        return SDHC_ADMA_BLOCK_COUNT_MAX;
+    return SDHC_CMD_BLOCK_COUNT_MAX;
+}
+
 int
 sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
 {
@@ -641,6 +783,7 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
     u_int16_t mode;
     u_int16_t command;
     int error;
+    int ndesc = 0;
 
     DPRINTF(1,("sdhc: start cmd %u arg=%#x data=%p dlen=%d flags=%#x\n",
         cmd->c_opcode, cmd->c_arg, cmd->c_data, cmd->c_datalen, cmd->c_flags));
@@ -661,8 +804,10 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
         }
     }
 
+    cmd->c_xfer = sdhc_select_xfer(hp, cmd, &ndesc);
+
     /* Check limit imposed by 9-bit block count. (1.7.2) */
-    if (blkcount > SDHC_BLOCK_COUNT_MAX) {
+    if (blkcount > (cmd->c_xfer == SDHC_XFER_ADMA2 ? SDHC_ADMA_BLOCK_COUNT_MAX : SDHC_CMD_BLOCK_COUNT_MAX)) {
         printf("sdhc: too much data\n");
         return EINVAL;
     }
@@ -676,10 +821,12 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
         if (blkcount > 1) {
             mode |= SDHC_MULTI_BLOCK_MODE;
             /* XXX only for memory commands? */
-            mode |= SDHC_AUTO_CMD12_ENABLE;
+            /* the card stops by itself after a CMD23 */
+            if (!ISSET(cmd->c_flags, SCF_CMD_PREDEF))
+                mode |= SDHC_AUTO_CMD12_ENABLE;
         }
     }
-    if (!hp->no_dma && can_sdcard_dma_addr(cmd->c_data) && ISSET(hp->flags, SHF_USE_DMA))
+    if (cmd->c_xfer != SDHC_XFER_PIO)
         mode |= SDHC_DMA_ENABLE;
 
     /*
@@ -718,9 +865,20 @@ sdhc_start_command(struct sdhc_host *hp, struct sdmmc_command *cmd)
             dc_invalidaterange(cmd->c_data, cmd->c_datalen);
         } else {
             dc_flushrange(cmd->c_data, cmd->c_datalen);
+        }
+
+        if (cmd->c_xfer == SDHC_XFER_ADMA2) {
+            dc_flushrange(hp->adma_table, ndesc * sizeof(struct sdhc_adma2_desc));
             ahb_flush_to(hp->pa.rb);
+            HWRITE1(hp, SDHC_HOST_CTL, (HREAD1(hp, SDHC_HOST_CTL) & ~SDHC_DMA_SELECT_MASK) | SDHC_DMA_SELECT_ADMA2);
+            HWRITE4(hp, SDHC_ADMA_SYSTEM_ADDR, (u32)hp->adma_table);
+        } else {
+            if (!ISSET(cmd->c_flags, SCF_CMD_READ))
+                ahb_flush_to(hp->pa.rb);
+            if (hp->adma_table)
+                HCLR1(hp, SDHC_HOST_CTL, SDHC_DMA_SELECT_MASK);
+            HWRITE4(hp, SDHC_DMA_ADDR, (u32)cmd->c_data);
         }
-        HWRITE4(hp, SDHC_DMA_ADDR, (u32)cmd->c_data);
     }
 
     DPRINTF(1,("sdhc: cmd=%#x mode=%#x blksize=%d blkcount=%d\n",
@@ -749,17 +907,27 @@ sdhc_transfer_data(struct sdhc_host *hp, struct sdmmc_command *cmd)
     error = 0;
 
     DPRINTF(1,("resp=%#x datalen=%d\n", MMC_R1(cmd->c_resp), cmd->c_datalen));
-    if (!hp->no_dma && can_sdcard_dma_addr(cmd->c_data) && ISSET(hp->flags, SHF_USE_DMA)) {
+    if (cmd->c_xfer != SDHC_XFER_PIO) {
         for(;;) {
             status = sdhc_wait_intr(hp, SDHC_TRANSFER_COMPLETE |
                     SDHC_DMA_INTERRUPT,
                     SDHC_TRANSFER_TIMEOUT);
-            if (!status) {
+            /* a timeout comes back as SDHC_ERROR_TIMEOUT, never as 0 */
+            if (!status || ISSET(status, SDHC_ERROR_TIMEOUT)) {
                 printf("DMA timeout? %08x %08x %04x\n", status, *(u32*)cmd->c_data, HREAD2(hp, SDHC_BLOCK_COUNT));
                 error = ETIMEDOUT;
                 break;
             }
 
+            if (ISSET(status, SDHC_ERROR_INTERRUPT)) {
+                /* the host already dropped ADMA2 if that's what failed */
+                if (cmd->c_xfer == SDHC_XFER_ADMA2 && !ISSET(hp->flags, SHF_USE_ADMA2))
+                    error = SDHC_EADMA;
+                else
+                    error = EIO;
+                break;
+            }
+
             if (ISSET(status, SDHC_TRANSFER_COMPLETE)) {
 //              printf("got a TRANSFER_COMPLETE: %08x\n", status);
                 break;
@@ -840,6 +1008,30 @@ sdhc_soft_reset(struct sdhc_host *hp, int mask)
     return (0);
 }
 
+#ifdef CAN_HAZ_IRQ
+/* Only sleep if the host's interrupt is going to wake us up again. */
+static int
+sdhc_irq_armed(struct sdhc_host *hp)
+{
+    if (!hp->pa.irq_mask_reg || !(read32(hp->pa.irq_mask_reg) & hp->pa.irq_flag))
+        return 0;
+    return HREAD2(hp, SDHC_NINTR_SIGNAL_EN) != 0;
+}
+
+/*
+ * Service the host with IRQs off. The handler never runs while a command
+ * is executed with IRQs killed, so the latch is cleared here as well or the
+ * next irq_wait() would return straight away.
+ */
+static void
+sdhc_poll_intr(struct sdhc_host *hp)
+{
+    sdhc_intr(hp);
+    if (hp->pa.irq_status_reg)
+        write32(hp->pa.irq_status_reg, hp->pa.irq_flag);
+}
+#endif
+
 int
 sdhc_wait_intr_debug(const char *funcname, int line, struct sdhc_host *hp, int mask, int timo)
 {
@@ -853,13 +1045,44 @@ sdhc_wait_intr_debug(const char *funcname, int line, struct sdhc_host *hp, int m
 
     status = hp->intr_status & mask;
 
+#ifdef CAN_HAZ_IRQ
+    /*
+     * Sleep until the host interrupts instead of spinning. The alarm wakes
+     * us up at the deadline in case the host never does. `timo' is in ms.
+     */
+    u32 start = read32(LT_TIMER);
+    u32 limit = IRQ_ALARM_MS2REG(timo);
+
+    irq_set_alarm(timo, 1);
+    irq_enable(IRQ_TIMER);
+
+    for (;;) {
+        u32 cookie = irq_kill();
+        sdhc_poll_intr(hp);
+
+        if (hp->intr_status != 0) {
+            status = hp->intr_status & mask;
+            irq_restore(cookie);
+            break;
+        }
+        if (read32(LT_TIMER) - start >= limit) {
+            timo = 0;
+            irq_restore(cookie);
+            break;
+        }
+
+        if (sdhc_irq_armed(hp))
+            irq_wait();
+        irq_restore(cookie);
+    }
+
+    irq_disable(IRQ_TIMER);
+    irq_set_alarm(0, 0);
+#else
     for (; timo > 0; timo--) {
         for (int j = 0; j < 1000; j++)
         {
-#ifdef CAN_HAZ_IRQ
-            if((get_cpsr() & 0b11111) == 0b10010 || (get_cpsr() & 0b11111) == 0b11111)
-#endif
-                sdhc_intr(hp); // seems backwards but ok
+            sdhc_intr(hp); // seems backwards but ok
 
             if (hp->intr_status != 0) {
                 status = hp->intr_status & mask;
@@ -870,6 +1093,7 @@ sdhc_wait_intr_debug(const char *funcname, int line, struct sdhc_host *hp, int m
         }
     }
 breakout:
+#endif
 
     if (timo == 0) {
         status |= SDHC_ERROR_TIMEOUT;
@@ -931,6 +1155,13 @@ sdhc_intr(struct sdhc_host *hp)
 
     /* Service error interrupts. */
     if (ISSET(status, SDHC_ERROR_INTERRUPT)) {
+        /* The reset clears the ADMA error state, report it first. */
+        if (ISSET(error, SDHC_ADMA_ERROR)) {
+            printf("sdhc: ADMA2 error 0x%x at 0x%08lx, falling back to SDMA\n",
+                HREAD1(hp, SDHC_ADMA_ERROR_STATUS), HREAD4(hp, SDHC_ADMA_SYSTEM_ADDR));
+            hp->flags &= ~SHF_USE_ADMA2;
+        }
+
         /* Acknowledge error interrupts. */
         HWRITE2(hp, SDHC_EINTR_SIGNAL_EN, 0);
         (void)sdhc_soft_reset(hp, SDHC_RESET_DAT|SDHC_RESET_CMD);
@@ -943,11 +1174,9 @@ sdhc_intr(struct sdhc_host *hp)
 
         DPRINTF(2,("sdhc: error interrupt, status=0x%x, signal=0x%x\n", error, signal));
 
-        if (ISSET(error, SDHC_CMD_TIMEOUT_ERROR|
-            SDHC_DATA_TIMEOUT_ERROR)) {
-            hp->intr_error_status |= error;
-            hp->intr_status |= status;
-        }
+        /* Every error wakes the waiter, a sleeping one wouldn't notice otherwise. */
+        hp->intr_error_status |= error;
+        hp->intr_status |= status;
     }
 
     /*
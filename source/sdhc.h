@@ -30,6 +30,17 @@ struct sdhc_host_params {
     void (*abort)();
     enum rb_client rb;
     enum wb_client wb;
+    /* interrupt controller bit of the host, 0 if waits should poll */
+    u32 irq_mask_reg;   /* LT_INTMR_* */
+    u32 irq_status_reg; /* LT_INTSR_* */
+    u32 irq_flag;
+};
+
+/* ADMA2 descriptor, little endian like the rest of the controller (1.13.3) */
+struct sdhc_adma2_desc {
+    u_int16_t attr;
+    u_int16_t len;
+    u_int32_t addr;
 };
 
 struct sdhc_host {
@@ -44,6 +55,7 @@ struct sdhc_host {
     volatile u_int16_t intr_error_status;    /* soft error status */
     int data_command;
     int no_dma;
+    struct sdhc_adma2_desc *adma_table;
 
     struct sdhc_host_params pa;
 };
@@ -58,11 +70,16 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_DMA_ADDR           0x00
 #define SDHC_BLOCK_SIZE         0x04
 #define SDHC_BLOCK_COUNT        0x06
+/* blocks per bounce buffer, boot1 runs out of SRAM and has no room for more than one */
 #ifdef MINUTE_BOOT1
 #define SDHC_BLOCK_COUNT_MAX 1
 #else
 #define SDHC_BLOCK_COUNT_MAX        256
 #endif
+/* one SDMA or PIO command, straight from or to the caller's buffer */
+#define SDHC_CMD_BLOCK_COUNT_MAX    256
+/* one ADMA2 command covers up to 2 MiB */
+#define SDHC_ADMA_BLOCK_COUNT_MAX   4096
 #define SDHC_ARGUMENT           0x08
 #define SDHC_TRANSFER_MODE      0x0c
 #define SDHC_MULTI_BLOCK_MODE       (1<<5)
@@ -111,6 +128,9 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_CMD_INHIBIT_MASK       0x0003
 #define SDHC_HOST_CTL           0x28
 #define SDHC_8BIT_MODE          (1<<5)
+#define SDHC_DMA_SELECT_MASK        (3<<3)
+#define SDHC_DMA_SELECT_SDMA        (0<<3)
+#define SDHC_DMA_SELECT_ADMA2       (2<<3)
 #define SDHC_HIGH_SPEED         (1<<2)
 #define SDHC_4BIT_MODE          (1<<1)
 #define SDHC_LED_ON         (1<<0)
@@ -178,6 +198,7 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_VOLTAGE_SUPP_3_3V      (1<<24)
 #define SDHC_DMA_SUPPORT        (1<<22)
 #define SDHC_HIGH_SPEED_SUPP        (1<<21)
+#define SDHC_ADMA2_SUPPORT      (1<<19)
 #define SDHC_BASE_FREQ_SHIFT        8
 #define SDHC_BASE_FREQ_MASK     0x3f
 #define SDHC_BASE_FREQ_MASK_V3      0xff
@@ -185,6 +206,8 @@ int sdhc_intr(struct sdhc_host *);
 #define SDHC_TIMEOUT_FREQ_SHIFT     0
 #define SDHC_TIMEOUT_FREQ_MASK      0x1f
 #define SDHC_MAX_CAPABILITIES       0x48
+#define SDHC_ADMA_ERROR_STATUS      0x54
+#define SDHC_ADMA_SYSTEM_ADDR       0x58
 #define SDHC_SLOT_INTR_STATUS       0xfc
 #define SDHC_HOST_CTL_VERSION       0xfe
 #define SDHC_SPEC_VERS_SHIFT        0
@@ -202,6 +225,20 @@ int sdhc_intr(struct sdhc_host *);
     (SDHC_SDCLK_DIV(div) |                      \
     (((div) & SDHC_SDCLK_DIV_MASK_V3) >> SDHC_SDCLK_DIV_RSHIFT_V3))
 
+/* ADMA2 descriptor attributes */
+#define SDHC_ADMA2_VALID        (1<<0)
+#define SDHC_ADMA2_END          (1<<1)
+#define SDHC_ADMA2_INT          (1<<2)
+#define SDHC_ADMA2_ACT_NOP      (0<<4)
+#define SDHC_ADMA2_ACT_TRAN     (2<<4)
+#define SDHC_ADMA2_ACT_LINK     (3<<4)
+#define SDHC_ADMA2_DESC_MAX_LEN     0x8000
+#define SDHC_ADMA2_MAX_DESC     128
+
+/* c_error when an ADMA2 transfer failed and the host dropped back to SDMA,
+ * the command can simply be issued again */
+#define SDHC_EADMA          122
+
 /* SDHC_CAPABILITIES decoding */
 #define SDHC_BASE_FREQ_KHZ(cap)                     \
     ((((cap) >> SDHC_BASE_FREQ_SHIFT) & SDHC_BASE_FREQ_MASK) * 1000)
@@ -234,5 +271,9 @@ void sdhc_exec_command(struct sdhc_host *hp, struct sdmmc_command *);
 
 void sdhc_async_command(struct sdhc_host *hp, struct sdmmc_command *);
 void sdhc_async_response(struct sdhc_host *hp, struct sdmmc_command *);
+int sdhc_async_ready(struct sdhc_host *hp, struct sdmmc_command *);
+
+u_int32_t sdhc_max_block_count(struct sdhc_host *hp);
+int sdhc_adma2_build(struct sdhc_adma2_desc *table, int max, void *data, u_int32_t len);
 
 #endif
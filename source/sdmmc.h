@@ -88,6 +88,7 @@ struct sdmmc_command {
 #define SCF_RSP_CRC  0x0400
 #define SCF_RSP_IDX  0x0800
 #define SCF_RSP_PRESENT  0x1000
+#define SCF_CMD_PREDEF   0x2000     /* block count set by CMD23, no auto-CMD12 */
 /* response types */
 #define SCF_RSP_R0   0 /* none */
 #define SCF_RSP_R1   (SCF_RSP_PRESENT|SCF_RSP_CRC|SCF_RSP_IDX)
@@ -106,6 +107,7 @@ struct sdmmc_command {
     /* Host controller owned fields for data xfer in progress */
     int c_resid;            /* remaining I/O */
     u_char *c_buf;          /* remaining data */
+    int c_xfer;             /* PIO, SDMA or ADMA2 */
 };
 
 /*
@@ -191,7 +193,9 @@ struct sdmmc_function {
 
 /* SD application commands */           /* response type */
 #define SD_APP_SET_BUS_WIDTH        6   /* R1 */
+#define SD_APP_SET_WR_BLK_ERASE_COUNT   23  /* R1 */
 #define SD_APP_OP_COND          41  /* R3 */
+#define SD_APP_SEND_SCR         51  /* R1 */
 
 /* OCR bits */
 #define MMC_OCR_MEM_READY       (1<<31) /* memory power-up status bit */
@@ -367,6 +371,12 @@ struct sdmmc_function {
 #define SD_CID_PSN(resp)        MMC_RSP_BITS((resp), 24, 32)
 #define SD_CID_MDT(resp)        MMC_RSP_BITS((resp), 8, 12)
 
+/* SD SCR register (ACMD51), raw bytes as sent, MSB first */
+#define SD_SCR_SPEC(scr)        ((scr)[0] & 0xf)
+#define SD_SCR_CMD_SUPPORT(scr) ((scr)[3] & 0x3)
+#define  SD_SCR_CMD20_SUPPORT       (1<<0)
+#define  SD_SCR_CMD23_SUPPORT       (1<<1)
+
 /* Might be slow, but it should work on big and little endian systems. */
 #define MMC_RSP_BITS(resp, start, len)  __bitfield((resp), (start)-8, (len))
 static __inline int
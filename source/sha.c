@@ -19,21 +19,106 @@ A million repetitions of "a"
 #include <malloc.h>
 
 #include "sha.h"
+
+#ifndef CRYPTO_SOFTWARE
 #include "irq.h"
 #include "memory.h"
 #include "latte.h"
 
-//should be divisible by four
-#define BLOCKSIZE 32
-
 #define SHA_CMD_FLAG_EXEC (1<<31)
 #define SHA_CMD_FLAG_IRQ  (1<<30)
 #define SHA_CMD_FLAG_ERR  (1<<29)
 #define SHA_CMD_AREA_BLOCK ((1<<10) - 1)
 
-static void sha_transform(u32 state[SHA_HASH_WORDS], u8 buffer[SHA_BLOCK_SIZE], u32 blocks)
+// the engine needs 64-byte aligned source data
+#define SHA_DMA_ALIGN     (64)
+
+// persistent bounce buffer for data the engine can't read directly
+#ifdef MINUTE_BOOT1
+#define SHA_BOUNCE_BLOCKS (1)
+#else
+#define SHA_BOUNCE_BLOCKS (64)
+#endif
+
+static u8 sha_bounce[SHA_BOUNCE_BLOCKS * SHA_BLOCK_SIZE] ALIGNED(SHA_DMA_ALIGN);
+
+// the engine takes one request at a time, commands are chained from the
+// IRQ (or from sha_wait() when nobody takes it) until the request is done
+static struct {
+    u32* state;
+    const u8* data;
+    u32 blocks;
+    u32 handle;
+    volatile u32 done;
+} sha_job = {0};
+
+static inline int _sha_pending(u32 handle)
+{
+    return (s32)(handle - sha_job.done) > 0;
+}
+
+static void _sha_issue(void)
+{
+    const u8* data = sha_job.data;
+    u32 count;
+
+    // the working vars stay in the engine between commands
+    if(!((u32)data & (SHA_DMA_ALIGN - 1))) {
+        count = min(sha_job.blocks, SHA_CMD_AREA_BLOCK + 1);
+    } else {
+        count = min(sha_job.blocks, SHA_BOUNCE_BLOCKS);
+        memcpy(sha_bounce, data, count * SHA_BLOCK_SIZE);
+        data = sha_bounce;
+    }
+    sha_job.data += count * SHA_BLOCK_SIZE;
+    sha_job.blocks -= count;
+
+    // royal flush :)
+    dc_flushrange(data, SHA_BLOCK_SIZE * count);
+    ahb_flush_to(RB_SHA);
+
+    // tell sha1 controller the block source address
+    write32(SHA_SRC, dma_addr((void*)data));
+
+    // tell sha1 controller number of blocks
+    write32(SHA_CTRL, (read32(SHA_CTRL) & ~(SHA_CMD_AREA_BLOCK)) | (count - 1));
+
+    // fire up hashing, the IRQ tells us when its finished
+    write32(SHA_CTRL, read32(SHA_CTRL) | SHA_CMD_FLAG_EXEC | SHA_CMD_FLAG_IRQ);
+}
+
+// must be called with IRQs off
+static void _sha_advance(void)
+{
+    if(!_sha_pending(sha_job.handle))
+        return;
+    if(read32(SHA_CTRL) & SHA_CMD_FLAG_EXEC)
+        return;
+
+    if(sha_job.blocks) {
+        _sha_issue();
+        return;
+    }
+
+    /* Add the working vars back into ctx.state[] */
+    sha_job.state[0] = read32(SHA_H0);
+    sha_job.state[1] = read32(SHA_H1);
+    sha_job.state[2] = read32(SHA_H2);
+    sha_job.state[3] = read32(SHA_H3);
+    sha_job.state[4] = read32(SHA_H4);
+    sha_job.done = sha_job.handle;
+}
+
+void sha_irq(void)
+{
+    _sha_advance();
+}
+
+u32 sha_submit(u32 state[SHA_HASH_WORDS], const void* data, u32 blocks)
 {
-    if(blocks == 0) return;
+    sha_wait(sha_job.handle);
+    if(blocks == 0)
+        return sha_job.handle;
 
     /* Copy ctx->state[] to working vars */
     write32(SHA_H0, state[0]);
@@ -42,33 +127,44 @@ static void sha_transform(u32 state[SHA_HASH_WORDS], u8 buffer[SHA_BLOCK_SIZE],
     write32(SHA_H3, state[3]);
     write32(SHA_H4, state[4]);
 
-    // assign block to local copy which is 64-byte aligned
-    u8 *block = memalign(128, SHA_BLOCK_SIZE * blocks);
-    memcpy(block, buffer, SHA_BLOCK_SIZE * blocks);
+    u32 cookie = irq_kill();
+    sha_job.state = state;
+    sha_job.data = data;
+    sha_job.blocks = blocks;
+    sha_job.handle++;
+    _sha_issue();
+    irq_restore(cookie);
 
-    // royal flush :)
-    dc_flushrange(block, SHA_BLOCK_SIZE * blocks);
-    ahb_flush_to(RB_SHA);
+    return sha_job.handle;
+}
 
-    // tell sha1 controller the block source address
-    write32(SHA_SRC, dma_addr(block));
+int sha_poll(u32 handle)
+{
+    u32 cookie = irq_kill();
+    _sha_advance();
+    irq_restore(cookie);
 
-    // tell sha1 controller number of blocks
-    write32(SHA_CTRL, (read32(SHA_CTRL) & ~(SHA_CMD_AREA_BLOCK)) | (blocks - 1));
+    return !_sha_pending(handle);
+}
 
-    // fire up hashing and wait till its finished
-    write32(SHA_CTRL, read32(SHA_CTRL) | SHA_CMD_FLAG_EXEC);
-    while (read32(SHA_CTRL) & SHA_CMD_FLAG_EXEC);
+void sha_wait(u32 handle)
+{
+    while(_sha_pending(handle)) {
+        u32 cookie = irq_kill();
+        _sha_advance();
+        // only sleep if the IRQ is going to wake us up again
+        if(_sha_pending(handle) && (read32(SHA_CTRL) & SHA_CMD_FLAG_EXEC) &&
+           (read32(LT_INTMR_AHBALL_ARM) & IRQF_SHA1))
+            irq_wait();
+        irq_restore(cookie);
+    }
+}
 
-    // free the aligned data
-    free(block);
+#endif // CRYPTO_SOFTWARE
 
-    /* Add the working vars back into ctx.state[] */
-    state[0] = read32(SHA_H0);
-    state[1] = read32(SHA_H1);
-    state[2] = read32(SHA_H2);
-    state[3] = read32(SHA_H3);
-    state[4] = read32(SHA_H4);
+static void sha_transform(u32 state[SHA_HASH_WORDS], const u8 *buffer, u32 blocks)
+{
+    sha_wait(sha_submit(state, buffer, blocks));
 }
 
 void sha_init(sha_ctx* ctx)
@@ -82,10 +178,11 @@ void sha_init(sha_ctx* ctx)
     ctx->state[4] = 0xC3D2E1F0;
 }
 
-void sha_update(sha_ctx* ctx, const void* inbuf, size_t size)
+u32 sha_update_async(sha_ctx* ctx, const void* inbuf, size_t size)
 {
     unsigned int i, j;
     u8* data = (u8*)inbuf;
+    u32 handle = 0;
 
     j = (ctx->count[0] >> 3) & 63;
     if ((ctx->count[0] += size << 3) < (size << 3))
@@ -94,23 +191,21 @@ void sha_update(sha_ctx* ctx, const void* inbuf, size_t size)
     if ((j + size) > 63) {
         memcpy(&ctx->buffer[j], data, (i = 64-j));
         sha_transform(ctx->state, ctx->buffer, 1);
-        // try bigger blocks at once
-        for ( ; i + 63 + ((BLOCKSIZE-1)*64) < size; i += (64 + (BLOCKSIZE-1)*64)) {
-            sha_transform(ctx->state, &data[i], BLOCKSIZE);
-        }
-        for ( ; i + 63 + (((BLOCKSIZE/2)-1)*64) < size; i += (64 + ((BLOCKSIZE/2)-1)*64)) {
-            sha_transform(ctx->state, &data[i], BLOCKSIZE/2);
-        }
-        for ( ; i + 63 + (((BLOCKSIZE/4)-1)*64) < size; i += (64 + ((BLOCKSIZE/4)-1)*64)) {
-            sha_transform(ctx->state, &data[i], BLOCKSIZE/4);
-        }
-        for ( ; i + 63 < size; i += 64) {
-            sha_transform(ctx->state, &data[i], 1);
-        }
+        // hash all remaining whole blocks at once, in the background
+        u32 blocks = (size - i) / 64;
+        handle = sha_submit(ctx->state, &data[i], blocks);
+        i += blocks * 64;
         j = 0;
     }
     else i = 0;
     memcpy(&ctx->buffer[j], &data[i], size - i);
+
+    return handle;
+}
+
+void sha_update(sha_ctx* ctx, const void* inbuf, size_t size)
+{
+    sha_wait(sha_update_async(ctx, inbuf, size));
 }
 
 void sha_final(sha_ctx* ctx, void* outbuf)
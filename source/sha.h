@@ -33,4 +33,15 @@ void sha_final(sha_ctx* ctx, void* outbuf);
 
 void sha_hash(const void* inbuf, void* outbuf, size_t size);
 
+void sha_irq(void);
+
+// queue blocks on the engine and return a handle for sha_poll/sha_wait,
+// state and data must not be touched until it completed
+u32 sha_submit(u32 state[SHA_HASH_WORDS], const void* data, u32 blocks);
+int sha_poll(u32 handle);
+void sha_wait(u32 handle);
+
+// like sha_update, but the whole blocks of inbuf are hashed in the background
+u32 sha_update_async(sha_ctx* ctx, const void* inbuf, size_t size);
+
 #endif
@@ -0,0 +1,226 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Known answer tests of the CRYPTO_SOFTWARE backend (aes_sw.c, sha_sw.c)
+ *  through the usual sha.c/hmac.c front ends: FIPS-197, SP 800-38A,
+ *  FIPS 180-1 and RFC 2202. `--bench' measures its throughput.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crypto.h"
+#include "sha.h"
+#include "hmac.h"
+
+static int unhex(const char *s, u8 *out)
+{
+    int n = 0;
+
+    for (; s[0] && s[1]; s += 2)
+        out[n++] = (u8)strtoul((char[]){ s[0], s[1], 0 }, NULL, 16);
+    return n;
+}
+
+static int matches(const u8 *got, const char *expect)
+{
+    static u8 want[256];
+    int n = unhex(expect, want);
+
+    if (!memcmp(got, want, n))
+        return 1;
+
+    printf("  got    ");
+    for (int i = 0; i < n; i++)
+        printf("%02x", got[i]);
+    printf("\n  expect %s\n", expect);
+    return 0;
+}
+
+/* FIPS-197 appendix C.1 */
+static void test_aes_block(void)
+{
+    u8 key[16], pt[16], ct[16], out[16];
+
+    unhex("000102030405060708090a0b0c0d0e0f", key);
+    unhex("00112233445566778899aabbccddeeff", pt);
+
+    aes_reset();
+    aes_set_key(key);
+    aes_empty_iv();
+    aes_encrypt(pt, ct, 1, 0);
+    CHECK(matches(ct, "69c4e0d86a7b0430d8cdb78070b4c55a"));
+
+    aes_empty_iv();
+    aes_decrypt(ct, out, 1, 0);
+    CHECK(!memcmp(out, pt, 16));
+}
+
+/* SP 800-38A F.2.1 and F.2.2, CBC-AES128 */
+#define CBC_KEY "2b7e151628aed2a6abf7158809cf4f3c"
+#define CBC_IV  "000102030405060708090a0b0c0d0e0f"
+#define CBC_PT  "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51" \
+                "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710"
+#define CBC_CT  "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2" \
+                "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7"
+
+static void test_aes_cbc(void)
+{
+    u8 key[16], iv[16], pt[64], ct[64], out[64];
+
+    unhex(CBC_KEY, key);
+    unhex(CBC_IV, iv);
+    unhex(CBC_PT, pt);
+
+    aes_reset();
+    aes_set_key(key);
+    aes_set_iv(iv);
+    aes_encrypt(pt, ct, 4, 0);
+    CHECK(matches(ct, CBC_CT));
+
+    aes_set_iv(iv);
+    aes_decrypt(ct, out, 4, 0);
+    CHECK(!memcmp(out, pt, 64));
+
+    /* keep_iv chains on from the last request */
+    memset(ct, 0, sizeof(ct));
+    aes_set_iv(iv);
+    aes_encrypt(pt, ct, 1, 0);
+    aes_encrypt(pt + 16, ct + 16, 3, 1);
+    CHECK(matches(ct, CBC_CT));
+
+    memset(out, 0, sizeof(out));
+    aes_set_iv(iv);
+    aes_decrypt(ct, out, 2, 0);
+    aes_decrypt(ct + 32, out + 32, 2, 1);
+    CHECK(!memcmp(out, pt, 64));
+
+    /* in place */
+    memcpy(out, ct, 64);
+    aes_set_iv(iv);
+    aes_decrypt(out, out, 4, 0);
+    CHECK(!memcmp(out, pt, 64));
+
+    /* a session restarts from its IV unless a segment keeps it */
+    aes_session session;
+    aes_segment segs[3] = {
+        { ct, out, 2, 0 },
+        { ct + 32, out + 32, 2, 1 },
+        { ct, out, 1, 0 },
+    };
+    memset(out, 0, sizeof(out));
+    aes_session_init(&session, AES_CMD_DECRYPT, key, iv);
+    aes_wait(aes_session_submit(&session, segs, 2));
+    CHECK(!memcmp(out, pt, 64));
+    memset(out, 0, sizeof(out));
+    aes_wait(aes_session_submit(&session, segs + 2, 1));
+    CHECK(!memcmp(out, pt, 16));
+}
+
+/* FIPS 180-1 appendix A and B, and the million 'a' of appendix C */
+static void test_sha1(void)
+{
+    static u8 big[1000000];
+    u8 h[SHA_HASH_SIZE];
+    const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+    sha_hash("abc", h, 3);
+    CHECK(matches(h, "a9993e364706816aba3e25717850c26c9cd0d89d"));
+
+    sha_hash(two, h, strlen(two));
+    CHECK(matches(h, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"));
+
+    sha_hash("", h, 0);
+    CHECK(matches(h, "da39a3ee5e6b4b0d3255bfef95601890afd80709"));
+
+    memset(big, 'a', sizeof(big));
+    sha_hash(big, h, sizeof(big));
+    CHECK(matches(h, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+
+    /* in odd sized pieces through the block buffer */
+    sha_ctx ctx;
+    sha_init(&ctx);
+    for (u32 done = 0, step = 1; done < sizeof(big); done += step, step = step * 3 % 1021 + 1)
+        sha_update(&ctx, big + done, min(step, (u32)sizeof(big) - done));
+    sha_final(&ctx, h);
+    CHECK(matches(h, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+}
+
+/* RFC 2202, HMAC-SHA-1 test cases 1, 2, 3 and 6 */
+static void test_hmac(void)
+{
+    static const struct {
+        const char *key;
+        int key_len;
+        const char *data;
+        int data_len;
+        const char *mac;
+    } cases[] = {
+        { "\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b\x0b", 20,
+          "Hi There", 8, "b617318655057264e28bc0b6fb378c8ef146be00" },
+        { "Jefe", 4, "what do ya want for nothing?", 28,
+          "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79" },
+        { NULL, 20, NULL, 50, "125d7342b9ac11cd91a39af48aa17b4f63f175d3" },
+        { NULL, 80, "Test Using Larger Than Block-Size Key - Hash Key First", 54,
+          "aa4ae5e15272d00e95705637ce8a3b55ed402112" },
+    };
+    u8 key[80], data[64], mac[HMAC_SIZE];
+
+    for (u32 i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        /* case 3 is 0xdd times 50 keyed with 0xaa, case 6 the 0xaa key */
+        memset(key, 0xaa, sizeof(key));
+        memset(data, 0xdd, sizeof(data));
+        if (cases[i].key)
+            memcpy(key, cases[i].key, cases[i].key_len);
+        if (cases[i].data)
+            memcpy(data, cases[i].data, cases[i].data_len);
+
+        hmac_ctx ctx;
+        hmac_init(&ctx, key, cases[i].key_len);
+        hmac_update(&ctx, data, cases[i].data_len);
+        hmac_final(&ctx, mac);
+        CHECK(matches(mac, cases[i].mac));
+    }
+}
+
+static void bench(void)
+{
+    static u8 buf[1 << 20] ALIGNED(32);
+    u8 key[16] = {0}, h[SHA_HASH_SIZE];
+    int rounds = 32;
+
+    aes_reset();
+    aes_set_key(key);
+    aes_empty_iv();
+
+    u64 start = hw_wallclock_ns();
+    for (int i = 0; i < rounds; i++)
+        aes_decrypt(buf, buf, sizeof(buf) / 16, i != 0);
+    double aes = (double)rounds * sizeof(buf) / (hw_wallclock_ns() - start) * 1e9 / (1024 * 1024);
+
+    start = hw_wallclock_ns();
+    for (int i = 0; i < rounds; i++)
+        sha_hash(buf, h, sizeof(buf));
+    double sha = (double)rounds * sizeof(buf) / (hw_wallclock_ns() - start) * 1e9 / (1024 * 1024);
+
+    printf("CRYPTO_SOFTWARE: AES-128-CBC decrypt %.1f MiB/s, SHA-1 %.1f MiB/s\n", aes, sha);
+}
+
+int test_main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench();
+        return 0;
+    }
+
+    test_aes_block();
+    test_aes_cbc();
+    test_sha1();
+    test_hmac();
+
+    return hw_done("crypto_sw");
+}
@@ -0,0 +1,166 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  disk_read()/disk_write() on top of sdcard.c and the simulated host:
+ *  buffers the host can DMA to go straight through, misaligned ones and
+ *  ones it can't reach through the bounce buffer, and a buffer that only
+ *  runs out of reach partway goes in chunks, each one the cheapest way.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdcard.c"
+#include "diskio.c"
+#include "sdhc_sim.h"
+
+#define CARD_BLOCKS     4096
+#define BLOCKS          1024
+#define CHUNK           SDHC_BLOCK_COUNT_MAX
+#define BYTES(n)        ((unsigned long long)(n) * SDMMC_DEFAULT_BLOCKLEN)
+
+static u8 image[CARD_BLOCKS * 512] ALIGNED(32);
+/* room to misalign by a word */
+static u8 mem[BLOCKS * 512 + 32] ALIGNED(32);
+
+static struct sdhc_sim sim;
+
+static void test_attach(struct sdhc_host *hp) { (void)hp; }
+
+/* a card that's been through sdcard_needs_discover() */
+static void setup(void)
+{
+    struct sdhc_host_params params = {
+        .attach = &test_attach,
+        .abort = &sdcard_abort,
+        .rb = RB_SD0,
+        .wb = WB_SD0,
+        .irq_mask_reg = LT_INTMR_AHBALL_ARM,
+        .irq_status_reg = LT_INTSR_AHBALL_ARM,
+        .irq_flag = IRQF_SD0,
+    };
+
+    hw_reset();
+    sdhc_sim_init(&sim, image, CARD_BLOCKS);
+    hw_set_irq_handler(IRQ_SD0, sdcard_irq);
+    sdhc_host_found(&sdcard_host, &params, 0, SDHC_SIM_BASE, 1);
+    irq_enable(IRQ_SD0);
+
+    memset(&card, 0, sizeof(card));
+    card.handle = &sdcard_host;
+    card.inserted = 1;
+    card.selected = 1;
+    card.sdhc_blockmode = 1;
+    card.num_sectors = CARD_BLOCKS;
+    _sdcard_recovery_reset();
+
+    for (u32 i = 0; i < sizeof(image); i += 4)
+        *(u32 *)(image + i) = i * 2654435761u;
+}
+
+/* reads `count' blocks from `sector' into `buff', checks the data and how it got there */
+static void check_read(u8 *buff, u32 sector, u32 count, u32 direct_blocks)
+{
+    unsigned long long direct, bounced;
+
+    memset(buff, 0, BYTES(count));
+    disk_reset_stats();
+    CHECK(disk_read(0, buff, sector, count) == RES_OK);
+    CHECK(!memcmp(buff, image + BYTES(sector), BYTES(count)));
+
+    disk_get_stats(&direct, &bounced);
+    CHECK(direct == BYTES(direct_blocks));
+    CHECK(bounced == BYTES(count - direct_blocks));
+}
+
+/* the same the other way */
+static void check_write(u8 *buff, u32 sector, u32 count, u32 direct_blocks)
+{
+    unsigned long long direct, bounced;
+
+    for (u32 i = 0; i < BYTES(count); i++)
+        buff[i] = sector + i * 7;
+    disk_reset_stats();
+    CHECK(disk_write(0, buff, sector, count) == RES_OK);
+    CHECK(!memcmp(image + BYTES(sector), buff, BYTES(count)));
+
+    disk_get_stats(&direct, &bounced);
+    CHECK(direct == BYTES(direct_blocks));
+    CHECK(bounced == BYTES(count - direct_blocks));
+}
+
+static void test_aligned(void)
+{
+    setup();
+
+    /* in one piece, however many commands sdcard.c makes of it */
+    sim.data_commands = 0;
+    check_read(mem, 100, BLOCKS, BLOCKS);
+    CHECK(sim.data_commands == 1);
+    check_write(mem, 1500, BLOCKS, BLOCKS);
+}
+
+static void test_misaligned(void)
+{
+    setup();
+
+    /* a word off: every block through the bounce buffer, a bounce buffer at a time */
+    sim.data_commands = 0;
+    check_read(mem + 4, 7, BLOCKS, 0);
+    CHECK(sim.data_commands == BLOCKS / CHUNK);
+    check_write(mem + 4, 2000, BLOCKS, 0);
+
+    /* and less than that */
+    check_read(mem + 4, 3000, 3, 0);
+}
+
+static void test_unreachable(void)
+{
+    setup();
+
+    /* aligned, but somewhere the host can't get to */
+    hw_nodma_start = mem;
+    hw_nodma_size = sizeof(mem);
+    check_read(mem, 0, BLOCKS, 0);
+    check_write(mem, 512, BLOCKS, 0);
+}
+
+static void test_partial(void)
+{
+    setup();
+
+    /*
+     * Out of reach from block 600 on: the whole buffer can't go direct, the
+     * chunks before that still do, the one across it and the ones after get
+     * bounced.
+     */
+    u32 edge = 600;
+    u32 direct = edge / CHUNK * CHUNK;
+    hw_nodma_start = mem + BYTES(edge);
+    hw_nodma_size = sizeof(mem) - BYTES(edge);
+
+    check_read(mem, 33, BLOCKS, direct);
+    check_write(mem, 2222, BLOCKS, direct);
+
+    /* a request that stays below the edge goes straight through in one piece */
+    sim.data_commands = 0;
+    check_read(mem, 900, edge - 1, edge - 1);
+    CHECK(sim.data_commands == 1);
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_aligned();
+    test_misaligned();
+    test_unreachable();
+    test_partial();
+
+    return hw_done("diskio_dma");
+}
@@ -0,0 +1,330 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  The MLC <-> SD copy engine in dump.c against the double buffered loop
+ *  it replaced, on two simulated controllers. The SD card stalls for a
+ *  while every so often, like cards do when they erase. The ring keeps the
+ *  MLC reading through a stall, where the double buffered loop waits for it.
+ *  A resume only ever continues from a checkpoint the user agreed to.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dump.c"
+
+#define MS(x)       ((u64)(x) * HW_TICKS_PER_MS)
+#define CHUNK       (DUMP_COPY_BLOCKS)
+#define CHUNKS      (64)
+#define SECTORS     (CHUNKS * CHUNK)
+#define IMAGE_SIZE  (SECTORS * SDMMC_DEFAULT_BLOCKLEN)
+
+/*
+ * No filesystem: the copies here never get to a checkpoint. The only
+ * file there is, is a checkpoint the resume tests put in place.
+ */
+static dump_checkpoint stored_ckpt;
+static int ckpt_stored;
+static u32 confirmations;
+static int answer_yes;
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    (void)fp;
+    if (!strcmp(path, DUMP_CHECKPOINT_PATH) && mode == FA_READ)
+        return ckpt_stored ? FR_OK : FR_NO_FILE;
+    return FR_NOT_READY;
+}
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    (void)fp;
+    *br = min(btr, (UINT)sizeof(stored_ckpt));
+    memcpy(buff, &stored_ckpt, *br);
+    return FR_OK;
+}
+FRESULT f_unlink(const TCHAR *path)
+{
+    if (!strcmp(path, DUMP_CHECKPOINT_PATH))
+        ckpt_stored = 0;
+    return FR_OK;
+}
+FRESULT f_close(FIL *fp) { (void)fp; return FR_OK; }
+FRESULT f_lseek(FIL *fp, DWORD ofs) { (void)fp; (void)ofs; return FR_OK; }
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    (void)fp; (void)buff;
+    *bw = btw;
+    return FR_OK;
+}
+
+/* 0 to go ahead, like the console prompt */
+int console_abort_confirmation_power_no_eject_yes(void)
+{
+    confirmations++;
+    return !answer_yes;
+}
+
+/* one controller with a card behind it, one command at a time */
+struct sim_dev {
+    u8 *image;
+    int read;
+    /* per chunk, and one command in every `stall_every' takes `stall' instead */
+    u64 latency;
+    u64 stall;
+    u32 stall_every;
+
+    int busy;
+    u64 done_at;
+    u32 blk, count;
+    u8 *data;
+
+    u32 commands;
+    u64 busy_ticks;
+};
+
+static u8 mlc_image[IMAGE_SIZE];
+static u8 sd_image[IMAGE_SIZE];
+static struct sim_dev mlc_sim = { .image = mlc_image, .read = 1 };
+static struct sim_dev sd_sim = { .image = sd_image, .read = 0 };
+
+/* the DMA happens when the command completes */
+static void sim_done(void *arg)
+{
+    struct sim_dev *s = arg;
+    u8 *card = s->image + s->blk * SDMMC_DEFAULT_BLOCKLEN;
+    u32 len = s->count * SDMMC_DEFAULT_BLOCKLEN;
+
+    if (s->read)
+        memcpy(s->data, card, len);
+    else
+        memcpy(card, s->data, len);
+    s->busy = 0;
+}
+
+static int sim_start(struct sim_dev *s, u32 blk, u32 count, void *data)
+{
+    CHECK(!s->busy);
+    CHECK(blk + count <= SECTORS);
+    if (s->busy)
+        return -1;
+
+    s->commands++;
+    /* halfway through the period, a stall on the last chunk would have nothing to overlap */
+    int stall = s->stall_every && (s->commands % s->stall_every) == s->stall_every / 2;
+    u64 latency = stall ? s->stall : s->latency;
+    latency = latency * count / CHUNK;
+
+    s->busy = 1;
+    s->blk = blk;
+    s->count = count;
+    s->data = data;
+    s->done_at = hw_ticks + latency;
+    s->busy_ticks += latency;
+    hw_schedule(s->done_at, sim_done, s);
+    return 0;
+}
+
+static int sim_end(struct sim_dev *s)
+{
+    if (s->busy)
+        hw_advance(s->done_at - hw_ticks);
+    return 0;
+}
+
+static int mlc_sim_start(u32 blk, u32 count, void *data, struct sdmmc_command *cmd)
+{
+    (void)cmd;
+    return sim_start(&mlc_sim, blk, count, data);
+}
+static int mlc_sim_end(struct sdmmc_command *cmd) { (void)cmd; return sim_end(&mlc_sim); }
+static int mlc_sim_poll(struct sdmmc_command *cmd) { (void)cmd; return !mlc_sim.busy; }
+
+static int sd_sim_start(u32 blk, u32 count, void *data, struct sdmmc_command *cmd)
+{
+    (void)cmd;
+    return sim_start(&sd_sim, blk, count, data);
+}
+static int sd_sim_end(struct sdmmc_command *cmd) { (void)cmd; return sim_end(&sd_sim); }
+static int sd_sim_poll(struct sdmmc_command *cmd) { (void)cmd; return !sd_sim.busy; }
+
+/* the loop _dump_mlc() had before the copy engine */
+static void ref_double_buffer(void)
+{
+    struct sdmmc_command mlc_cmd = {0}, sdcard_cmd = {0};
+    u8 *sector_buf1 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * CHUNK);
+    u8 *sector_buf2 = memalign(32, SDMMC_DEFAULT_BLOCKLEN * CHUNK);
+    u8 *mlc_buf = sector_buf2;
+    u8 *sdcard_buf = sector_buf1;
+
+    mlc_sim_start(0, CHUNK, sdcard_buf, &mlc_cmd);
+    mlc_sim_end(&mlc_cmd);
+
+    u32 sdcard_sector = 0;
+    for (u32 sector = CHUNK; sector < SECTORS; sector += CHUNK) {
+        mlc_sim_start(sector, CHUNK, mlc_buf, &mlc_cmd);
+        sd_sim_start(sdcard_sector, CHUNK, sdcard_buf, &sdcard_cmd);
+        mlc_sim_end(&mlc_cmd);
+        sd_sim_end(&sdcard_cmd);
+
+        u8 *tmp = mlc_buf;
+        mlc_buf = sdcard_buf;
+        sdcard_buf = tmp;
+        sdcard_sector += CHUNK;
+    }
+
+    sd_sim_start(sdcard_sector, CHUNK, sdcard_buf, &sdcard_cmd);
+    sd_sim_end(&sdcard_cmd);
+
+    free(sector_buf1);
+    free(sector_buf2);
+}
+
+static void ring_copy(u32 depth)
+{
+    dump_copy_dev mlc = {
+        .name = "MLC", .base = 0,
+        .start = mlc_sim_start, .end = mlc_sim_end, .poll = mlc_sim_poll,
+    };
+    dump_copy_dev sd = {
+        .name = "SD", .base = 0,
+        .start = sd_sim_start, .end = sd_sim_end, .poll = sd_sim_poll,
+    };
+    dump_checkpoint ckpt = { .direction = DUMP_MLC_TO_SD, .total = SECTORS };
+    dump_manifest manifest = {0};
+
+    CHECK(_dump_copy_blocks(&mlc, &sd, &ckpt, &manifest, depth, CHUNK) == 0);
+    CHECK(ckpt.done == SECTORS && ckpt.bad == 0);
+    CHECK(mlc.retries + sd.retries == 0);
+}
+
+/* runs a copy, checks what arrived and returns how long it took */
+static u64 run(void (*copy)(u32), u32 depth)
+{
+    hw_reset();
+    for (u32 i = 0; i < IMAGE_SIZE; i += 4)
+        *(u32 *)(mlc_image + i) = i * 2654435761u;
+    memset(sd_image, 0, IMAGE_SIZE);
+    mlc_sim.commands = sd_sim.commands = 0;
+    mlc_sim.busy_ticks = sd_sim.busy_ticks = 0;
+
+    if (copy)
+        copy(depth);
+    else
+        ref_double_buffer();
+
+    CHECK(!memcmp(sd_image, mlc_image, IMAGE_SIZE));
+    CHECK(mlc_sim.commands == CHUNKS && sd_sim.commands == CHUNKS);
+    return hw_ticks;
+}
+
+static void setup(u64 read, u64 write, u64 stall, u32 stall_every)
+{
+    mlc_sim.latency = read;
+    sd_sim.latency = write;
+    sd_sim.stall = stall;
+    sd_sim.stall_every = stall_every;
+}
+
+static void report(const char *what, u64 ref, u64 ring)
+{
+    double mb = (double)IMAGE_SIZE / (1000 * 1000);
+
+    printf("%s: double buffered %.1f MB/s, ring of %d %.1f MB/s, %.2fx\n", what,
+           mb / ((double)ref / MS(1000)), DUMP_COPY_DEPTH, mb / ((double)ring / MS(1000)),
+           (double)ref / ring);
+}
+
+static void test_steady(void)
+{
+    /* even latencies: the ring has nothing to gain, but mustn't lose either */
+    setup(MS(4), MS(3), 0, 0);
+    u64 ref = run(NULL, 0);
+    u64 ring = run(ring_copy, DUMP_COPY_DEPTH);
+
+    CHECK(ring <= ref + MS(1));
+    /* the MLC reads back to back, the last write comes on top */
+    CHECK(ring < CHUNKS * MS(4) + MS(3) + MS(1));
+    report("steady", ref, ring);
+}
+
+static void test_stalls(void)
+{
+    /* 2ms writes, but every 16th takes 40ms: on average still faster than the 4ms reads */
+    setup(MS(4), MS(2), MS(40), 16);
+    u64 ref = run(NULL, 0);
+    u64 ring = run(ring_copy, DUMP_COPY_DEPTH);
+    u64 ring2 = run(ring_copy, 2);
+
+    /* every stall costs the double buffered loop 36ms */
+    CHECK(ref >= CHUNKS * MS(4) + (CHUNKS / 16) * MS(36));
+    /*
+     * The ring keeps reading into the buffers that aren't being written:
+     * one is on the SD, one was already read when it stalled, the rest fill
+     * up during the stall. The MLC only waits for whatever is left of it.
+     */
+    u64 left = MS(40) - (DUMP_COPY_DEPTH - 2) * MS(4);
+    CHECK(ring < CHUNKS * MS(4) + (CHUNKS / 16) * left + MS(2) + MS(1));
+    CHECK(ring * 5 < ref * 4);
+    /* and it's the depth that does it, two buffers are no better than before */
+    CHECK(ring2 * 10 > ref * 9);
+    report("stalling SD", ref, ring);
+}
+
+static void store_checkpoint(u32 base, u32 done)
+{
+    stored_ckpt = (dump_checkpoint){
+        .magic = DUMP_CHECKPOINT_MAGIC, .direction = DUMP_MLC_TO_SD,
+        .base = base, .total = TOTAL_SECTORS, .done = done,
+    };
+    stored_ckpt.checksum = _dump_checkpoint_checksum(&stored_ckpt);
+    ckpt_stored = 1;
+}
+
+/* resuming never falls back to a fresh copy over the old one */
+static void test_resume(void)
+{
+    dump_checkpoint ckpt;
+
+    /* nothing to resume from */
+    ckpt_stored = 0;
+    confirmations = 0;
+    CHECK(_dump_checkpoint_init(&ckpt, DUMP_MLC_TO_SD, 0x1000, true) != 0);
+    CHECK(confirmations == 0);
+
+    /* a checkpoint for another partition doesn't count */
+    store_checkpoint(0x2000, 0x80000);
+    CHECK(_dump_checkpoint_init(&ckpt, DUMP_MLC_TO_SD, 0x1000, true) != 0);
+    CHECK(confirmations == 0);
+
+    /* the user says no: the resume stops and the checkpoint stays */
+    store_checkpoint(0x1000, 0x80000);
+    answer_yes = 0;
+    CHECK(_dump_checkpoint_init(&ckpt, DUMP_MLC_TO_SD, 0x1000, true) != 0);
+    CHECK(confirmations == 1 && ckpt_stored);
+
+    /* and yes picks it up */
+    answer_yes = 1;
+    CHECK(_dump_checkpoint_init(&ckpt, DUMP_MLC_TO_SD, 0x1000, true) == 0);
+    CHECK(ckpt.done == 0x80000 && ckpt.base == 0x1000);
+
+    /* a plain dump still starts over when told to */
+    answer_yes = 0;
+    CHECK(_dump_checkpoint_init(&ckpt, DUMP_MLC_TO_SD, 0x1000, false) == 0);
+    CHECK(ckpt.done == 0 && ckpt.total == TOTAL_SECTORS);
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_steady();
+    test_stalls();
+    test_resume();
+
+    return hw_done("dump_copy");
+}
@@ -0,0 +1,120 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: FatFS on host files.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ff.h"
+#include "ff_host.h"
+
+#define FF_HOST_FILES   8
+
+u32 ff_host_reads = 0;
+u32 ff_host_seeks = 0;
+u64 ff_host_bytes = 0;
+void (*ff_host_on_read)(const void *buff, u32 len) = NULL;
+
+static struct {
+    FIL *fp;
+    FILE *file;
+} ff_host_files[FF_HOST_FILES];
+
+static FILE *ff_host_file(FIL *fp)
+{
+    for (int i = 0; i < FF_HOST_FILES; i++) {
+        if (ff_host_files[i].fp == fp)
+            return ff_host_files[i].file;
+    }
+    return NULL;
+}
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    const char *how = "rb";
+    if (mode & FA_CREATE_ALWAYS)
+        how = "w+b";
+    else if (mode & FA_WRITE)
+        how = "r+b";
+
+    FILE *file = fopen(path, how);
+    if (!file && (mode & FA_OPEN_ALWAYS))
+        file = fopen(path, "w+b");
+    if (!file)
+        return FR_NO_FILE;
+
+    for (int i = 0; i < FF_HOST_FILES; i++) {
+        if (ff_host_files[i].fp)
+            continue;
+        ff_host_files[i].fp = fp;
+        ff_host_files[i].file = file;
+
+        memset(fp, 0, sizeof(*fp));
+        fseek(file, 0, SEEK_END);
+        fp->fsize = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        return FR_OK;
+    }
+    fclose(file);
+    return FR_TOO_MANY_OPEN_FILES;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    for (int i = 0; i < FF_HOST_FILES; i++) {
+        if (ff_host_files[i].fp != fp)
+            continue;
+        fclose(ff_host_files[i].file);
+        ff_host_files[i].fp = NULL;
+        return FR_OK;
+    }
+    return FR_INVALID_OBJECT;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    FILE *file = ff_host_file(fp);
+    if (!file)
+        return FR_INVALID_OBJECT;
+
+    *br = fread(buff, 1, btr, file);
+    fp->fptr += *br;
+    ff_host_reads++;
+    ff_host_bytes += *br;
+    if (ff_host_on_read)
+        ff_host_on_read(buff, *br);
+    return ferror(file) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    FILE *file = ff_host_file(fp);
+    if (!file)
+        return FR_INVALID_OBJECT;
+
+    *bw = fwrite(buff, 1, btw, file);
+    fp->fptr += *bw;
+    if (fp->fptr > fp->fsize)
+        fp->fsize = fp->fptr;
+    return ferror(file) ? FR_DISK_ERR : FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, DWORD ofs)
+{
+    FILE *file = ff_host_file(fp);
+    if (!file)
+        return FR_INVALID_OBJECT;
+
+    /* only the ones that go somewhere else */
+    if (ofs != fp->fptr)
+        ff_host_seeks++;
+    if (fseek(file, ofs, SEEK_SET))
+        return FR_DISK_ERR;
+    fp->fptr = ofs;
+    return FR_OK;
+}
@@ -0,0 +1,24 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: the FatFS file calls on top of host files, for the
+ *  code that reads NAND images off the SD card (isfs.c with ctx->file).
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_FF_HOST_H__
+#define __HOST_FF_HOST_H__
+
+#include "types.h"
+
+/* what went through it */
+extern u32 ff_host_reads;
+extern u32 ff_host_seeks;
+extern u64 ff_host_bytes;
+
+/* called on every f_read(), for tests that care where the data goes and how long it takes */
+extern void (*ff_host_on_read)(const void *buff, u32 len);
+
+#endif
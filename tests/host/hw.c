@@ -0,0 +1,498 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: simulated register space, clock and interrupt
+ *  controller, plus the few platform functions the drivers call into.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "latte.h"
+#include "irq.h"
+#include "memory.h"
+
+#define HW_MMIO_START       0x0D000000
+#define HW_MMIO_END         0x0E000000
+
+#define HW_MAX_DEVICES      8
+#define HW_MAX_EVENTS       32
+#define HW_REGFILE_SIZE     1024
+
+u64 hw_ticks = 0;
+u32 hw_mmio_reads = 0;
+u32 hw_mmio_writes = 0;
+u32 hw_irq_waits = 0;
+u32 hw_irq_hangs = 0;
+int hw_failures = 0;
+
+static struct hw_device hw_devices[HW_MAX_DEVICES];
+static int hw_device_count = 0;
+
+static struct {
+    u64 when;
+    void (*fn)(void *arg);
+    void *arg;
+} hw_events[HW_MAX_EVENTS];
+
+/* registers nobody claimed just keep what was written to them */
+static struct {
+    u32 addr;
+    u32 val;
+} hw_regfile[HW_REGFILE_SIZE];
+
+static u32 hw_intsr = 0, hw_intmr = 0;
+static u32 hw_intsr_lt = 0, hw_intmr_lt = 0;
+static u64 hw_alarm_at = HW_NEVER;
+static u32 hw_alarm = 0;
+static u32 hw_cpsr = 0x13;
+static u32 _alarm_frequency = 0;
+static void (*hw_irq_handlers[32])(void);
+
+void hw_reset(void)
+{
+    hw_ticks = 0;
+    hw_mmio_reads = hw_mmio_writes = 0;
+    hw_irq_waits = hw_irq_hangs = 0;
+    hw_device_count = 0;
+    memset(hw_events, 0, sizeof(hw_events));
+    memset(hw_regfile, 0, sizeof(hw_regfile));
+    memset(hw_irq_handlers, 0, sizeof(hw_irq_handlers));
+    hw_intsr = hw_intmr = hw_intsr_lt = hw_intmr_lt = 0;
+    hw_alarm_at = HW_NEVER;
+    hw_alarm = 0;
+    hw_cpsr = 0x13;
+    _alarm_frequency = 0;
+    hw_nodma_start = NULL;
+    hw_nodma_size = 0;
+}
+
+void hw_map(const struct hw_device *dev)
+{
+    if (hw_device_count >= HW_MAX_DEVICES) {
+        printf("hw: too many devices\n");
+        abort();
+    }
+    hw_devices[hw_device_count++] = *dev;
+}
+
+u32 hw_ptr32(const void *p)
+{
+    uintptr_t a = (uintptr_t)p;
+    if (a >> 32) {
+        printf("hw: %p isn't reachable by a 32-bit bus\n", p);
+        abort();
+    }
+    return (u32)a;
+}
+
+static u32 *hw_reg(u32 addr)
+{
+    u32 i = (addr >> 2) % HW_REGFILE_SIZE;
+
+    for (u32 n = 0; n < HW_REGFILE_SIZE; n++, i = (i + 1) % HW_REGFILE_SIZE) {
+        if (hw_regfile[i].addr == addr || !hw_regfile[i].addr) {
+            hw_regfile[i].addr = addr;
+            return &hw_regfile[i].val;
+        }
+    }
+    printf("hw: register file full\n");
+    abort();
+}
+
+static struct hw_device *hw_find(u32 addr)
+{
+    for (int i = 0; i < hw_device_count; i++) {
+        if (addr - hw_devices[i].base < hw_devices[i].size)
+            return &hw_devices[i];
+    }
+    return NULL;
+}
+
+static int hw_next(u64 limit);
+
+/* A register access is a bus cycle or so, polling loops get to see time go by. */
+static void hw_bus_cycle(void)
+{
+    hw_ticks++;
+    while (hw_next(hw_ticks))
+        ;
+}
+
+u32 hw_read32(u32 addr)
+{
+    if (addr < HW_MMIO_START || addr >= HW_MMIO_END)
+        return *(u32 *)HW_PTR(addr);
+
+    hw_mmio_reads++;
+    hw_bus_cycle();
+
+    struct hw_device *dev = hw_find(addr);
+    if (dev)
+        return dev->read(dev->ctx, addr - dev->base);
+
+    switch (addr) {
+        case LT_TIMER:              return (u32)hw_ticks;
+        case LT_ALARM:              return hw_alarm;
+        case LT_INTSR_AHBALL_ARM:   return hw_intsr;
+        case LT_INTMR_AHBALL_ARM:   return hw_intmr;
+        case LT_INTSR_AHBLT_ARM:    return hw_intsr_lt;
+        case LT_INTMR_AHBLT_ARM:    return hw_intmr_lt;
+    }
+    return *hw_reg(addr);
+}
+
+void hw_write32(u32 addr, u32 val)
+{
+    if (addr < HW_MMIO_START || addr >= HW_MMIO_END) {
+        *(u32 *)HW_PTR(addr) = val;
+        return;
+    }
+
+    hw_mmio_writes++;
+    hw_bus_cycle();
+
+    struct hw_device *dev = hw_find(addr);
+    if (dev) {
+        dev->write(dev->ctx, addr - dev->base, val);
+        return;
+    }
+
+    switch (addr) {
+        case LT_TIMER:
+            hw_ticks = (hw_ticks & ~0xFFFFFFFFull) | val;
+            return;
+        case LT_ALARM:
+            /* the compare matches once the timer gets there, wrapping if needed */
+            hw_alarm = val;
+            hw_alarm_at = hw_ticks + (u32)(val - (u32)hw_ticks);
+            if (hw_alarm_at == hw_ticks)
+                hw_alarm_at += 1ull << 32;
+            return;
+        case LT_INTSR_AHBALL_ARM:   hw_intsr &= ~val; return;
+        case LT_INTMR_AHBALL_ARM:   hw_intmr = val; return;
+        case LT_INTSR_AHBLT_ARM:    hw_intsr_lt &= ~val; return;
+        case LT_INTMR_AHBLT_ARM:    hw_intmr_lt = val; return;
+    }
+    *hw_reg(addr) = val;
+}
+
+void hw_schedule(u64 when, void (*fn)(void *arg), void *arg)
+{
+    if (when == HW_NEVER)
+        return;
+
+    for (int i = 0; i < HW_MAX_EVENTS; i++) {
+        if (!hw_events[i].fn) {
+            hw_events[i].when = when;
+            hw_events[i].fn = fn;
+            hw_events[i].arg = arg;
+            return;
+        }
+    }
+    printf("hw: too many events\n");
+    abort();
+}
+
+void hw_cancel(void *arg)
+{
+    for (int i = 0; i < HW_MAX_EVENTS; i++) {
+        if (hw_events[i].fn && hw_events[i].arg == arg)
+            hw_events[i].fn = NULL;
+    }
+}
+
+void hw_raise(u32 irq)
+{
+    hw_intsr |= 1 << irq;
+}
+
+void hw_lower(u32 irq)
+{
+    hw_intsr &= ~(1 << irq);
+}
+
+void hw_set_irq_handler(u32 irq, void (*fn)(void))
+{
+    hw_irq_handlers[irq] = fn;
+}
+
+static int hw_pending(void)
+{
+    return (hw_intsr & hw_intmr) || (hw_intsr_lt & hw_intmr_lt);
+}
+
+/* Moves the clock to the next thing that happens, as long as it's before `limit'. */
+static int hw_next(u64 limit)
+{
+    int ev = -1;
+    u64 when = hw_alarm_at;
+
+    for (int i = 0; i < HW_MAX_EVENTS; i++) {
+        if (hw_events[i].fn && hw_events[i].when < when) {
+            when = hw_events[i].when;
+            ev = i;
+        }
+    }
+    if (when > limit)
+        return 0;
+
+    if (when > hw_ticks)
+        hw_ticks = when;
+
+    if (ev < 0) {
+        hw_alarm_at = HW_NEVER;
+        hw_raise(IRQ_TIMER);
+    } else {
+        void (*fn)(void *) = hw_events[ev].fn;
+        hw_events[ev].fn = NULL;
+        fn(hw_events[ev].arg);
+    }
+    return 1;
+}
+
+/* Takes pending interrupts the way irq_handler() in irq.c does. */
+static void hw_service(void)
+{
+    while (!(hw_cpsr & CPSR_IRQDIS) && hw_pending()) {
+        u32 mask = hw_intsr & hw_intmr;
+
+        hw_cpsr |= CPSR_IRQDIS | CPSR_FIQDIS;
+        if (mask & IRQF_TIMER) {
+            if (_alarm_frequency)
+                write32(LT_ALARM, read32(LT_TIMER) + _alarm_frequency);
+            write32(LT_INTSR_AHBALL_ARM, IRQF_TIMER);
+        }
+        for (u32 irq = 1; irq < 32; irq++) {
+            if (!(mask & (1 << irq)))
+                continue;
+            if (hw_irq_handlers[irq])
+                hw_irq_handlers[irq]();
+            write32(LT_INTSR_AHBALL_ARM, 1 << irq);
+        }
+        hw_intsr_lt &= ~hw_intmr_lt;
+        hw_cpsr &= ~(CPSR_IRQDIS | CPSR_FIQDIS);
+    }
+}
+
+void hw_advance(u64 ticks)
+{
+    u64 target = hw_ticks + ticks;
+
+    while (hw_next(target))
+        hw_service();
+    hw_ticks = target;
+    hw_service();
+}
+
+void udelay(u32 d)
+{
+    hw_advance(((u64)d * HW_TICKS_PER_MS + 999) / 1000);
+}
+
+/* irq.c, minus the coprocessor and the vectors */
+void irq_enable(u32 irq)
+{
+    set32(LT_INTMR_AHBALL_ARM, 1<<irq);
+}
+
+void irq_disable(u32 irq)
+{
+    clear32(LT_INTMR_AHBALL_ARM, 1<<irq);
+}
+
+void irql_enable(u32 irq)
+{
+    set32(LT_INTMR_AHBLT_ARM, 1<<irq);
+}
+
+void irql_disable(u32 irq)
+{
+    clear32(LT_INTMR_AHBLT_ARM, 1<<irq);
+}
+
+void irq_set_alarm(u32 ms, u8 enable)
+{
+    _alarm_frequency = IRQ_ALARM_MS2REG(ms);
+
+    if (enable)
+        write32(LT_ALARM, read32(LT_TIMER) + _alarm_frequency);
+}
+
+u32 hw_alarm_frequency(void)
+{
+    return _alarm_frequency;
+}
+
+u32 irq_kill(void)
+{
+    u32 cookie = hw_cpsr & (CPSR_IRQDIS | CPSR_FIQDIS);
+    hw_cpsr |= CPSR_IRQDIS | CPSR_FIQDIS;
+    return cookie;
+}
+
+void irq_restore(u32 cookie)
+{
+    hw_cpsr = (hw_cpsr & ~(CPSR_IRQDIS | CPSR_FIQDIS)) | cookie;
+    hw_service();
+}
+
+/*
+ * Wait for interrupt: wakes on any enabled interrupt, masked by the CPSR
+ * or not. With nothing left that could wake the CPU the real thing hangs,
+ * here that gets counted and the clock jumps ahead a second instead.
+ */
+void irq_wait(void)
+{
+    hw_irq_waits++;
+
+    while (!hw_pending()) {
+        if (!hw_next(HW_NEVER - 1)) {
+            printf("hw: irq_wait() with nothing left to wake it up\n");
+            hw_irq_hangs++;
+            hw_ticks += 1000 * HW_TICKS_PER_MS;
+            return;
+        }
+    }
+    hw_service();
+}
+
+u32 get_cpsr(void)
+{
+    return hw_cpsr;
+}
+
+/* memory.c */
+void dc_flushrange(const void *start, u32 size) { (void)start; (void)size; }
+void dc_invalidaterange(void *start, u32 size) { (void)start; (void)size; }
+void dc_flushall(void) {}
+void ic_invalidateall(void) {}
+void ahb_flush_from(enum wb_client dev) { (void)dev; }
+void ahb_flush_to(enum rb_client dev) { (void)dev; }
+
+u32 dma_addr(void *p)
+{
+    return hw_ptr32(p);
+}
+
+const u8 *hw_nodma_start;
+u32 hw_nodma_size;
+
+u32 can_sdcard_dma_addr(void *p)
+{
+#ifdef MINUTE_BOOT1
+    /* like memory.c, boot1 does all of it by PIO */
+    (void)p;
+    return 0;
+#else
+    if ((const u8 *)p >= hw_nodma_start && (const u8 *)p < hw_nodma_start + hw_nodma_size)
+        return 0;
+    return !(hw_ptr32(p) & 0x1F);
+#endif
+}
+
+/* utils.c */
+void memset32(void *dst, u32 value, u32 size)
+{
+    for (u32 i = 0; i < size / 4; i++)
+        ((u32 *)dst)[i] = value;
+}
+
+void memcpy32(void *dst, void *src, u32 size)
+{
+    for (u32 i = 0; i < size / 4; i++)
+        ((u32 *)dst)[i] = ((u32 *)src)[i];
+}
+
+void memset16(void *dst, u16 value, u32 size)
+{
+    for (u32 i = 0; i < size / 2; i++)
+        ((u16 *)dst)[i] = value;
+}
+
+void memcpy16(void *dst, void *src, u32 size)
+{
+    for (u32 i = 0; i < size / 2; i++)
+        ((u16 *)dst)[i] = ((u16 *)src)[i];
+}
+
+void memset8(void *dst, u8 value, u32 size)
+{
+    memset(dst, value, size);
+}
+
+void memcpy8(void *dst, void *src, u32 size)
+{
+    memcpy(dst, src, size);
+}
+
+void hexdump(const void *d, int len)
+{
+    const u8 *p = d;
+
+    for (int i = 0; i < len; i++)
+        printf("%02x%s", p[i], (i & 15) == 15 || i == len - 1 ? "\n" : " ");
+}
+
+void panic(u8 v)
+{
+    printf("panic(%u)\n", v);
+    abort();
+}
+
+u64 hw_wallclock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int hw_done(const char *name)
+{
+    if (hw_failures)
+        printf("%s: %d check(s) FAILED\n", name, hw_failures);
+    else
+        printf("%s: ok\n", name);
+    return hw_failures ? 1 : 0;
+}
+
+/*
+ * The drivers keep pointers in u32s like the ARM does. The binaries are
+ * linked -no-pie, malloc() is kept on the brk heap and the test itself runs
+ * on this stack, so everything they get to see sits below 4 GiB.
+ */
+static u8 hw_stack[8 << 20] ALIGNED(16);
+static ucontext_t hw_main_ctx, hw_test_ctx;
+static int hw_argc, hw_ret;
+static char **hw_argv;
+
+static void hw_trampoline(void)
+{
+    hw_ret = test_main(hw_argc, hw_argv);
+}
+
+int main(int argc, char **argv)
+{
+    mallopt(M_MMAP_MAX, 0);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    hw_argc = argc;
+    hw_argv = argv;
+    hw_ptr32(hw_stack + sizeof(hw_stack) - 1);
+
+    getcontext(&hw_test_ctx);
+    hw_test_ctx.uc_stack.ss_sp = hw_stack;
+    hw_test_ctx.uc_stack.ss_size = sizeof(hw_stack);
+    hw_test_ctx.uc_link = &hw_main_ctx;
+    makecontext(&hw_test_ctx, hw_trampoline, 0);
+    swapcontext(&hw_main_ctx, &hw_test_ctx);
+
+    return hw_ret;
+}
@@ -0,0 +1,192 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: stands in for utils.h, which is ARM inline asm, and
+ *  routes register accesses to simulated devices instead. Every test is
+ *  built with -include host/hw.h ahead of the driver source it pulls in.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_HW_H__
+#define __HOST_HW_H__
+
+/* keep the real utils.h out, everything it offers is below */
+#define __UTILS_H__
+
+#include "types.h"
+
+/*
+ * Simulated clock, in LT_TIMER ticks (IRQ_ALARM_MS2REG() of them per ms).
+ * A register access takes one, udelay(), irq_wait() and hw_advance() move
+ * it further.
+ */
+#define HW_TICKS_PER_MS     1898
+#define HW_NEVER            (~0ull)
+
+extern u64 hw_ticks;
+extern u32 hw_mmio_reads;
+extern u32 hw_mmio_writes;
+extern u32 hw_irq_waits;
+extern u32 hw_irq_hangs;
+
+/* A device claims [base, base + size) of the register space. */
+struct hw_device {
+    u32 base;
+    u32 size;
+    void *ctx;
+    u32 (*read)(void *ctx, u32 offs);
+    void (*write)(void *ctx, u32 offs, u32 val);
+};
+
+void hw_map(const struct hw_device *dev);
+void hw_reset(void);
+
+void hw_advance(u64 ticks);
+void hw_schedule(u64 when, void (*fn)(void *arg), void *arg);
+void hw_cancel(void *arg);
+
+/* interrupt lines of LT_INTSR_AHBALL_ARM */
+void hw_raise(u32 irq);
+void hw_lower(u32 irq);
+void hw_set_irq_handler(u32 irq, void (*fn)(void));
+
+/* reload value of the periodic alarm, 0 for a one-shot */
+u32 hw_alarm_frequency(void);
+
+u32 hw_read32(u32 addr);
+void hw_write32(u32 addr, u32 val);
+
+/* [hw_nodma_start, + hw_nodma_size) is memory the SD host can't reach, like SRAM */
+extern const u8 *hw_nodma_start;
+extern u32 hw_nodma_size;
+
+/* Buffers handed to a device get cast to u32, they have to stay below 4 GiB. */
+u32 hw_ptr32(const void *p);
+#define HW_PTR(a) ((void *)(uintptr_t)(a))
+
+/* tiny check framework, the test's main returns hw_done() */
+extern int hw_failures;
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            hw_failures++; \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+int hw_done(const char *name);
+u64 hw_wallclock_ns(void);
+
+/* entry point, run on a stack below 4 GiB */
+int test_main(int argc, char **argv);
+
+static inline u32 _byteswap_ulong(u32 val)
+{
+    return __builtin_bswap32(val);
+}
+
+static inline u16 _byteswap_ushort(u16 val)
+{
+    return __builtin_bswap16(val);
+}
+
+static inline u32 read32_unaligned(const u8* pData)
+{
+    return (pData[0] << 24) | (pData[1] << 16) | (pData[2] << 8) | pData[3];
+}
+
+static inline u32 read32le_unaligned(u8* pData)
+{
+    return (pData[3] << 24) | (pData[2] << 16) | (pData[1] << 8) | pData[0];
+}
+
+static inline u32 read32(u32 addr)
+{
+    return hw_read32(addr);
+}
+
+static inline void write32(u32 addr, u32 data)
+{
+    hw_write32(addr, data);
+}
+
+static inline u32 set32(u32 addr, u32 set)
+{
+    u32 data = hw_read32(addr) | set;
+    hw_write32(addr, data);
+    return data;
+}
+
+static inline u32 clear32(u32 addr, u32 clear)
+{
+    u32 data = hw_read32(addr) & ~clear;
+    hw_write32(addr, data);
+    return data;
+}
+
+static inline u32 mask32(u32 addr, u32 clear, u32 set)
+{
+    u32 data = (hw_read32(addr) & ~clear) | set;
+    hw_write32(addr, data);
+    return data;
+}
+
+/* the bus is big endian, the narrow accesses pick their lane */
+static inline u16 read16(u32 addr)
+{
+    return hw_read32(addr & ~3) >> ((2 - (addr & 2)) * 8);
+}
+
+static inline void write16(u32 addr, u16 data)
+{
+    u32 shift = (2 - (addr & 2)) * 8;
+    mask32(addr & ~3, 0xffff << shift, (u32)data << shift);
+}
+
+static inline u8 read8(u32 addr)
+{
+    return hw_read32(addr & ~3) >> ((3 - (addr & 3)) * 8);
+}
+
+static inline void write8(u8 *addr, u8 data)
+{
+    u32 a = hw_ptr32(addr);
+    u32 shift = (3 - (a & 3)) * 8;
+    mask32(a & ~3, 0xff << shift, (u32)data << shift);
+}
+
+void memset32(void *dst, u32 value, u32 size);
+void memcpy32(void *dst, void *src, u32 size);
+void memset16(void *dst, u16 value, u32 size);
+void memcpy16(void *dst, void *src, u32 size);
+void memset8(void *dst, u8 value, u32 size);
+void memcpy8(void *dst, void *src, u32 size);
+
+void hexdump(const void *d, int len);
+void udelay(u32 d);
+void panic(u8 v);
+
+/* CPSR as far as anyone looks at it: SVC mode plus the IRQ/FIQ disable bits */
+u32 get_cpsr(void);
+
+#define PTR_OFFS(a, b) ((void*)(((intptr_t)a) + b))
+
+#define ALIGN_FORWARD(x,align) \
+    ((__typeof__(x))((((u32)(x)) + (align) - 1) & (~(align-1))))
+
+#define ALIGN_BACKWARD(x,align) \
+    ((__typeof__(x))(((u32)(x)) & (~(align-1))))
+
+#define max(a, b) \
+    ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+       _a > _b ? _a : _b; })
+
+#define min(a, b) \
+    ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+       _a < _b ? _a : _b; })
+
+#define BIT(n) (1<<n)
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: ISFS superblocks from dumps. Include it after
+ *  isfs.c, it uses that file's statics.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_ISFS_IMAGE_H__
+#define __HOST_ISFS_IMAGE_H__
+
+#include <stdio.h>
+
+/* superblocks are stored big endian and in the clear */
+static void isfs_image_swap_super(isfs_ctx* ctx)
+{
+    u16* fat = _isfs_get_fat(ctx);
+    isfs_fst* root = _isfs_get_fst(ctx);
+
+    for (u32 i = 0; i < CLUSTER_COUNT; i++)
+        fat[i] = _byteswap_ushort(fat[i]);
+    for (u32 i = 0; i < ISFS_FST_COUNT; i++) {
+        root[i].sub = _byteswap_ushort(root[i].sub);
+        root[i].sib = _byteswap_ushort(root[i].sib);
+        root[i].size = _byteswap_ulong(root[i].size);
+        root[i].x1 = _byteswap_ushort(root[i].x1);
+        root[i].uid = _byteswap_ushort(root[i].uid);
+        root[i].gid = _byteswap_ushort(root[i].gid);
+        root[i].x3 = _byteswap_ulong(root[i].x3);
+    }
+}
+
+/*
+ * Loads a superblock into ctx->super, in host byte order: the file is
+ * either just the superblock, or a raw dump of the bank (pages with their
+ * spare) and the newest superblock in it is taken.
+ */
+static int isfs_image_load_super(isfs_ctx* ctx, const char* name)
+{
+    FILE* f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+
+    long best = -1;
+    u32 best_generation = 0;
+    const long page = PAGE_SIZE + PAGE_SPARE_SIZE;
+
+    if (size == ISFSSUPER_SIZE) {
+        best = 0;
+    } else {
+        for (u32 i = 0; i < ctx->super_count; i++) {
+            u32 cluster = CLUSTER_COUNT - (ctx->super_count - i) * ISFSSUPER_CLUSTERS;
+            u8 hdr[8];
+            fseek(f, cluster * CLUSTER_PAGES * page, SEEK_SET);
+            if (fread(hdr, sizeof(hdr), 1, f) != 1 || _isfs_get_super_version(hdr) < 0)
+                continue;
+            u32 generation = read32_unaligned(hdr + 4);
+            if (best < 0 || generation > best_generation) {
+                best = cluster * CLUSTER_PAGES * page;
+                best_generation = generation;
+            }
+        }
+    }
+    if (best < 0) {
+        printf("%s: no superblock found\n", name);
+        fclose(f);
+        return -1;
+    }
+
+    fseek(f, best, SEEK_SET);
+    int ok = 1;
+    if (size == ISFSSUPER_SIZE) {
+        ok = fread(ctx->super, ISFSSUPER_SIZE, 1, f) == 1;
+    } else {
+        for (u32 p = 0; ok && p < ISFSSUPER_SIZE / PAGE_SIZE; p++) {
+            ok = fread(ctx->super + p * PAGE_SIZE, PAGE_SIZE, 1, f) == 1;
+            fseek(f, PAGE_SPARE_SIZE, SEEK_CUR);
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        printf("%s: short read\n", name);
+        return -1;
+    }
+
+    ctx->version = _isfs_get_super_version(ctx->super);
+    isfs_image_swap_super(ctx);
+    return 0;
+}
+
+#endif
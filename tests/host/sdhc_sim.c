@@ -0,0 +1,335 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: simulated SD host controller.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bsdtypes.h"
+#include "sdmmc.h"
+#include "sdhc.h"
+#include "irq.h"
+#include "sdhc_sim.h"
+
+/*
+ * The driver sees the 16-bit registers as halves of a 32-bit word, the
+ * one at the lower offset in the low half, so the model keeps them that way.
+ */
+#define REG(sim, offs)  ((sim)->regs[(offs) >> 2])
+
+#define SIM_STATUS(sim)     (REG(sim, SDHC_NINTR_STATUS) & 0xffff)
+#define SIM_ERROR(sim)      (REG(sim, SDHC_NINTR_STATUS) >> 16)
+
+static void sdhc_sim_update_irq(struct sdhc_sim *sim)
+{
+    u32 signal = REG(sim, SDHC_NINTR_SIGNAL_EN);
+
+    if ((SIM_STATUS(sim) & signal & 0xffff) || (SIM_ERROR(sim) & (signal >> 16)))
+        hw_raise(sim->irq);
+}
+
+static void sdhc_sim_status(struct sdhc_sim *sim, u16 status, u16 error)
+{
+    u32 en = REG(sim, SDHC_NINTR_STATUS_EN);
+
+    if (error)
+        status |= SDHC_ERROR_INTERRUPT;
+    REG(sim, SDHC_NINTR_STATUS) |= (status & (en | SDHC_ERROR_INTERRUPT) & 0xffff) |
+        ((error & (en >> 16)) << 16);
+    sdhc_sim_update_irq(sim);
+}
+
+/* Moves `len' bytes between the card and memory at `addr'. */
+static void sdhc_sim_copy(struct sdhc_sim *sim, u32 addr, u32 *card_offs, u32 len, int read)
+{
+    u8 *mem = HW_PTR(addr);
+    u8 *card = sim->card + *card_offs;
+
+    if (read)
+        memcpy(mem, card, len);
+    else
+        memcpy(card, mem, len);
+    *card_offs += len;
+    sim->bytes += len;
+}
+
+/* Walks the descriptor table like the ADMA2 engine does, 0 if it was fine. */
+static int sdhc_sim_adma2(struct sdhc_sim *sim, u32 card_offs, u32 total, int read)
+{
+    u32 desc = REG(sim, SDHC_ADMA_SYSTEM_ADDR);
+    u32 moved = 0;
+
+    for (int n = 0; n < 4096; n++) {
+        struct sdhc_adma2_desc *d = HW_PTR(desc);
+        u16 attr = d->attr;
+        u32 len = d->len ? d->len : 0x10000;
+
+        sim->descriptors++;
+        if (!(attr & SDHC_ADMA2_VALID))
+            return -1;
+
+        switch (attr & (3 << 4)) {
+            case SDHC_ADMA2_ACT_TRAN:
+                if ((d->addr & 3) || moved + len > total)
+                    return -1;
+                sdhc_sim_copy(sim, d->addr, &card_offs, len, read);
+                moved += len;
+                desc += sizeof(*d);
+                break;
+            case SDHC_ADMA2_ACT_LINK:
+                desc = d->addr;
+                break;
+            default:
+                desc += sizeof(*d);
+                break;
+        }
+        if (attr & SDHC_ADMA2_END)
+            return moved == total ? 0 : -1;
+    }
+    return -1;
+}
+
+static void sdhc_sim_data_done(void *arg)
+{
+    struct sdhc_sim *sim = arg;
+    u32 mode = REG(sim, SDHC_TRANSFER_MODE) & 0xffff;
+    u32 blksize = REG(sim, SDHC_BLOCK_SIZE) & 0xfff;
+    u32 total = blksize * sim->last_blocks;
+    u32 card_offs = sim->last_arg * 512;
+    int read = !!(mode & SDHC_READ_MODE);
+
+    if (sim->last_arg + (total + 511) / 512 > sim->card_blocks) {
+        sdhc_sim_status(sim, 0, SDHC_DATA_TIMEOUT_ERROR);
+        return;
+    }
+
+    sim->last_adma = (REG(sim, SDHC_HOST_CTL) & SDHC_DMA_SELECT_MASK) == SDHC_DMA_SELECT_ADMA2;
+    if (sim->last_adma) {
+        if (sim->adma_fail || sdhc_sim_adma2(sim, card_offs, total, read)) {
+            sim->adma_fail = 0;
+            sim->adma_errors++;
+            REG(sim, SDHC_ADMA_ERROR_STATUS) = 1;
+            sdhc_sim_status(sim, 0, SDHC_ADMA_ERROR);
+            return;
+        }
+    } else {
+        sdhc_sim_copy(sim, REG(sim, SDHC_DMA_ADDR), &card_offs, total, read);
+    }
+
+    /* block count runs down to zero */
+    REG(sim, SDHC_BLOCK_SIZE) &= 0xffff;
+    sim->last_complete = hw_ticks;
+    sdhc_sim_status(sim, SDHC_TRANSFER_COMPLETE, 0);
+}
+
+/* The data port is little endian, sdhc.c swaps every word. */
+static u32 sdhc_sim_pio_ready(struct sdhc_sim *sim)
+{
+    u32 mode = REG(sim, SDHC_TRANSFER_MODE) & 0xffff;
+    u32 blksize = REG(sim, SDHC_BLOCK_SIZE) & 0xfff;
+    int read = !!(mode & SDHC_READ_MODE);
+    u32 block = sim->pio_pos / blksize + read;
+
+    if (!sim->pio || hw_ticks < sim->pio_start + block * sim->block_latency)
+        return 0;
+    return read ? SDHC_BUFFER_READ_ENABLE : SDHC_BUFFER_WRITE_ENABLE;
+}
+
+static u32 sdhc_sim_pio(struct sdhc_sim *sim, u32 val, int read)
+{
+    u8 *card = sim->card + sim->last_arg * 512 + sim->pio_pos;
+    u32 word;
+
+    if (!(sdhc_sim_pio_ready(sim) & (read ? SDHC_BUFFER_READ_ENABLE : SDHC_BUFFER_WRITE_ENABLE)))
+        return 0;
+
+    if (read) {
+        memcpy(&word, card, 4);
+        val = __builtin_bswap32(word);
+    } else {
+        word = __builtin_bswap32(val);
+        memcpy(card, &word, 4);
+    }
+    sim->pio_pos += 4;
+    sim->bytes += 4;
+
+    if (sim->pio_pos == sim->pio_total) {
+        sim->pio = 0;
+        REG(sim, SDHC_BLOCK_SIZE) &= 0xffff;
+        sim->last_complete = hw_ticks;
+        sdhc_sim_status(sim, SDHC_TRANSFER_COMPLETE, 0);
+    }
+    return val;
+}
+
+static void sdhc_sim_cmd_done(void *arg)
+{
+    struct sdhc_sim *sim = arg;
+    u32 mode = REG(sim, SDHC_TRANSFER_MODE) & 0xffff;
+    u32 command = REG(sim, SDHC_TRANSFER_MODE) >> 16;
+    u32 blksize = REG(sim, SDHC_BLOCK_SIZE) & 0xfff;
+
+    if (sim->cmd_fail) {
+        sim->cmd_fail = 0;
+        sdhc_sim_status(sim, 0, SDHC_CMD_TIMEOUT_ERROR);
+        return;
+    }
+
+    if ((command & SDHC_DATA_PRESENT_SELECT) && !(mode & SDHC_DMA_ENABLE)) {
+        sim->pio_commands++;
+        if (sim->pio_fail && sim->last_blocks > 1) {
+            sim->pio_fail--;
+            sdhc_sim_status(sim, 0, SDHC_DATA_TIMEOUT_ERROR);
+            return;
+        }
+    }
+
+    /* R1, card in transfer state and ready */
+    REG(sim, SDHC_RESPONSE) = (4 << 9) | (1 << 8);
+    sim->last_complete = hw_ticks;
+    sdhc_sim_status(sim, SDHC_COMMAND_COMPLETE, 0);
+
+    if (!(command & SDHC_DATA_PRESENT_SELECT))
+        return;
+    if (mode & SDHC_DMA_ENABLE) {
+        hw_schedule(hw_ticks + sim->data_latency + sim->block_latency * sim->last_blocks, sdhc_sim_data_done, sim);
+    } else if (sim->last_arg + sim->last_blocks * blksize / 512 <= sim->card_blocks) {
+        sim->pio = 1;
+        sim->pio_pos = 0;
+        sim->pio_total = blksize * sim->last_blocks;
+        sim->pio_start = hw_ticks + sim->data_latency;
+    }
+}
+
+static void sdhc_sim_issue(struct sdhc_sim *sim, u32 val)
+{
+    u32 command = val >> 16;
+    u32 entry;
+    int app = sim->app_cmd;
+
+    sim->commands++;
+    sim->last_opcode = (command >> SDHC_COMMAND_INDEX_SHIFT) & SDHC_COMMAND_INDEX_MASK;
+    sim->last_arg = REG(sim, SDHC_ARGUMENT);
+    sim->last_blocks = REG(sim, SDHC_BLOCK_SIZE) >> 16;
+    sim->last_adma = 0;
+    sim->last_issue = hw_ticks;
+    sim->app_cmd = sim->last_opcode == MMC_APP_CMD;
+    sim->data_latency = 0;
+
+    entry = sim->last_opcode;
+    if (app)
+        entry |= SDHC_SIM_ACMD;
+
+    if (sim->last_opcode == MMC_SET_BLOCK_COUNT && !app) {
+        if (sim->cmd23_fail) {
+            sim->cmd23_fail--;
+            sim->cmd_fail = 1;
+        } else {
+            sim->block_count = sim->last_arg;
+        }
+    }
+
+    if (command & SDHC_DATA_PRESENT_SELECT) {
+        u32 mode = val & 0xffff;
+
+        sim->data_commands++;
+        if (mode & SDHC_AUTO_CMD12_ENABLE)
+            entry |= SDHC_SIM_AUTO_CMD12;
+        if (sim->block_count)
+            entry |= SDHC_SIM_COUNTED;
+        else if (!(mode & SDHC_READ_MODE) && sim->last_blocks > 1)
+            sim->data_latency = sim->open_write_latency;
+        sim->block_count = 0;
+    }
+
+    if (sim->log_len < SDHC_SIM_LOG)
+        sim->log[sim->log_len++] = entry;
+
+    if (sim->cmd_latency != HW_NEVER)
+        hw_schedule(hw_ticks + sim->cmd_latency, sdhc_sim_cmd_done, sim);
+}
+
+static u32 sdhc_sim_read(void *ctx, u32 offs)
+{
+    struct sdhc_sim *sim = ctx;
+
+    switch (offs & ~3) {
+        case SDHC_PRESENT_STATE:
+            return SDHC_CARD_INSERTED | SDHC_CARD_STATE_STABLE | SDHC_CARD_DETECT_PIN_LEVEL |
+                sdhc_sim_pio_ready(sim);
+        case SDHC_DATA:
+            return sdhc_sim_pio(sim, 0, 1);
+    }
+    return REG(sim, offs & ~3);
+}
+
+static void sdhc_sim_write(void *ctx, u32 offs, u32 val)
+{
+    struct sdhc_sim *sim = ctx;
+
+    switch (offs & ~3) {
+        case SDHC_NINTR_STATUS:
+            /* write one to clear, both halves */
+            REG(sim, SDHC_NINTR_STATUS) &= ~val;
+            return;
+        case SDHC_CLOCK_CTL: {
+            u32 reset = (val >> 24) & SDHC_RESET_MASK;
+            if (reset) {
+                hw_cancel(sim);
+                sim->pio = 0;
+                sim->cmd_fail = 0;
+                REG(sim, SDHC_NINTR_STATUS) = 0;
+                if (reset & SDHC_RESET_ALL)
+                    REG(sim, SDHC_NINTR_SIGNAL_EN) = REG(sim, SDHC_NINTR_STATUS_EN) = 0;
+            }
+            /* resets finish at once, the clock is stable as soon as it runs */
+            val &= 0x00ffffff;
+            if (val & SDHC_INTCLK_ENABLE)
+                val |= SDHC_INTCLK_STABLE;
+            break;
+        }
+        case SDHC_TRANSFER_MODE:
+            REG(sim, offs) = val;
+            sdhc_sim_issue(sim, val);
+            return;
+        case SDHC_DATA:
+            sdhc_sim_pio(sim, val, 0);
+            return;
+        case SDHC_PRESENT_STATE:
+        case SDHC_CAPABILITIES:
+        case SDHC_SLOT_INTR_STATUS:
+            return;
+    }
+    REG(sim, offs & ~3) = val;
+    sdhc_sim_update_irq(sim);
+}
+
+void sdhc_sim_init(struct sdhc_sim *sim, u8 *card, u32 card_blocks)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->base = SDHC_SIM_BASE;
+    sim->irq = IRQ_SD0;
+    sim->card = card;
+    sim->card_blocks = card_blocks;
+    sim->cmd_latency = 100;
+    sim->block_latency = 50;
+
+    /* SDHC 2.0, 48 MHz, SDMA and ADMA2 */
+    REG(sim, SDHC_CAPABILITIES) = SDHC_VOLTAGE_SUPP_3_3V | SDHC_DMA_SUPPORT |
+        SDHC_ADMA2_SUPPORT | (48 << SDHC_BASE_FREQ_SHIFT);
+    REG(sim, SDHC_SLOT_INTR_STATUS) = SDHC_SPEC_V2 << 16;
+
+    struct hw_device dev = {
+        .base = sim->base,
+        .size = 0x100,
+        .ctx = sim,
+        .read = sdhc_sim_read,
+        .write = sdhc_sim_write,
+    };
+    hw_map(&dev);
+}
@@ -0,0 +1,84 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: an SD host controller with a card behind it, enough
+ *  of it to run commands and SDMA/ADMA2/PIO transfers through sdhc.c.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_SDHC_SIM_H__
+#define __HOST_SDHC_SIM_H__
+
+#include "types.h"
+
+#define SDHC_SIM_BASE   0x0D070000
+
+/* entries of the command log: the opcode and what came with it */
+#define SDHC_SIM_LOG            64
+#define SDHC_SIM_ACMD           (1 << 8)    /* after APP_CMD */
+#define SDHC_SIM_AUTO_CMD12     (1 << 9)    /* the host sends the stop */
+#define SDHC_SIM_COUNTED        (1 << 10)   /* block count set by CMD23 */
+
+struct sdhc_sim {
+    u32 base;
+    u32 irq;
+    u32 regs[0x100 / 4];
+
+    /* the card, 512 byte blocks, block addressed */
+    u8 *card;
+    u32 card_blocks;
+
+    /*
+     * Latency from issuing a command to COMMAND_COMPLETE, and of every block
+     * in the data phase after that, in LT_TIMER ticks. HW_NEVER for a card
+     * that doesn't answer.
+     */
+    u64 cmd_latency;
+    u64 block_latency;
+
+    /* the next ADMA2 transfer fails with an ADMA error */
+    int adma_fail;
+    /* the next `pio_fail' multi-block PIO commands fail with a data timeout */
+    u32 pio_fail;
+    /* the next `cmd23_fail' CMD23 fail with a command timeout */
+    u32 cmd23_fail;
+    /*
+     * Extra latency of a multi-block write nobody told the card the length
+     * of, it has to be ready for the stop after every block.
+     */
+    u64 open_write_latency;
+
+    /* card side: the last command was APP_CMD, the count CMD23 set for the next transfer */
+    int app_cmd;
+    u32 block_count;
+    int cmd_fail;
+    u64 data_latency;
+
+    /* PIO data phase: block n can go through SDHC_DATA once pio_start + n (reads: n + 1) block latencies passed */
+    int pio;
+    u32 pio_pos;
+    u32 pio_total;
+    u64 pio_start;
+
+    /* what went through it */
+    u32 commands;
+    u32 data_commands;
+    u32 descriptors;
+    u32 adma_errors;
+    u32 pio_commands;
+    u32 bytes;
+    u32 last_opcode;
+    u32 last_arg;
+    u32 last_blocks;
+    int last_adma;
+    u64 last_issue;
+    u64 last_complete;
+    u32 log[SDHC_SIM_LOG];
+    u32 log_len;
+};
+
+void sdhc_sim_init(struct sdhc_sim *sim, u8 *card, u32 card_blocks);
+
+#endif
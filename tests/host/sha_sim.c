@@ -0,0 +1,156 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: simulated SHA-1 engine.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+#include "latte.h"
+#include "sha_sim.h"
+
+#define SHA_CTRL_EXEC   (1u << 31)
+#define SHA_CTRL_IRQ    (1u << 30)
+#define SHA_CTRL_BLOCKS ((1u << 10) - 1)
+
+#define ROL(x, n)       (((x) << (n)) | ((x) >> (32 - (n))))
+
+/* plain FIPS 180-1, deliberately nothing like the unrolled sha_sw.c */
+static void sha_sim_compress(u32 h[5], const u8 *p)
+{
+    u32 w[80];
+    u32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int i = 0; i < 16; i++)
+        w[i] = read32_unaligned(p + i * 4);
+    for (int i = 16; i < 80; i++)
+        w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    for (int i = 0; i < 80; i++) {
+        u32 f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        u32 t = ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = ROL(b, 30);
+        b = a;
+        a = t;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+/* the DMA reads the source when the blocks go through, not when the command is issued */
+static void sha_sim_done(void *arg)
+{
+    struct sha_sim *sim = arg;
+    u32 count = (sim->ctrl & SHA_CTRL_BLOCKS) + 1;
+    const u8 *p = HW_PTR(sim->src);
+
+    for (u32 i = 0; i < count; i++, p += 64)
+        sha_sim_compress(sim->h, p);
+
+    sim->src += count * 64;
+    sim->ctrl &= ~SHA_CTRL_EXEC;
+    if (sim->ctrl & SHA_CTRL_IRQ)
+        hw_raise(IRQ_SHA1);
+}
+
+static void sha_sim_exec(struct sha_sim *sim)
+{
+    u32 count = (sim->ctrl & SHA_CTRL_BLOCKS) + 1;
+    const u8 *p = HW_PTR(sim->src);
+    const u8 *bounce = sim->bounce;
+
+    sim->commands++;
+    sim->blocks += count;
+    sim->largest = max(sim->largest, count);
+    if (bounce && p >= bounce && p < bounce + sim->bounce_size)
+        sim->bounced += count;
+
+    hw_schedule(hw_ticks + sim->block_latency * count, sha_sim_done, sim);
+}
+
+static u32 sha_sim_read(void *ctx, u32 offs)
+{
+    struct sha_sim *sim = ctx;
+
+    switch (offs) {
+        case SHA_CTRL - SHA_REG_BASE:
+            return sim->ctrl;
+        case SHA_SRC - SHA_REG_BASE:
+            return sim->src;
+    }
+    if (offs >= SHA_H0 - SHA_REG_BASE && offs <= SHA_H4 - SHA_REG_BASE)
+        return sim->h[(offs - (SHA_H0 - SHA_REG_BASE)) / 4];
+    return 0;
+}
+
+static void sha_sim_write(void *ctx, u32 offs, u32 val)
+{
+    struct sha_sim *sim = ctx;
+
+    /* nothing is latched while it runs */
+    if (sim->ctrl & SHA_CTRL_EXEC) {
+        sim->busy_writes++;
+        return;
+    }
+
+    switch (offs) {
+        case SHA_CTRL - SHA_REG_BASE:
+            sim->ctrl = val;
+            if (val & SHA_CTRL_EXEC)
+                sha_sim_exec(sim);
+            return;
+        case SHA_SRC - SHA_REG_BASE:
+            sim->src = val;
+            return;
+    }
+    if (offs >= SHA_H0 - SHA_REG_BASE && offs <= SHA_H4 - SHA_REG_BASE)
+        sim->h[(offs - (SHA_H0 - SHA_REG_BASE)) / 4] = val;
+}
+
+void sha_sim_clear_stats(struct sha_sim *sim)
+{
+    sim->commands = 0;
+    sim->blocks = 0;
+    sim->bounced = 0;
+    sim->largest = 0;
+    sim->busy_writes = 0;
+}
+
+void sha_sim_init(struct sha_sim *sim)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->block_latency = 20;
+
+    struct hw_device dev = {
+        .base = SHA_REG_BASE,
+        .size = 0x20,
+        .ctx = sim,
+        .read = sha_sim_read,
+        .write = sha_sim_write,
+    };
+    hw_map(&dev);
+}
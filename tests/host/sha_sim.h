@@ -0,0 +1,39 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: the SHA-1 engine, its registers and the block DMA
+ *  from memory, so sha.c can run unchanged.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_SHA_SIM_H__
+#define __HOST_SHA_SIM_H__
+
+#include "types.h"
+
+struct sha_sim {
+    u32 ctrl;
+    u32 src;
+    u32 h[5];
+
+    /* time the engine takes per block, in LT_TIMER ticks */
+    u64 block_latency;
+
+    /* blocks read from here count as bounced, the rest came straight from the caller */
+    const void *bounce;
+    u32 bounce_size;
+
+    /* what went through it */
+    u32 commands;
+    u32 blocks;
+    u32 bounced;
+    u32 largest;
+    u32 busy_writes;
+};
+
+void sha_sim_init(struct sha_sim *sim);
+void sha_sim_clear_stats(struct sha_sim *sim);
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: the parts of devkitARM's newlib device table that
+ *  isfs.c and elm.c register themselves with. Nothing calls through it on
+ *  the host, the handlers are left untyped.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_SYS_IOSUPPORT_H__
+#define __HOST_SYS_IOSUPPORT_H__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <errno.h>
+
+struct _reent {
+    int _errno;
+};
+
+typedef struct {
+    int device;
+    void *dirStruct;
+} DIR_ITER;
+
+typedef struct {
+    const char *name;
+    int structSize;
+    void *open_r;
+    void *close_r;
+    void *write_r;
+    void *read_r;
+    void *seek_r;
+    void *fstat_r;
+    void *stat_r;
+    void *link_r;
+    void *unlink_r;
+    void *chdir_r;
+    void *rename_r;
+    void *mkdir_r;
+    int dirStateSize;
+    void *diropen_r;
+    void *dirreset_r;
+    void *dirnext_r;
+    void *dirclose_r;
+    void *statvfs_r;
+    void *ftruncate_r;
+    void *fsync_r;
+    void *deviceData;
+    void *chmod_r;
+    void *fchmod_r;
+    void *rmdir_r;
+} devoptab_t;
+
+int AddDevice(const devoptab_t *device);
+int RemoveDevice(const char *name);
+void setDefaultDevice(int device);
+
+#endif
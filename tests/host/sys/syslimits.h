@@ -0,0 +1,19 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Host test harness: newlib's sys/syslimits.h, elm.h only wants PATH_MAX
+ *  out of it.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef __HOST_SYS_SYSLIMITS_H__
+#define __HOST_SYS_SYSLIMITS_H__
+
+/* newlib's value, glibc's limits.h would fight types.h over INT_MAX */
+#ifndef PATH_MAX
+#define PATH_MAX 1024
+#endif
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  The ISFS path lookup index in isfs.c against the linear FST walker it
+ *  sits in front of: same answer for every path in a synthetic FST, also
+ *  when the index has to give up. `--bench [image]' times both over all
+ *  paths of the FST, from a superblock or a raw SLC dump if one is given.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "isfs.c"
+#include "isfs_image.h"
+
+#define MAX_PATHS   ISFS_FST_COUNT
+
+static u8 super[ISFSSUPER_SIZE] ALIGNED(NAND_DATA_ALIGN);
+static isfs_ctx* ctx = &isfs[ISFSVOL_SLC];
+
+static char (*paths)[128];
+static u32 path_count;
+
+/* newlib's device table, nothing to register with here */
+int AddDevice(const devoptab_t *device) { (void)device; return 0; }
+int RemoveDevice(const char *name) { (void)name; return 0; }
+
+static void mount(void)
+{
+    ctx->super = super;
+    ctx->mounted = true;
+    if (!ctx->lookup)
+        ctx->lookup = malloc(ISFS_LOOKUP_ALLOC);
+    ctx->lookup_valid = false;
+}
+
+/* what _isfs_find_fst() finds without the index */
+static isfs_fst* linear(const char* path)
+{
+    void* parent;
+    isfs_ctx* vol = NULL;
+
+    path = _isfs_do_volume(path, &vol);
+    return _isfs_find_fst(vol, path, &parent);
+}
+
+/* synthetic FST, laid out like the system titles on a console */
+static u16 fst_used;
+
+/* FST names are zero padded, but not terminated at 12 characters */
+static void fst_name(isfs_fst* fst, const char* name)
+{
+    memset(fst->name, 0, sizeof(fst->name));
+    memcpy(fst->name, name, min(strlen(name), sizeof(fst->name)));
+}
+
+static u16 fst_add(u16 dir, const char* name, int is_dir)
+{
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u16 index = fst_used++;
+    isfs_fst* fst = &root[index];
+
+    if (index >= ISFS_FST_COUNT) {
+        printf("synthetic FST too big\n");
+        exit(1);
+    }
+
+    memset(fst, 0, sizeof(*fst));
+    fst_name(fst, name);
+    fst->mode = is_dir ? 2 : 1;
+    fst->sub = 0xFFFF;
+    fst->size = is_dir ? 0 : index * 100;
+
+    /* newest first, like IOS does */
+    fst->sib = root[dir].sub;
+    root[dir].sub = index;
+    return index;
+}
+
+static void build_fst(void)
+{
+    static const char* content[] = { "code", "content", "meta" };
+    static const char* files[] = { "app.xml", "cos.xml", "title.tmd", "title.tik", "00000000.app", "fw.img" };
+    char name[16];
+
+    ctx->super = super;
+    memset(super, 0, sizeof(super));
+    memcpy(super, "SFS!", 4);
+    fst_used = 0;
+    fst_add(0, "/", 1);
+    _isfs_get_fst(ctx)[0].sub = 0xFFFF;
+
+    u16 sys = fst_add(0, "sys", 1);
+    fst_add(0, "tmp", 1);
+    fst_add(0, "import", 1);
+    u16 shared = fst_add(0, "shared2", 1);
+    for (int i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "log%02d.txt", i);
+        fst_add(shared, name, 0);
+    }
+    /* names filling all 12 characters, one a prefix of the other */
+    fst_add(shared, "twelve_chars", 0);
+    fst_add(shared, "twelve_char", 0);
+
+    u16 title = fst_add(sys, "title", 1);
+    for (int hi = 0; hi < 8; hi++) {
+        snprintf(name, sizeof(name), "000500%02x", 0x10 + hi);
+        u16 high = fst_add(title, name, 1);
+        for (int lo = 0; lo < 45; lo++) {
+            snprintf(name, sizeof(name), "1000%04x", lo * 0x10 + hi);
+            u16 low = fst_add(high, name, 1);
+            for (u32 c = 0; c < 3; c++) {
+                u16 sub = fst_add(low, content[c], 1);
+                for (u32 f = c; f < c + 3; f++)
+                    fst_add(sub, files[f], 0);
+            }
+        }
+    }
+    ctx->lookup_valid = false;
+}
+
+static void collect(u16 dir, const char* prefix)
+{
+    isfs_fst* root = _isfs_get_fst(ctx);
+    char name[13];
+
+    for (u16 next = root[dir].sub; next != 0xFFFF && path_count < MAX_PATHS; next = root[next].sib) {
+        if (next >= ISFS_FST_COUNT)
+            return;
+        memcpy(name, root[next].name, 12);
+        name[12] = 0;
+        snprintf(paths[path_count++], sizeof(paths[0]), "%s/%s", prefix, name);
+        if (_isfs_fst_is_dir(&root[next]))
+            collect(next, paths[path_count - 1]);
+    }
+}
+
+static void collect_paths(void)
+{
+    if (!paths)
+        paths = malloc(MAX_PATHS * sizeof(paths[0]));
+    path_count = 0;
+    collect(0, "slc:");
+}
+
+static void test_agree(void)
+{
+    build_fst();
+    mount();
+    collect_paths();
+    CHECK(path_count > 4500);
+
+    int bad = 0;
+    for (u32 i = 0; i < path_count; i++) {
+        isfs_fst* fst = isfs_stat(paths[i]);
+        if ((!fst || fst != linear(paths[i])) && bad++ < 5)
+            printf("lookup of %s: %p, linear %p\n", paths[i], fst, linear(paths[i]));
+    }
+    CHECK(bad == 0);
+    CHECK(ctx->lookup_valid);
+
+    static const char* odd[] = {
+        "slc:/sys/title/00050010/10000011/code/app.xml",   /* right name, wrong dir */
+        "slc:/sys/title/00050010/10000000/code/app.xml/x", /* a file isn't a dir */
+        "slc:/sys/title/00050010/10000000/code/app.xm",
+        "slc:/sys/title/00050010/10000000/code/app.xmll",
+        "slc://sys//title/00050010/10000000/code/app.xml",
+        "slc:/shared2/twelve_chars",
+        "slc:/shared2/twelve_char",
+        "slc:/shared2/twelve_charsX",
+        "slc:/sys/title/000500100000/",
+        "slc:/sys/",
+        "slc:/nope",
+    };
+    for (u32 i = 0; i < sizeof(odd) / sizeof(odd[0]); i++) {
+        if (isfs_stat(odd[i]) != linear(odd[i]))
+            printf("lookup of %s: %p, linear %p\n", odd[i], isfs_stat(odd[i]), linear(odd[i]));
+        CHECK(isfs_stat(odd[i]) == linear(odd[i]));
+    }
+    CHECK(isfs_stat(odd[0]) == NULL);
+    CHECK(isfs_stat(odd[1]) == NULL);
+    CHECK(isfs_stat(odd[4]) != NULL);
+    CHECK(isfs_stat(odd[5]) != NULL && isfs_stat(odd[6]) != NULL && isfs_stat(odd[5]) != isfs_stat(odd[6]));
+}
+
+static void test_rebuild(void)
+{
+    build_fst();
+    mount();
+    const char* old_path = "slc:/sys/title/00050011/10000011/meta/title.tik";
+    const char* new_path = "slc:/sys/title/00050011/10000011/meta/renamed";
+    isfs_fst* fst = isfs_stat(old_path);
+    CHECK(fst != NULL);
+    if (!fst)
+        return;
+
+    /* what isfs_load_super() and isfs_commit_super() do on a new FST */
+    fst_name(fst, "renamed");
+    ctx->lookup_valid = false;
+    CHECK(isfs_stat(old_path) == NULL);
+    CHECK(isfs_stat(new_path) == fst);
+
+    /* an FST the index can't take is left to the linear walker */
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u16 tmp = root[0].sub;
+    while (strcmp(root[tmp].name, "tmp"))
+        tmp = root[tmp].sib;
+    root[tmp].sub = ISFS_FST_COUNT + 5;
+    ctx->lookup_valid = false;
+    CHECK(isfs_stat(new_path) == fst);
+    CHECK(!ctx->lookup_valid);
+    root[tmp].sub = 0xFFFF;
+
+    /* and so is a volume without one */
+    u16* lookup = ctx->lookup;
+    ctx->lookup = NULL;
+    CHECK(isfs_stat(new_path) == fst);
+    ctx->lookup = lookup;
+}
+
+static void test_collision(void)
+{
+    build_fst();
+    mount();
+
+    isfs_fst* root = _isfs_get_fst(ctx);
+    u16 tmp = root[0].sub;
+    while (strcmp(root[tmp].name, "tmp"))
+        tmp = root[tmp].sib;
+
+    /* a longer name in the same slot, ahead of "ab" in the probe sequence */
+    char key[12], longer[13], path[32];
+    _isfs_lookup_name(key, "ab", 2);
+    u32 slot = _isfs_lookup_hash(tmp, key);
+    u32 n;
+    for (n = 0; n < 0x1000000; n++) {
+        snprintf(longer, sizeof(longer), "ab%06lx", n);
+        _isfs_lookup_name(key, longer, sizeof(key));
+        if (_isfs_lookup_hash(tmp, key) == slot)
+            break;
+    }
+    CHECK(n < 0x1000000);
+
+    u16 ab = fst_add(tmp, "ab", 0);
+    u16 other = fst_add(tmp, longer, 0);
+    ctx->lookup_valid = false;
+
+    CHECK(isfs_stat("slc:/tmp/ab") == &root[ab]);
+    CHECK(isfs_stat("slc:/tmp/ab") == linear("slc:/tmp/ab"));
+    snprintf(path, sizeof(path), "slc:/tmp/%s", longer);
+    CHECK(isfs_stat(path) == &root[other]);
+    CHECK(isfs_stat("slc:/tmp/a") == NULL);
+}
+
+static void bench(const char* image)
+{
+    if (image) {
+        ctx->super = super;
+        if (isfs_image_load_super(ctx, image))
+            return;
+    } else {
+        build_fst();
+    }
+    mount();
+    collect_paths();
+
+    /* past the volume name, that part is the same for both */
+    int rounds = 20;
+    void* parent;
+    u64 start = hw_wallclock_ns();
+    for (int r = 0; r < rounds; r++)
+        for (u32 i = 0; i < path_count; i++)
+            CHECK(_isfs_find_fst(ctx, paths[i] + 4, &parent) != NULL);
+    double lin = (double)(hw_wallclock_ns() - start) / (rounds * path_count);
+
+    /* the first lookup builds the index, the build is part of the time */
+    ctx->lookup_valid = false;
+    start = hw_wallclock_ns();
+    for (int r = 0; r < rounds; r++)
+        for (u32 i = 0; i < path_count; i++)
+            CHECK(_isfs_find_fst(ctx, paths[i] + 4, NULL) != NULL);
+    double idx = (double)(hw_wallclock_ns() - start) / (rounds * path_count);
+
+    printf("%s, %lu paths: linear %.0f ns, index %.0f ns per lookup, %.1fx\n",
+           image ? image : "synthetic FST", path_count, lin, idx, lin / idx);
+}
+
+int test_main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench(argc > 2 ? argv[2] : NULL);
+        return hw_done("isfs_lookup");
+    }
+
+    test_agree();
+    test_rebuild();
+    test_collision();
+
+    return hw_done("isfs_lookup");
+}
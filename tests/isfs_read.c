@@ -0,0 +1,550 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  isfs_read() on a file backed NAND image, the way isfs.c reads images
+ *  off the SD card, against the one cluster per call loop it replaced.
+ *  The test writes an encrypted SLC image with its ECC and checks what
+ *  comes back for aligned, unaligned and fragmented reads. It also
+ *  checks how the data got there: pages read, the bytes that went
+ *  straight to the caller, and the time on a simulated clock where the
+ *  NAND and the AES engine work in parallel.
+ *  `--bench [slc.raw otp.bin]' reads every file of the volume both ways,
+ *  from a real dump if one is given.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "isfs.c"
+#include "isfs_image.h"
+#include "ff_host.h"
+
+/*
+ * Simulated costs: a page read is tR plus 2112 bytes over the bus, and
+ * the AES engine does about 40 MB/s.
+ */
+#define NAND_PAGE_TICKS     ((HW_TICKS_PER_MS * 60) / 1000)
+#define AES_CLUSTER_TICKS   ((HW_TICKS_PER_MS * 400) / 1000)
+
+otp_t otp;
+otp_t *redotp = NULL;
+rednand_config rednand = { 0 };
+
+int sdcard_read(u32 blk_start, u32 blk_count, void *data)
+{
+    (void)blk_start; (void)blk_count; (void)data;
+    return -1;
+}
+
+/* newlib's device table, nothing to register with here */
+int AddDevice(const devoptab_t *device) { (void)device; return 0; }
+int RemoveDevice(const char *name) { (void)name; return 0; }
+
+static u8 super[ISFSSUPER_SIZE] ALIGNED(NAND_DATA_ALIGN);
+static isfs_ctx* ctx = &isfs[ISFSVOL_SLC];
+static FIL image;
+static char image_path[64];
+
+static const u8 key[16] = {
+    0x6b, 0x69, 0x6e, 0x64, 0x61, 0x20, 0x73, 0x65, 0x63, 0x72, 0x65, 0x74, 0x20, 0x6b, 0x65, 0x79,
+};
+
+/* the caller's buffer, page reads that land in it weren't bounced */
+static const u8* direct_lo;
+static const u8* direct_hi;
+static u64 direct_bytes;
+static u32 page_reads;
+
+static void on_read(const void* buff, u32 len)
+{
+    const u8* p = buff;
+
+    if (len != PAGE_SIZE)
+        return;
+    page_reads++;
+    if (p >= direct_lo && p + len <= direct_hi)
+        direct_bytes += len;
+    hw_advance(NAND_PAGE_TICKS);
+}
+
+/* the AES engine runs next to the NAND: a request is done some time after it was queued */
+static u64 aes_busy_until;
+
+u32 __real_aes_session_submit(aes_session *session, const aes_segment *segs, u32 count);
+void __real_aes_wait(u32 handle);
+
+u32 __wrap_aes_session_submit(aes_session *session, const aes_segment *segs, u32 count)
+{
+    u32 blocks = 0;
+    for (u32 i = 0; i < count; i++)
+        blocks += segs[i].blocks;
+
+    aes_busy_until = max(aes_busy_until, hw_ticks) +
+        (u64)AES_CLUSTER_TICKS * blocks / (CLUSTER_SIZE / ISFSAES_BLOCK_SIZE);
+    return __real_aes_session_submit(session, segs, count);
+}
+
+void __wrap_aes_wait(u32 handle)
+{
+    __real_aes_wait(handle);
+    if (aes_busy_until > hw_ticks)
+        hw_advance(aes_busy_until - hw_ticks);
+}
+
+/* the isfs_read() loop before it merged clusters */
+static int ref_read(isfs_file* file, void* buffer, size_t size, size_t* bytes_read)
+{
+    isfs_ctx* ctx = isfs_get_volume(file->volume);
+    isfs_fst* fst = file->fst;
+
+    if(size + file->offset > fst->size)
+        size = fst->size - file->offset;
+
+    size_t total = size;
+
+    while(size) {
+        size_t pos = file->offset % CLUSTER_SIZE;
+        size_t copy = CLUSTER_SIZE - pos;
+        if(copy > size) copy = size;
+
+        if (isfs_read_volume(ctx, file->cluster, 1, ISFSVOL_FLAG_ENCRYPTED, NULL, slc_cluster_buf) < 0)
+            return -4;
+        memcpy(buffer, slc_cluster_buf + pos, copy);
+
+        file->offset += copy;
+        buffer += copy;
+        size -= copy;
+
+        if((pos + copy) >= CLUSTER_SIZE)
+            file->cluster = _isfs_get_fat(ctx)[file->cluster];
+    }
+
+    *bytes_read = total;
+    return 0;
+}
+
+/* synthetic volume: a contiguous file, a fragmented one and a small one */
+#define BIG_CLUSTERS    256
+#define FRAG_CLUSTERS   96
+#define FRAG_SIZE       (FRAG_CLUSTERS * CLUSTER_SIZE - 1234)
+#define SMALL_SIZE      5000
+
+struct test_file {
+    const char* name;
+    u32 size;
+    u16 fst;
+    u8* data;
+};
+
+static struct test_file files[] = {
+    { "big.bin", BIG_CLUSTERS * CLUSTER_SIZE },
+    { "frag.bin", FRAG_SIZE },
+    { "small.txt", SMALL_SIZE },
+};
+#define FILE_COUNT  (sizeof(files) / sizeof(files[0]))
+
+static void write_cluster(FILE* f, u16 cluster, const u8* plain)
+{
+    static u8 enc[CLUSTER_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    static u8 spare[PAGE_SPARE_SIZE];
+
+    memcpy(enc, plain, CLUSTER_SIZE);
+    aes_reset();
+    aes_set_key((u8*)key);
+    aes_empty_iv();
+    aes_encrypt(enc, enc, CLUSTER_SIZE / ISFSAES_BLOCK_SIZE, 0);
+
+    fseek(f, (long)cluster * CLUSTER_PAGES * (PAGE_SIZE + PAGE_SPARE_SIZE), SEEK_SET);
+    for (u32 p = 0; p < CLUSTER_PAGES; p++) {
+        nand_create_ecc(enc + p * PAGE_SIZE, spare);
+        fwrite(enc + p * PAGE_SIZE, PAGE_SIZE, 1, f);
+        fwrite(spare, PAGE_SPARE_SIZE, 1, f);
+    }
+}
+
+/* puts `clusters' worth of the file at the given clusters, chained in that order */
+static void place(FILE* f, struct test_file* tf, const u16* chain, u32 clusters)
+{
+    u16* fat = _isfs_get_fat(ctx);
+    static u8 plain[CLUSTER_SIZE];
+
+    _isfs_get_fst(ctx)[tf->fst].sub = chain[0];
+    for (u32 i = 0; i < clusters; i++) {
+        memset(plain, 0, sizeof(plain));
+        memcpy(plain, tf->data + i * CLUSTER_SIZE, min(tf->size - i * CLUSTER_SIZE, (u32)CLUSTER_SIZE));
+        write_cluster(f, chain[i], plain);
+        fat[chain[i]] = (i + 1 < clusters) ? chain[i + 1] : FAT_CLUSTER_LAST;
+    }
+}
+
+static void build_image(void)
+{
+    static u16 chain[BIG_CLUSTERS];
+
+    memset(super, 0, sizeof(super));
+    memcpy(super, "SFS!", 4);
+    ctx->super = super;
+    ctx->version = 1;
+    ctx->mounted = true;
+    memcpy(ctx->aes, key, sizeof(key));
+
+    u16* fat = _isfs_get_fat(ctx);
+    for (u32 i = 0; i < CLUSTER_COUNT; i++)
+        fat[i] = FAT_CLUSTER_EMPTY;
+
+    isfs_fst* root = _isfs_get_fst(ctx);
+    root[0].mode = 2;
+    root[0].sub = 1;
+    root[0].sib = 0xFFFF;
+
+    srand(3);
+    for (u32 i = 0; i < FILE_COUNT; i++) {
+        struct test_file* tf = &files[i];
+        tf->fst = 1 + i;
+        tf->data = malloc(tf->size);
+        for (u32 b = 0; b < tf->size; b++)
+            tf->data[b] = rand();
+
+        isfs_fst* fst = &root[tf->fst];
+        memcpy(fst->name, tf->name, strlen(tf->name));
+        fst->mode = 1;
+        fst->size = tf->size;
+        fst->sib = (i + 1 < FILE_COUNT) ? tf->fst + 1 : 0xFFFF;
+    }
+
+    strcpy(image_path, "/tmp/isfs_read.XXXXXX");
+    int fd = mkstemp(image_path);
+    FILE* f = fdopen(fd, "w+b");
+
+    /* contiguous */
+    for (u32 i = 0; i < BIG_CLUSTERS; i++)
+        chain[i] = 0x100 + i;
+    place(f, &files[0], chain, BIG_CLUSTERS);
+
+    /* runs of one to five clusters, every other run taken from the far end */
+    u32 n = 0;
+    for (u32 run = 0, lo = 0x400, hi = 0x500; n < FRAG_CLUSTERS; run++) {
+        u32 len = min(1 + run % 5, FRAG_CLUSTERS - n);
+        u32 start = (run & 1) ? (hi -= len + 1) : lo;
+        if (!(run & 1))
+            lo += len + 1;
+        for (u32 i = 0; i < len; i++)
+            chain[n++] = start + i;
+    }
+    place(f, &files[1], chain, FRAG_CLUSTERS);
+
+    chain[0] = 0x300;
+    place(f, &files[2], chain, 1);
+
+    fclose(f);
+    CHECK(f_open(&image, image_path, FA_READ) == FR_OK);
+    ctx->file = &image;
+    ff_host_on_read = on_read;
+}
+
+static void open_file(isfs_file* file, u16 fst)
+{
+    memset(file, 0, sizeof(*file));
+    file->volume = ctx->volume;
+    file->fst = &_isfs_get_fst(ctx)[fst];
+    file->cluster = file->fst->sub;
+}
+
+static void start(const void* dst, u32 len)
+{
+    _isfs_cache_invalidate(ctx);
+    direct_lo = dst;
+    direct_hi = (const u8*)dst + len;
+    direct_bytes = 0;
+    page_reads = 0;
+    aes_busy_until = hw_ticks;
+}
+
+static u8 buf[BIG_CLUSTERS * CLUSTER_SIZE + 64] ALIGNED(NAND_DATA_ALIGN);
+
+static void test_contents(void)
+{
+    size_t got;
+
+    for (u32 i = 0; i < FILE_COUNT; i++) {
+        struct test_file* tf = &files[i];
+        isfs_file file;
+
+        /* aligned, in one go */
+        open_file(&file, tf->fst);
+        memset(buf, 0, tf->size);
+        CHECK(isfs_read(&file, buf, tf->size + 100, &got) == 0 && got == tf->size);
+        CHECK(!memcmp(buf, tf->data, tf->size));
+
+        /* unaligned buffer */
+        open_file(&file, tf->fst);
+        memset(buf, 0, tf->size + 1);
+        CHECK(isfs_read(&file, buf + 1, tf->size, &got) == 0 && got == tf->size);
+        CHECK(!memcmp(buf + 1, tf->data, tf->size));
+
+        /* in odd pieces, crossing clusters and runs */
+        open_file(&file, tf->fst);
+        memset(buf, 0, tf->size);
+        u32 done = 0;
+        for (u32 step = 100; done < tf->size; step = step * 7 % 50000 + 1) {
+            CHECK(isfs_read(&file, buf + done, step, &got) == 0);
+            done += got;
+        }
+        CHECK(done == tf->size && !memcmp(buf, tf->data, tf->size));
+
+        /* from the middle of a cluster, then a cluster aligned bulk read */
+        open_file(&file, tf->fst);
+        u32 from = min(tf->size, (u32)(CLUSTER_SIZE * 3 + 77));
+        CHECK(isfs_seek(&file, from, SEEK_SET) == 0);
+        u32 head = min(tf->size - from, (u32)(CLUSTER_SIZE - 77));
+        CHECK(isfs_read(&file, buf, head, &got) == 0 && got == head);
+        CHECK(isfs_read(&file, buf + head, tf->size, &got) == 0 && got == tf->size - from - head);
+        CHECK(!memcmp(buf, tf->data + from, tf->size - from));
+        isfs_close(&file);
+    }
+}
+
+struct result {
+    u64 ticks;
+    u64 ns;
+    u32 pages;
+    u64 direct;
+};
+
+static struct result read_all(int (*read)(isfs_file*, void*, size_t, size_t*), const struct test_file* tf, u8* dst)
+{
+    isfs_file file;
+    size_t got = 0;
+    struct result r;
+
+    open_file(&file, tf->fst);
+    start(dst, tf->size);
+
+    u64 ticks = hw_ticks;
+    u64 ns = hw_wallclock_ns();
+    CHECK(read(&file, dst, tf->size, &got) == 0 && got == tf->size);
+    r.ns = hw_wallclock_ns() - ns;
+    r.ticks = hw_ticks - ticks;
+    r.pages = page_reads;
+    r.direct = direct_bytes;
+
+    CHECK(!memcmp(dst, tf->data, tf->size));
+    isfs_close(&file);
+    return r;
+}
+
+static void test_merged(void)
+{
+    for (u32 i = 0; i < 2; i++) {
+        const struct test_file* tf = &files[i];
+        u32 clusters = (tf->size + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+        struct result ref = read_all(ref_read, tf, buf);
+        struct result cur = read_all(isfs_read, tf, buf);
+
+        /* every page once, both ways */
+        CHECK(ref.pages == clusters * CLUSTER_PAGES);
+        CHECK(cur.pages == clusters * CLUSTER_PAGES);
+
+        /* the whole clusters land in the caller's buffer, only the tail is bounced */
+        CHECK(ref.direct == 0);
+        CHECK(cur.direct == (u64)(tf->size / CLUSTER_SIZE) * CLUSTER_SIZE);
+
+        /*
+         * One cluster per call waits for the AES after every cluster, a run
+         * decrypts one cluster while the NAND reads the next: close to the
+         * NAND time alone, plus the decryption at the end of every run.
+         */
+        u64 nand = (u64)clusters * CLUSTER_PAGES * NAND_PAGE_TICKS;
+        CHECK(ref.ticks >= nand + clusters * AES_CLUSTER_TICKS);
+        if (i == 0)
+            CHECK(cur.ticks < nand + AES_CLUSTER_TICKS + HW_TICKS_PER_MS);
+        CHECK(cur.ticks * 10 < ref.ticks * 8);
+    }
+}
+
+/* seeks land on the right cluster, through the link map or the FAT */
+static void check_seeks(isfs_file* file, const struct test_file* tf)
+{
+    size_t got;
+
+    for (u32 i = 0; i < 40; i++) {
+        u32 to = (i * 2654435761u) % tf->size;
+        CHECK(isfs_seek(file, to, SEEK_SET) == 0);
+        CHECK(isfs_read(file, buf, 300, &got) == 0 && got == min(300u, tf->size - to));
+        CHECK(!memcmp(buf, tf->data + to, got));
+    }
+}
+
+static void test_seek(void)
+{
+    static u16 clmt[128];
+    isfs_file file;
+
+    /* one run fits the pooled map */
+    open_file(&file, files[0].fst);
+    check_seeks(&file, &files[0]);
+    CHECK(file.clmt_valid && file.clmt_pooled && file.clmt[0] == 1);
+    isfs_close(&file);
+
+    /*
+     * Too many runs: the slot goes back to the pool and the file remembers,
+     * later seeks walk the FAT without building the map again.
+     */
+    open_file(&file, files[1].fst);
+    CHECK(isfs_seek(&file, 0, SEEK_SET) == 0);
+    CHECK(file.clmt_failed && !file.clmt_valid && !file.clmt);
+    for (u32 i = 0; i < ISFS_CLMT_POOL; i++)
+        CHECK(!isfs_clmt_used[i]);
+    /* another attempt would scribble runs over the pool before giving up */
+    memset(isfs_clmt_pool, 0xA5, sizeof(isfs_clmt_pool));
+    check_seeks(&file, &files[1]);
+    CHECK(file.clmt_failed && !file.clmt);
+    u32 touched = 0;
+    for (u32 i = 0; i < sizeof(isfs_clmt_pool); i++)
+        touched += ((u8*)isfs_clmt_pool)[i] != 0xA5;
+    CHECK(touched == 0);
+
+    /* a buffer of the caller's that is big enough gets another go */
+    CHECK(isfs_set_clmt(&file, clmt, sizeof(clmt) / sizeof(clmt[0])) == 0);
+    CHECK(!file.clmt_failed);
+    check_seeks(&file, &files[1]);
+    CHECK(file.clmt_valid && file.clmt == clmt && clmt[0] > (ISFS_CLMT_ENTRIES - 1) / 2);
+    isfs_close(&file);
+}
+
+/* a cut off image fails the read, even without an HMAC to catch the garbage */
+static void test_truncated(void)
+{
+    static u8 cluster[CLUSTER_SIZE] ALIGNED(NAND_DATA_ALIGN);
+    const long page = PAGE_SIZE + PAGE_SPARE_SIZE;
+    isfs_file file;
+    size_t got;
+
+    CHECK(isfs_read_volume(ctx, 0x300, 1, ISFSVOL_FLAG_ENCRYPTED, NULL, cluster) == ISFSVOL_OK);
+
+    /* the small file's cluster ends in the middle of its fourth page */
+    CHECK(truncate(image_path, (0x300 * CLUSTER_PAGES + 3) * page + 100) == 0);
+    _isfs_cache_invalidate(ctx);
+    CHECK(isfs_read_volume(ctx, 0x300, 1, ISFSVOL_FLAG_ENCRYPTED, NULL, cluster) == ISFSVOL_ERROR_READ);
+
+    open_file(&file, files[2].fst);
+    CHECK(isfs_read(&file, buf, SMALL_SIZE, &got) == -4);
+    isfs_close(&file);
+}
+
+static void bench_file(const char* name, const struct test_file* tf, u8* dst, struct result* sum)
+{
+    struct result ref = read_all(ref_read, tf, dst);
+    struct result cur = read_all(isfs_read, tf, dst);
+
+    if (name)
+        printf("%-12s %8lu bytes: simulated %.1f -> %.1f ms, host %.2f -> %.2f ms, %lu%% direct\n",
+               name, tf->size, (double)ref.ticks / HW_TICKS_PER_MS, (double)cur.ticks / HW_TICKS_PER_MS,
+               ref.ns / 1e6, cur.ns / 1e6, tf->size ? (u32)(cur.direct * 100 / tf->size) : 100);
+
+    sum[0].ticks += ref.ticks;
+    sum[0].ns += ref.ns;
+    sum[1].ticks += cur.ticks;
+    sum[1].ns += cur.ns;
+}
+
+static void bench_report(u64 bytes, const struct result* sum)
+{
+    if (!bytes) {
+        printf("no files read\n");
+        return;
+    }
+    printf("%lu MiB: simulated %.1f -> %.1f ms (%.2fx), host %.1f -> %.1f ms (%.2fx)\n",
+           (u32)(bytes >> 20), (double)sum[0].ticks / HW_TICKS_PER_MS, (double)sum[1].ticks / HW_TICKS_PER_MS,
+           (double)sum[0].ticks / sum[1].ticks, sum[0].ns / 1e6, sum[1].ns / 1e6, (double)sum[0].ns / sum[1].ns);
+}
+
+/* every file of a real SLC dump, keyed with the console's OTP */
+static int bench_dump(const char* slc, const char* otp_name)
+{
+    FILE* f = fopen(otp_name, "rb");
+    if (!f || fread(&otp, sizeof(otp), 1, f) != 1) {
+        printf("%s: can't read the OTP\n", otp_name);
+        if (f) fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    ctx->super = super;
+    if (isfs_image_load_super(ctx, slc) || isfs_load_keys(ctx))
+        return -1;
+    if (f_open(&image, slc, FA_READ) != FR_OK)
+        return -1;
+    ctx->file = &image;
+    ff_host_on_read = on_read;
+
+    isfs_fst* root = _isfs_get_fst(ctx);
+    struct result sum[2] = {0};
+    u64 bytes = 0;
+    u8* dst = memalign(NAND_DATA_ALIGN, CLUSTER_COUNT * CLUSTER_SIZE / 64);
+
+    for (u16 i = 1; i < ISFS_FST_COUNT; i++) {
+        if (!_isfs_fst_is_file(&root[i]) || !root[i].size || root[i].sub >= FAT_CLUSTER_LAST)
+            continue;
+        if (root[i].size > CLUSTER_COUNT * CLUSTER_SIZE / 64)
+            continue;
+
+        struct test_file tf = { .size = root[i].size, .fst = i };
+        tf.data = malloc(tf.size);
+        isfs_file file;
+        size_t got;
+        open_file(&file, i);
+        if (ref_read(&file, tf.data, tf.size, &got)) {
+            free(tf.data);
+            continue;
+        }
+        bench_file(NULL, &tf, dst, sum);
+        bytes += tf.size;
+        free(tf.data);
+    }
+    bench_report(bytes, sum);
+
+    free(dst);
+    f_close(&image);
+    return 0;
+}
+
+static void bench(void)
+{
+    struct result sum[2] = {0};
+    u64 bytes = 0;
+
+    for (u32 i = 0; i < FILE_COUNT; i++) {
+        bench_file(files[i].name, &files[i], buf, sum);
+        bytes += files[i].size;
+    }
+    bench_report(bytes, sum);
+}
+
+int test_main(int argc, char **argv)
+{
+    if (argc > 3 && !strcmp(argv[1], "--bench")) {
+        bench_dump(argv[2], argv[3]);
+        return hw_done("isfs_read");
+    }
+
+    build_image();
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench();
+    } else {
+        test_contents();
+        test_merged();
+        test_seek();
+        test_truncated();
+    }
+
+    f_close(&image);
+    unlink(image_path);
+    return hw_done("isfs_read");
+}
@@ -0,0 +1,182 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  The word-at-a-time NAND ECC in nand.c against the bit-by-bit reference
+ *  it replaced, over random pages. `--bench' times the two.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nand.c"
+
+
+/* the original nand_create_ecc(), bit exact with the controller */
+static u8 ref_parity(u8 x)
+{
+    u8 y = 0;
+    while (x)
+    {
+        y ^= (x & 1);
+        x >>= 1;
+    }
+    return y;
+}
+
+static void ref_create_ecc(void* in_data, void* spare_out)
+{
+    u8 a[12][2];
+    u32 a0, a1;
+    u8 x;
+
+    u8* spare_buf = PTR_OFFS(spare_out, 0x0);
+    memset(spare_buf, 0, 0x40);
+    spare_buf[0] = 0xFF;
+
+    u8* ecc = PTR_OFFS(spare_out, 0x30);
+    const u8* data = (u8*)in_data;
+
+    for (int k = 0; k < 4; k++)
+    {
+        memset(a, 0, sizeof(a));
+        for (int i = 0; i < 0x200; i++)
+        {
+            x = data[i];
+            for (int j = 0; j < 9; j++)
+                a[3 + j][(i >> j) & 1] ^= x;
+        }
+
+        x = a[3][0] ^ a[3][1];
+        a[0][0] = x & 0x55;
+        a[0][1] = x & 0xaa;
+        a[1][0] = x & 0x33;
+        a[1][1] = x & 0xcc;
+        a[2][0] = x & 0x0f;
+        a[2][1] = x & 0xf0;
+
+        for (int j = 0; j < 12; j++)
+        {
+            a[j][0] = ref_parity(a[j][0]);
+            a[j][1] = ref_parity(a[j][1]);
+        }
+        a0 = a1 = 0;
+
+        for (int j = 0; j < 12; j++)
+        {
+            a0 |= a[j][0] << j;
+            a1 |= a[j][1] << j;
+        }
+        ecc[0] = a0;
+        ecc[1] = a0 >> 8;
+        ecc[2] = a1;
+        ecc[3] = a1 >> 8;
+
+        data += 512;
+        ecc += 4;
+    }
+}
+
+static u8 page[PAGE_SIZE + 4] ALIGNED(32);
+static u8 spare[0x80];
+
+/* random, erased and mostly zero pages, the last two hit the corner cases */
+static void fill_page(u8 *d, int it)
+{
+    for (int i = 0; i < PAGE_SIZE; i++) {
+        switch (it % 3) {
+            case 0: d[i] = rand(); break;
+            case 1: d[i] = 0xFF; break;
+            case 2: d[i] = (rand() % 50) ? 0 : rand(); break;
+        }
+    }
+}
+
+static void test_agree(void)
+{
+    static u8 s1[0x40], s2[0x40];
+    int bad = 0;
+
+    srand(1);
+    for (int it = 0; it < 20000; it++) {
+        /* the unaligned pages take the byte loop */
+        u8 *d = page + (it & 3);
+
+        fill_page(d, it);
+        ref_create_ecc(d, s1);
+        nand_create_ecc(d, s2);
+        if (memcmp(s1, s2, sizeof(s1)) && bad++ < 5)
+            printf("ECC mismatch, page %d at offset %d\n", it, it & 3);
+    }
+    CHECK(bad == 0);
+}
+
+static void test_correct(void)
+{
+    static u8 orig[PAGE_SIZE];
+
+    srand(2);
+    for (int it = 0; it < 200; it++) {
+        fill_page(page, it * 3);
+        memcpy(orig, page, PAGE_SIZE);
+        nand_create_ecc(page, spare);
+
+        /* one flipped bit per sector gets fixed */
+        for (int s = 0; s < 4; s++) {
+            u32 bit = rand() % (0x200 * 8);
+            page[s * 0x200 + bit / 8] ^= 1 << (bit & 7);
+        }
+        CHECK(nand_correct_sw(it, page, spare) == NAND_ECC_CORRECTED);
+        CHECK(!memcmp(page, orig, PAGE_SIZE));
+
+        /* two can only be detected */
+        page[0x10] ^= 0x01;
+        page[0x20] ^= 0x80;
+        CHECK(nand_correct_sw(it, page, spare) == NAND_ECC_UNCORRECTABLE);
+        memcpy(page, orig, PAGE_SIZE);
+
+        /* so can a bit flipped in the stored ECC, the data stays */
+        spare[0x30 + (it & 15)] ^= 1 << (it & 7);
+        CHECK(nand_correct_sw(it, page, spare) == NAND_ECC_CORRECTED);
+        CHECK(!memcmp(page, orig, PAGE_SIZE));
+    }
+}
+
+static double bench_one(void (*fn)(void *, void *), int pages)
+{
+    u64 start = hw_wallclock_ns();
+
+    for (int i = 0; i < pages; i++) {
+        page[i & 0x7ff] ^= i;
+        fn(page, spare);
+    }
+    u64 ns = hw_wallclock_ns() - start;
+    return (double)pages * PAGE_SIZE / ns * 1e9 / (1024 * 1024);
+}
+
+static void bench(void)
+{
+    fill_page(page, 0);
+
+    double ref = bench_one(ref_create_ecc, 20000);
+    double cur = bench_one(nand_create_ecc, 200000);
+
+    printf("nand_create_ecc: bit-by-bit %.1f MiB/s, nand.c %.1f MiB/s, %.1fx\n",
+        ref, cur, cur / ref);
+}
+
+int test_main(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        bench();
+        return 0;
+    }
+
+    test_agree();
+    test_correct();
+
+    return hw_done("nand_ecc");
+}
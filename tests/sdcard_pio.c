@@ -0,0 +1,152 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  sdcard.c as boot1 builds it: no buffer is DMA reachable, so everything
+ *  goes by PIO. A batch like ancast_load() reads has to go out as a few
+ *  multi-block commands, not a command per sector, and a card that fails
+ *  them drops to single blocks and gets probed again later.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+/* boot1's gfx.h turns printf into a no-op, keep that to sdcard.c so CHECK still reports */
+#define printf sdcard_printf
+#include "sdcard.c"
+#undef printf
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdhc_sim.h"
+
+#define CARD_BLOCKS     8192
+#define BATCH           (0x100000 / SDMMC_DEFAULT_BLOCKLEN)
+#define US(x)           ((u64)(x) * HW_TICKS_PER_MS / 1000)
+
+static u8 image[CARD_BLOCKS * 512] ALIGNED(32);
+static u8 buf[BATCH * 512] ALIGNED(32);
+
+static struct sdhc_sim sim;
+
+static void test_attach(struct sdhc_host *hp) { (void)hp; }
+
+/* a card that's been through sdcard_needs_discover() */
+static void setup(void)
+{
+    struct sdhc_host_params params = {
+        .attach = &test_attach,
+        .abort = &sdcard_abort,
+        .rb = RB_SD0,
+        .wb = WB_SD0,
+        .irq_mask_reg = LT_INTMR_AHBALL_ARM,
+        .irq_status_reg = LT_INTSR_AHBALL_ARM,
+        .irq_flag = IRQF_SD0,
+    };
+
+    hw_reset();
+    sdhc_sim_init(&sim, image, CARD_BLOCKS);
+    hw_set_irq_handler(IRQ_SD0, sdcard_irq);
+    sdhc_host_found(&sdcard_host, &params, 0, SDHC_SIM_BASE, 1);
+    irq_enable(IRQ_SD0);
+
+    memset(&card, 0, sizeof(card));
+    card.handle = &sdcard_host;
+    card.inserted = 1;
+    card.selected = 1;
+    card.sdhc_blockmode = 1;
+    card.num_sectors = CARD_BLOCKS;
+    /* sdcard_reset_stats() isn't in boot1 */
+    memset(sdcard_pio_rec, 0, sizeof(sdcard_pio_rec));
+    _sdcard_recovery_reset();
+
+    for (u32 i = 0; i < sizeof(image); i += 4)
+        *(u32 *)(image + i) = i * 2654435761u;
+
+    /* a command costs 100us before any data moves, a block 20us */
+    sim.cmd_latency = US(100);
+    sim.block_latency = US(20);
+}
+
+static u64 read_batch(u32 blk)
+{
+    memset(buf, 0, sizeof(buf));
+    sim.pio_commands = 0;
+
+    u64 start = hw_ticks;
+    CHECK(sdcard_read(blk, BATCH, buf) == 0);
+    CHECK(!memcmp(buf, image + blk * 512, sizeof(buf)));
+    return hw_ticks - start;
+}
+
+static void test_batch(void)
+{
+    setup();
+
+    /* 1 MiB in 256 block commands, straight into the caller's buffer */
+    u64 multi = read_batch(16);
+    CHECK(sim.pio_commands == BATCH / SDHC_CMD_BLOCK_COUNT_MAX);
+    CHECK(sim.data_commands == sim.pio_commands);
+
+    /* what boot1 did before: a command per sector */
+    sdcard_pio_rec[SDCARD_DIR_READ].mode = SDCARD_PIO_SINGLE;
+    sdcard_pio_rec[SDCARD_DIR_READ].countdown = ~0;
+    u64 single = read_batch(16);
+    CHECK(sim.pio_commands == BATCH);
+
+    /* every command saved is 100us saved */
+    CHECK(single - multi >= (BATCH - BATCH / SDHC_CMD_BLOCK_COUNT_MAX) * US(100));
+    printf("boot1 1 MiB batch: %u commands %.1f ms, single sectors %.1f ms\n",
+           BATCH / SDHC_CMD_BLOCK_COUNT_MAX, (double)multi / HW_TICKS_PER_MS, (double)single / HW_TICKS_PER_MS);
+}
+
+static void test_write(void)
+{
+    setup();
+
+    /* 300 blocks: one full command and the rest */
+    for (u32 i = 0; i < 300 * 512; i++)
+        buf[i] = i * 7;
+    sim.pio_commands = 0;
+    CHECK(sdcard_write(100, 300, buf) == 0);
+    CHECK(sim.pio_commands == 2);
+    CHECK(!memcmp(image + 100 * 512, buf, 300 * 512));
+}
+
+static void test_fallback(void)
+{
+    setup();
+    sdcard_recovery *rec = &sdcard_pio_rec[SDCARD_DIR_READ];
+
+    /* the first multi-block command fails: single blocks until the backoff ran out, then a probe */
+    sim.pio_fail = 1;
+    sim.pio_commands = 0;
+    memset(buf, 0, sizeof(buf));
+    CHECK(sdcard_read(0, 64, buf) == 0);
+    CHECK(!memcmp(buf, image, 64 * 512));
+
+    u32 backoff = SDCARD_BACKOFF_MIN * 2;
+    CHECK(sim.pio_commands == 1 + backoff + 1);
+    CHECK(rec->mode == SDCARD_PIO_MULTI);
+    CHECK(rec->stats[SDCARD_PIO_MULTI].errors == 1);
+    CHECK(rec->stats[SDCARD_PIO_SINGLE].cmds == backoff);
+
+    /* and stays there: a whole batch in full size commands again */
+    sim.pio_commands = 0;
+    CHECK(sdcard_read(0, BATCH, buf) == 0);
+    CHECK(!memcmp(buf, image, sizeof(buf)));
+    CHECK(sim.pio_commands == BATCH / SDHC_CMD_BLOCK_COUNT_MAX);
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_batch();
+    test_write();
+    test_fallback();
+
+    return hw_done("sdcard_pio");
+}
@@ -0,0 +1,188 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  Pre-declared multi-block writes against a simulated card that takes
+ *  longer over open-ended ones: ACMD23 and CMD23 have to go out ahead of
+ *  the write and take the auto-CMD12 with them, a card that fails CMD23
+ *  gets open-ended writes until the backoff ran out and is asked again.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdcard.c"
+#include "sdhc_sim.h"
+
+#define CARD_BLOCKS     8192
+#define WRITE_BLOCKS    128
+#define US(x)           ((u64)(x) * HW_TICKS_PER_MS / 1000)
+
+#define ACMD(op)        ((op) | SDHC_SIM_ACMD)
+
+static u8 image[CARD_BLOCKS * 512] ALIGNED(32);
+static u8 buf[WRITE_BLOCKS * 512] ALIGNED(32);
+
+static struct sdhc_sim sim;
+
+static void test_attach(struct sdhc_host *hp) { (void)hp; }
+
+/* a card that's been through sdcard_needs_discover() and says it has CMD23 */
+static void setup(void)
+{
+    struct sdhc_host_params params = {
+        .attach = &test_attach,
+        .abort = &sdcard_abort,
+        .rb = RB_SD0,
+        .wb = WB_SD0,
+        .irq_mask_reg = LT_INTMR_AHBALL_ARM,
+        .irq_status_reg = LT_INTSR_AHBALL_ARM,
+        .irq_flag = IRQF_SD0,
+    };
+
+    hw_reset();
+    sdhc_sim_init(&sim, image, CARD_BLOCKS);
+    hw_set_irq_handler(IRQ_SD0, sdcard_irq);
+    sdhc_host_found(&sdcard_host, &params, 0, SDHC_SIM_BASE, 1);
+    irq_enable(IRQ_SD0);
+
+    memset(&card, 0, sizeof(card));
+    card.handle = &sdcard_host;
+    card.inserted = 1;
+    card.selected = 1;
+    card.sdhc_blockmode = 1;
+    card.num_sectors = CARD_BLOCKS;
+    card.cmd23 = 1;
+    sdcard_reset_stats();
+    _sdcard_recovery_reset();
+    sdcard_set_predef(1);
+
+    sim.cmd_latency = US(100);
+    sim.block_latency = US(20);
+}
+
+static int write_fill(u32 blk, u32 count, u8 seed)
+{
+    for (u32 i = 0; i < count * 512; i++)
+        buf[i] = seed + i * 13;
+    sim.log_len = 0;
+
+    int res = sdcard_write(blk, count, buf);
+    CHECK(!memcmp(image + blk * 512, buf, count * 512));
+    return res;
+}
+
+/* the log of the last write has exactly `n' commands, these */
+static int logged(u32 n, const u32 *want)
+{
+    return sim.log_len == n && !memcmp(sim.log, want, n * sizeof(*want));
+}
+
+static void test_sequence(void)
+{
+    setup();
+
+    /* ACMD23, CMD23, then the write with the count and without the auto-CMD12 */
+    static const u32 predef[] = {
+        MMC_APP_CMD, ACMD(SD_APP_SET_WR_BLK_ERASE_COUNT), MMC_SET_BLOCK_COUNT,
+        MMC_WRITE_BLOCK_MULTIPLE | SDHC_SIM_COUNTED,
+    };
+    CHECK(write_fill(64, WRITE_BLOCKS, 1) == 0);
+    CHECK(logged(4, predef));
+    CHECK(sim.last_arg == 64);
+
+    /* a single block has nothing to announce */
+    static const u32 single[] = { MMC_WRITE_BLOCK_SINGLE };
+    CHECK(write_fill(300, 1, 2) == 0);
+    CHECK(logged(1, single));
+
+    /* a card without CMD23 still gets its pre-erase, the host sends the stop */
+    static const u32 erase[] = {
+        MMC_APP_CMD, ACMD(SD_APP_SET_WR_BLK_ERASE_COUNT),
+        MMC_WRITE_BLOCK_MULTIPLE | SDHC_SIM_AUTO_CMD12,
+    };
+    card.cmd23 = 0;
+    CHECK(write_fill(400, 16, 3) == 0);
+    CHECK(logged(3, erase));
+    card.cmd23 = 1;
+
+    /* turned off it's the old open-ended write */
+    static const u32 open[] = { MMC_WRITE_BLOCK_MULTIPLE | SDHC_SIM_AUTO_CMD12 };
+    sdcard_set_predef(0);
+    CHECK(write_fill(500, 16, 4) == 0);
+    CHECK(logged(1, open));
+}
+
+static void test_cmd23_fail(void)
+{
+    setup();
+    sdcard_recovery *rec = &sdcard_predef_rec;
+
+    /* CMD23 fails: the write still goes out, open-ended */
+    static const u32 failed[] = {
+        MMC_APP_CMD, ACMD(SD_APP_SET_WR_BLK_ERASE_COUNT), MMC_SET_BLOCK_COUNT,
+        MMC_WRITE_BLOCK_MULTIPLE | SDHC_SIM_AUTO_CMD12,
+    };
+    sim.cmd23_fail = 1;
+    CHECK(write_fill(0, 32, 5) == 0);
+    CHECK(logged(4, failed));
+    CHECK(rec->mode == SDCARD_PREDEF_OFF);
+    CHECK(rec->stats[SDCARD_PREDEF_ON].errors == 1);
+
+    /* open-ended until the backoff ran out, the write that fell back counts towards it */
+    static const u32 open[] = { MMC_WRITE_BLOCK_MULTIPLE | SDHC_SIM_AUTO_CMD12 };
+    u32 backoff = SDCARD_BACKOFF_MIN * 2;
+    for (u32 i = 1; i < backoff; i++) {
+        CHECK(write_fill(32 * i, 32, 5 + i) == 0);
+        CHECK(logged(1, open));
+    }
+
+    /* then asked again, and it works */
+    static const u32 probe[] = {
+        MMC_APP_CMD, ACMD(SD_APP_SET_WR_BLK_ERASE_COUNT), MMC_SET_BLOCK_COUNT,
+        MMC_WRITE_BLOCK_MULTIPLE | SDHC_SIM_COUNTED,
+    };
+    CHECK(write_fill(32 * backoff, 32, 0x55) == 0);
+    CHECK(logged(4, probe));
+    CHECK(rec->mode == SDCARD_PREDEF_ON);
+}
+
+static u64 time_writes(int predef)
+{
+    sdcard_set_predef(predef);
+    u64 start = hw_ticks;
+    for (u32 i = 0; i < CARD_BLOCKS / WRITE_BLOCKS; i++)
+        CHECK(write_fill(i * WRITE_BLOCKS, WRITE_BLOCKS, i) == 0);
+    return hw_ticks - start;
+}
+
+static void test_throughput(void)
+{
+    setup();
+
+    /* the card spends 1ms on an open-ended write it saves with the count up front */
+    sim.open_write_latency = US(1000);
+
+    u64 open = time_writes(0);
+    u64 predef = time_writes(1);
+    CHECK(predef < open);
+
+    double mb = (double)CARD_BLOCKS * 512 / (1024 * 1024);
+    printf("%u block writes: open-ended %.1f MiB/s, pre-declared %.1f MiB/s\n", WRITE_BLOCKS,
+           mb * 1000 * HW_TICKS_PER_MS / open, mb * 1000 * HW_TICKS_PER_MS / predef);
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_sequence();
+    test_cmd23_fail();
+    test_throughput();
+
+    return hw_done("sdcard_predef");
+}
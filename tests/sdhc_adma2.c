@@ -0,0 +1,205 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  sdhc_adma2_build() and the ADMA2/SDMA transfer paths of sdhc.c against
+ *  the simulated host controller.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdhc.c"
+#include "sdhc_sim.h"
+
+#define CARD_BLOCKS     4096
+
+static u8 card[CARD_BLOCKS * 512] ALIGNED(32);
+static u8 buf[0x40000] ALIGNED(32);
+
+static struct sdhc_sim sim;
+static struct sdhc_host host;
+static int attached, aborted;
+
+static void test_attach(struct sdhc_host *hp) { (void)hp; attached++; }
+static void test_abort(void) { aborted++; }
+
+/* what sdcard_irq() does */
+static void test_sd0_irq(void)
+{
+    sdhc_intr(&host);
+}
+
+static void fill(u8 *p, u32 len, u32 seed)
+{
+    for (u32 i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        p[i] = seed >> 16;
+    }
+}
+
+static void setup(void)
+{
+    struct sdhc_host_params params = {
+        .attach = &test_attach,
+        .abort = &test_abort,
+        .rb = RB_SD0,
+        .wb = WB_SD0,
+        .irq_mask_reg = LT_INTMR_AHBALL_ARM,
+        .irq_status_reg = LT_INTSR_AHBALL_ARM,
+        .irq_flag = IRQF_SD0,
+    };
+
+    hw_reset();
+    fill(card, sizeof(card), 1);
+    sdhc_sim_init(&sim, card, CARD_BLOCKS);
+    hw_set_irq_handler(IRQ_SD0, test_sd0_irq);
+
+    sdhc_host_found(&host, &params, 0, SDHC_SIM_BASE, 1);
+    irq_enable(IRQ_SD0);
+}
+
+static int run(u32 opcode, u32 blk, void *data, u32 len)
+{
+    struct sdmmc_command cmd = {0};
+
+    cmd.c_opcode = opcode;
+    cmd.c_arg = blk;
+    cmd.c_data = data;
+    cmd.c_datalen = len;
+    cmd.c_blklen = 512;
+    cmd.c_flags = SCF_CMD_ADTC | SCF_RSP_R1;
+    if (opcode == MMC_READ_BLOCK_MULTIPLE)
+        cmd.c_flags |= SCF_CMD_READ;
+
+    sdhc_exec_command(&host, &cmd);
+    return cmd.c_error;
+}
+
+static void test_build(void)
+{
+    struct sdhc_adma2_desc table[8];
+    int n;
+
+    /* a small buffer, one descriptor */
+    n = sdhc_adma2_build(table, 8, buf, 0x200);
+    CHECK(n == 1);
+    CHECK(table[0].attr == (SDHC_ADMA2_VALID | SDHC_ADMA2_ACT_TRAN | SDHC_ADMA2_END));
+    CHECK(table[0].len == 0x200);
+    CHECK(table[0].addr == hw_ptr32(buf));
+
+    /* longer than a descriptor takes: split, END only on the last */
+    n = sdhc_adma2_build(table, 8, buf, 0x14000);
+    CHECK(n == 3);
+    CHECK(table[0].len == 0x8000 && table[1].len == 0x8000 && table[2].len == 0x4000);
+    CHECK(table[1].addr == hw_ptr32(buf) + 0x8000);
+    CHECK(table[2].addr == hw_ptr32(buf) + 0x10000);
+    CHECK(!(table[0].attr & SDHC_ADMA2_END) && !(table[1].attr & SDHC_ADMA2_END));
+    CHECK(table[2].attr & SDHC_ADMA2_END);
+
+    /* a word past a full descriptor */
+    n = sdhc_adma2_build(table, 8, buf + 0x1000, 0x8004);
+    CHECK(n == 2);
+    CHECK(table[0].addr == hw_ptr32(buf) + 0x1000 && table[0].len == 0x8000);
+    CHECK(table[1].addr == hw_ptr32(buf) + 0x9000 && table[1].len == 4);
+    CHECK(table[1].attr & SDHC_ADMA2_END);
+
+    /* what the 32-bit engine can't do */
+    CHECK(sdhc_adma2_build(table, 8, buf + 2, 0x200) == -1);
+    CHECK(sdhc_adma2_build(table, 8, buf, 0x202) == -1);
+    CHECK(sdhc_adma2_build(table, 8, buf, 0) == -1);
+
+    /* too many descriptors */
+    CHECK(sdhc_adma2_build(table, 8, buf, 0x8000 * 8 + 4) == -2);
+    CHECK(sdhc_adma2_build(table, 8, buf, 0x8000 * 8) == 8);
+}
+
+static void test_attach_caps(void)
+{
+    setup();
+    CHECK(attached == 1);
+    CHECK(ISSET(host.flags, SHF_USE_ADMA2));
+    CHECK(host.adma_table != NULL);
+    CHECK(sdhc_max_block_count(&host) == SDHC_ADMA_BLOCK_COUNT_MAX);
+}
+
+static void test_adma2_read(void)
+{
+    /* more than SDMA takes in one command */
+    u32 len = 0x21400;
+
+    setup();
+    memset(buf, 0, sizeof(buf));
+
+    CHECK(run(MMC_READ_BLOCK_MULTIPLE, 100, buf, len) == 0);
+    CHECK(sim.last_adma);
+    CHECK(sim.last_opcode == MMC_READ_BLOCK_MULTIPLE);
+    CHECK(sim.last_arg == 100);
+    CHECK(sim.last_blocks == len / 512);
+    CHECK(sim.descriptors == 5);
+    CHECK(sim.adma_errors == 0);
+    CHECK((HREAD1(&host, SDHC_HOST_CTL) & SDHC_DMA_SELECT_MASK) == SDHC_DMA_SELECT_ADMA2);
+    CHECK(HREAD4(&host, SDHC_ADMA_SYSTEM_ADDR) == hw_ptr32(host.adma_table));
+
+    CHECK(!memcmp(buf, card + 100 * 512, len));
+}
+
+static void test_adma2_write(void)
+{
+    setup();
+    fill(buf, sizeof(buf), 2);
+
+    CHECK(run(MMC_WRITE_BLOCK_MULTIPLE, 7, buf + 0x10000, 0x9200) == 0);
+    CHECK(sim.last_adma);
+    CHECK(sim.descriptors == 2);
+    CHECK(!memcmp(card + 7 * 512, buf + 0x10000, 0x9200));
+}
+
+static void test_sdma(void)
+{
+    setup();
+    memset(buf, 0, sizeof(buf));
+
+    /* without ADMA2 one plain buffer goes through SDMA */
+    host.flags &= ~SHF_USE_ADMA2;
+    CHECK(sdhc_max_block_count(&host) == SDHC_CMD_BLOCK_COUNT_MAX);
+    CHECK(run(MMC_READ_BLOCK_MULTIPLE, 300, buf, 0x8000) == 0);
+    CHECK(!sim.last_adma);
+    CHECK((HREAD1(&host, SDHC_HOST_CTL) & SDHC_DMA_SELECT_MASK) == SDHC_DMA_SELECT_SDMA);
+    CHECK(HREAD4(&host, SDHC_DMA_ADDR) == hw_ptr32(buf));
+    CHECK(!memcmp(buf, card + 300 * 512, 0x8000));
+}
+
+static void test_adma2_error(void)
+{
+    setup();
+
+    /* the host drops ADMA2 and the command says it can be issued again */
+    sim.adma_fail = 1;
+    CHECK(run(MMC_READ_BLOCK_MULTIPLE, 0, buf, 0x1000) == SDHC_EADMA);
+    CHECK(sim.adma_errors == 1);
+    CHECK(!ISSET(host.flags, SHF_USE_ADMA2));
+
+    memset(buf, 0, 0x1000);
+    CHECK(run(MMC_READ_BLOCK_MULTIPLE, 0, buf, 0x1000) == 0);
+    CHECK(!sim.last_adma);
+    CHECK(!memcmp(buf, card, 0x1000));
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_build();
+    test_attach_caps();
+    test_adma2_read();
+    test_adma2_write();
+    test_sdma();
+    test_adma2_error();
+
+    return hw_done("sdhc_adma2");
+}
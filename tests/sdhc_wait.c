@@ -0,0 +1,189 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  sdhc_wait_intr() against a simulated controller that completes after a
+ *  set latency, or never: the wait has to sleep until the host interrupts
+ *  and give up at its deadline even if the host stays quiet.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdhc.c"
+#include "sdhc_sim.h"
+
+#define CARD_BLOCKS     2048
+#define MS(x)           ((u64)(x) * HW_TICKS_PER_MS)
+
+static u8 card[CARD_BLOCKS * 512] ALIGNED(32);
+static u8 buf[0x20000] ALIGNED(32);
+
+static struct sdhc_sim sim;
+static struct sdhc_host host;
+
+static void test_attach(struct sdhc_host *hp) { (void)hp; }
+static void test_abort(void) {}
+
+/* what sdcard_irq() does */
+static void test_sd0_irq(void)
+{
+    sdhc_intr(&host);
+}
+
+static void setup(int use_irq, u64 cmd_latency, u64 block_latency)
+{
+    struct sdhc_host_params params = {
+        .attach = &test_attach,
+        .abort = &test_abort,
+        .rb = RB_SD0,
+        .wb = WB_SD0,
+    };
+
+    /* without the interrupt controller bit the wait has to poll */
+    if (use_irq) {
+        params.irq_mask_reg = LT_INTMR_AHBALL_ARM;
+        params.irq_status_reg = LT_INTSR_AHBALL_ARM;
+        params.irq_flag = IRQF_SD0;
+    }
+
+    hw_reset();
+    sdhc_sim_init(&sim, card, CARD_BLOCKS);
+    hw_set_irq_handler(IRQ_SD0, test_sd0_irq);
+
+    sdhc_host_found(&host, &params, 0, SDHC_SIM_BASE, 1);
+    if (use_irq)
+        irq_enable(IRQ_SD0);
+
+    sim.cmd_latency = cmd_latency;
+    sim.block_latency = block_latency;
+}
+
+static int run(u32 opcode, u32 blk, void *data, u32 len)
+{
+    struct sdmmc_command cmd = {0};
+
+    cmd.c_opcode = opcode;
+    cmd.c_arg = blk;
+    cmd.c_data = data;
+    cmd.c_datalen = len;
+    cmd.c_blklen = 512;
+    cmd.c_flags = (data ? SCF_CMD_ADTC | SCF_CMD_READ : SCF_CMD_AC) | SCF_RSP_R1;
+
+    hw_mmio_reads = 0;
+    hw_irq_waits = 0;
+    hw_irq_hangs = 0;
+
+    sdhc_exec_command(&host, &cmd);
+    return cmd.c_error;
+}
+
+/* the wait is done with the timer: it's off again and the alarm doesn't repeat */
+static void check_timer_released(void)
+{
+    CHECK(!(read32(LT_INTMR_AHBALL_ARM) & IRQF_TIMER));
+    CHECK(hw_alarm_frequency() == 0);
+}
+
+static void test_command_latency(void)
+{
+    /* the card takes 3ms to answer */
+    setup(1, MS(3), 0);
+
+    u64 start = hw_ticks;
+    CHECK(run(MMC_SEND_STATUS, 0, NULL, 0) == 0);
+    CHECK(hw_ticks - start >= MS(3));
+    CHECK(hw_ticks - start < MS(3) + MS(1) / 10);
+
+    /* slept through it: a couple of wake ups, not a register poll per tick */
+    CHECK(hw_irq_waits >= 1 && hw_irq_waits <= 2);
+    CHECK(hw_irq_hangs == 0);
+    CHECK(hw_mmio_reads < 100);
+    check_timer_released();
+}
+
+static void test_transfer_latency(void)
+{
+    /* 64 blocks at 40ms each, 2.56s all in all, under the 5s limit */
+    setup(1, MS(1), MS(40));
+    for (u32 i = 0; i < sizeof(card); i++)
+        card[i] = i * 7;
+    memset(buf, 0, sizeof(buf));
+
+    u64 start = hw_ticks;
+    CHECK(run(MMC_READ_BLOCK_MULTIPLE, 16, buf, 64 * 512) == 0);
+    CHECK(hw_ticks - start >= MS(1) + MS(40) * 64);
+    CHECK(hw_ticks - start < MS(1) + MS(40) * 64 + MS(1));
+    CHECK(hw_irq_hangs == 0);
+    CHECK(hw_irq_waits <= 4);
+    CHECK(!memcmp(buf, card + 16 * 512, 64 * 512));
+    check_timer_released();
+}
+
+static void test_no_answer(void)
+{
+    /* the card never answers: the alarm has to end the wait at 500ms */
+    setup(1, HW_NEVER, 0);
+
+    u64 start = hw_ticks;
+    CHECK(run(MMC_SEND_STATUS, 0, NULL, 0) == ETIMEDOUT);
+    CHECK(hw_ticks - start >= MS(SDHC_COMMAND_TIMEOUT));
+    CHECK(hw_ticks - start < MS(SDHC_COMMAND_TIMEOUT) + MS(1));
+    CHECK(hw_irq_hangs == 0);
+    CHECK(hw_irq_waits <= 2);
+    check_timer_released();
+
+    /* and the host still works afterwards */
+    sim.cmd_latency = MS(1);
+    CHECK(run(MMC_SEND_STATUS, 0, NULL, 0) == 0);
+    CHECK(hw_irq_hangs == 0);
+}
+
+static void test_transfer_too_slow(void)
+{
+    /* 8 blocks at 1s each: the transfer gives up at 5s */
+    setup(1, MS(1), MS(1000));
+
+    u64 start = hw_ticks;
+    CHECK(run(MMC_READ_BLOCK_MULTIPLE, 0, buf, 8 * 512) == ETIMEDOUT);
+    CHECK(hw_ticks - start >= MS(1) + MS(SDHC_TRANSFER_TIMEOUT));
+    CHECK(hw_ticks - start < MS(1) + MS(SDHC_TRANSFER_TIMEOUT) + MS(1));
+    CHECK(hw_irq_hangs == 0);
+    check_timer_released();
+}
+
+static void test_polled(void)
+{
+    /* no interrupt to sleep on: polls, but still keeps to the latency and the deadline */
+    setup(0, MS(2), 0);
+
+    u64 start = hw_ticks;
+    CHECK(run(MMC_SEND_STATUS, 0, NULL, 0) == 0);
+    CHECK(hw_ticks - start >= MS(2));
+    CHECK(hw_ticks - start < MS(3));
+    CHECK(hw_irq_waits == 0);
+
+    sim.cmd_latency = HW_NEVER;
+    start = hw_ticks;
+    CHECK(run(MMC_SEND_STATUS, 0, NULL, 0) == ETIMEDOUT);
+    CHECK(hw_ticks - start >= MS(SDHC_COMMAND_TIMEOUT));
+    CHECK(hw_ticks - start < MS(SDHC_COMMAND_TIMEOUT) + MS(1));
+    CHECK(hw_irq_waits == 0);
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_command_latency();
+    test_transfer_latency();
+    test_no_answer();
+    test_transfer_too_slow();
+    test_polled();
+
+    return hw_done("sdhc_wait");
+}
@@ -0,0 +1,154 @@
+/*
+ *  minute - a port of the "mini" IOS replacement for the Wii U.
+ *
+ *  sha.c on the SHA engine: digests of FIPS 180-1 vectors, and how the data
+ *  gets to the engine. Aligned buffers go straight to it in commands as big
+ *  as the block count field allows, only the rest is copied to the bounce
+ *  buffer. Runs with the engine interrupt and without.
+ *
+ *  This code is licensed to you under the terms of the GNU GPL, version 2;
+ *  see file COPYING or http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha.c"
+#include "sha_sim.h"
+
+#define BIG_SIZE    (1 << 20)
+#define BIG_BLOCKS  (BIG_SIZE / SHA_BLOCK_SIZE)
+
+static u8 big[BIG_SIZE + SHA_BLOCK_SIZE] ALIGNED(SHA_DMA_ALIGN);
+static struct sha_sim sim;
+
+static int matches(const u8 *got, const char *expect)
+{
+    char hex[SHA_HASH_SIZE * 2 + 1];
+
+    for (int i = 0; i < SHA_HASH_SIZE; i++)
+        sprintf(hex + i * 2, "%02x", got[i]);
+    if (!strcmp(hex, expect))
+        return 1;
+
+    printf("  got    %s\n  expect %s\n", hex, expect);
+    return 0;
+}
+
+static void setup(int use_irq)
+{
+    hw_reset();
+    sha_sim_init(&sim);
+    sim.bounce = sha_bounce;
+    sim.bounce_size = sizeof(sha_bounce);
+
+    hw_set_irq_handler(IRQ_SHA1, sha_irq);
+    if (use_irq)
+        irq_enable(IRQ_SHA1);
+}
+
+static void test_vectors(int use_irq)
+{
+    const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    u8 h[SHA_HASH_SIZE];
+
+    setup(use_irq);
+
+    sha_hash("abc", h, 3);
+    CHECK(matches(h, "a9993e364706816aba3e25717850c26c9cd0d89d"));
+
+    sha_hash(two, h, strlen(two));
+    CHECK(matches(h, "84983e441c3bd26ebaae4aa1f95129e5e54670f1"));
+
+    sha_hash("", h, 0);
+    CHECK(matches(h, "da39a3ee5e6b4b0d3255bfef95601890afd80709"));
+
+    /* a million 'a', at both alignments */
+    memset(big, 'a', sizeof(big));
+    sha_hash(big, h, 1000000);
+    CHECK(matches(h, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+    sha_hash(big + 3, h, 1000000);
+    CHECK(matches(h, "34aa973cd4c4daa4f61eeb2bdbad27316534016f"));
+
+    CHECK(sim.busy_writes == 0);
+    CHECK(hw_irq_hangs == 0);
+    if (!use_irq)
+        CHECK(hw_irq_waits == 0);
+}
+
+static void test_zero_copy(void)
+{
+    u8 h[SHA_HASH_SIZE], expect[SHA_HASH_SIZE];
+
+    setup(1);
+    for (u32 i = 0; i < sizeof(big); i++)
+        big[i] = i * 13 + (i >> 11);
+
+    /*
+     * An aligned MiB: the first block goes through ctx->buffer and the rest
+     * is DMAed in place, 1024 blocks a command. Padding and the wipe at the
+     * end are the only other blocks that get copied.
+     */
+    sha_sim_clear_stats(&sim);
+    sha_hash(big, expect, BIG_SIZE);
+    CHECK(sim.largest == SHA_CMD_AREA_BLOCK + 1);
+    CHECK(sim.bounced <= 3);
+    CHECK(sim.blocks == BIG_BLOCKS + 2);
+    CHECK(sim.commands <= (BIG_BLOCKS - 1) / (SHA_CMD_AREA_BLOCK + 1) + 1 + 3);
+
+    /* the same data unaligned: all of it is bounced, a bounce buffer at a time */
+    memmove(big + 1, big, BIG_SIZE);
+    sha_sim_clear_stats(&sim);
+    sha_hash(big + 1, h, BIG_SIZE);
+    CHECK(!memcmp(h, expect, sizeof(h)));
+    CHECK(sim.bounced == sim.blocks);
+    CHECK(sim.largest == SHA_BOUNCE_BLOCKS);
+    CHECK(sim.blocks == BIG_BLOCKS + 2);
+    CHECK(sim.busy_writes == 0);
+}
+
+static void test_async(void)
+{
+    static const u32 init[SHA_HASH_WORDS] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    u32 state[2][SHA_HASH_WORDS];
+
+    for (int use_irq = 0; use_irq < 2; use_irq++) {
+        setup(use_irq);
+        sim.block_latency = HW_TICKS_PER_MS / 1024;
+        memcpy(state[use_irq], init, sizeof(init));
+        hw_irq_waits = 0;
+
+        /* 2048 blocks: two commands, 2ms of engine time, submitting doesn't wait for it */
+        u64 start = hw_ticks;
+        u32 handle = sha_submit(state[use_irq], big, 2048);
+        CHECK(!sha_poll(handle));
+        CHECK(hw_ticks - start < sim.block_latency * 1024);
+
+        sha_wait(handle);
+        CHECK(sha_poll(handle));
+        CHECK(sim.commands == 2);
+        CHECK(hw_ticks - start >= sim.block_latency * 2048);
+        CHECK(hw_irq_hangs == 0);
+
+        /* with the IRQ the second command is chained from it and the wait sleeps */
+        if (use_irq)
+            CHECK(hw_irq_waits >= 1 && hw_irq_waits <= 2);
+        else
+            CHECK(hw_irq_waits == 0);
+    }
+    CHECK(!memcmp(state[0], state[1], sizeof(state[0])));
+}
+
+int test_main(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    test_vectors(1);
+    test_vectors(0);
+    test_zero_copy();
+    test_async();
+
+    return hw_done("sha_engine");
+}